@@ -0,0 +1,383 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "../instrumentation.h"
+#include "../job_system.hpp"
+
+// Screen recording and screenshots. Frames are RGBA8 with row 0 at the bottom (glReadPixels
+// order); the backends hand them over without waiting (capture_gl.hpp reads the GL back
+// buffer through a ring of pixel-pack buffers) and low-priority jobs encode them in order.
+enum class capture_format : int
+{
+    png,  // numbered files path_000000.png, stored (uncompressed) deflate
+    y4m,  // YUV4MPEG2 4:2:0 video, full-range BT.601
+    raw,  // RGBA8 frames back to back, top row first
+};
+
+inline capture_format capture_format_for(const std::string& path)
+{
+    auto ends = [&](const char* s){
+        const size_t n = std::strlen(s);
+        return path.size() >= n && 0 == path.compare(path.size() - n, n, s);
+    };
+    return ends(".png") ? capture_format::png : ends(".y4m") ? capture_format::y4m : capture_format::raw;
+}
+
+// What a frame is read back for: the running recording (by session) and/or a screenshot.
+struct capture_request
+{
+    int session = 0;         // 0: not part of a recording
+    std::string screenshot;  // PNG path, "" for none
+};
+
+struct capture_frame
+{
+    int w = 0, h = 0;
+    const uint8_t* pixels = nullptr;  // w * h * 4 bytes, owned or mapped
+    std::vector<uint8_t> owned;
+    std::function<void()> release;    // called once the encoder is done with pixels
+    capture_request request;
+};
+
+// ---------- encoders ----------
+inline uint32_t capture_crc32(uint32_t crc, const uint8_t* p, size_t n)
+{
+    static const auto table = []{
+        std::vector<uint32_t> t(256);
+        for(uint32_t i = 0; i < 256; ++i){
+            uint32_t c = i;
+            for(int k = 0; k < 8; ++k) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for(size_t i = 0; i < n; ++i) crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+// RGB8 PNG without a zlib dependency: filter 0 rows in stored deflate blocks.
+inline bool write_png(const std::string& path, const capture_frame& f)
+{
+    std::FILE* out = std::fopen(path.c_str(), "wb");
+    if(!out){ std::cerr << "can not write " << path << "\n"; return false; }
+    auto be32 = [](uint8_t* p, uint32_t v){ p[0] = uint8_t(v >> 24); p[1] = uint8_t(v >> 16); p[2] = uint8_t(v >> 8); p[3] = uint8_t(v); };
+    auto chunk = [&](const char* type, const uint8_t* data, size_t n){
+        uint8_t head[8];
+        be32(head, uint32_t(n));
+        std::memcpy(head + 4, type, 4);
+        uint8_t tail[4];
+        be32(tail, capture_crc32(capture_crc32(0, head + 4, 4), data, n));
+        std::fwrite(head, 1, 8, out);
+        if(n) std::fwrite(data, 1, n, out);
+        std::fwrite(tail, 1, 4, out);
+    };
+    std::fwrite("\x89PNG\r\n\x1a\n", 1, 8, out);
+    uint8_t ihdr[13] = {};
+    be32(ihdr, uint32_t(f.w));
+    be32(ihdr + 4, uint32_t(f.h));
+    ihdr[8] = 8;  // bit depth
+    ihdr[9] = 2;  // RGB
+    chunk("IHDR", ihdr, sizeof(ihdr));
+
+    // scanlines, top row first, each led by its filter byte
+    const size_t line = size_t(f.w) * 3 + 1, raw = line * f.h;
+    std::vector<uint8_t> z;
+    z.reserve(raw + raw / 65535 * 5 + 16);
+    z.push_back(0x78);
+    z.push_back(0x01);
+    std::vector<uint8_t> scan(line);
+    uint32_t a = 1, b = 0;  // adler32
+    size_t block = 0;       // bytes left in the current stored block
+    size_t left = raw;
+    for(int y = f.h - 1; y >= 0; --y){
+        const uint8_t* src = f.pixels + size_t(y) * f.w * 4;
+        scan[0] = 0;
+        for(int x = 0; x < f.w; ++x){
+            scan[1 + x * 3] = src[x * 4];
+            scan[2 + x * 3] = src[x * 4 + 1];
+            scan[3 + x * 3] = src[x * 4 + 2];
+        }
+        for(size_t i = 0; i < line;){
+            if(0 == block){
+                block = std::min<size_t>(left, 65535);
+                left -= block;
+                const uint16_t len = uint16_t(block), nlen = uint16_t(~len);
+                z.push_back(left ? 0 : 1);
+                z.push_back(uint8_t(len));
+                z.push_back(uint8_t(len >> 8));
+                z.push_back(uint8_t(nlen));
+                z.push_back(uint8_t(nlen >> 8));
+            }
+            const size_t n = std::min(block, line - i);
+            z.insert(z.end(), scan.begin() + i, scan.begin() + i + n);
+            for(size_t k = i; k < i + n; ++k){
+                a += scan[k];
+                b += a;
+                if(a >= 65521) a -= 65521;
+                if(b >= 65521) b -= 65521;
+            }
+            i += n;
+            block -= n;
+        }
+    }
+    uint8_t adler[4];
+    be32(adler, b << 16 | a);
+    z.insert(z.end(), adler, adler + 4);
+    chunk("IDAT", z.data(), z.size());
+    chunk("IEND", nullptr, 0);
+    const bool ok = std::fclose(out) == 0;
+    if(!ok) std::cerr << "can not write " << path << "\n";
+    return ok;
+}
+
+// one 4:2:0 frame, full-range BT.601; odd sizes are cut to even
+inline void rgba_to_i420(const capture_frame& f, std::vector<uint8_t>& yuv)
+{
+    const int w = f.w & ~1, h = f.h & ~1, cw = w / 2, ch = h / 2;
+    yuv.resize(size_t(w) * h + 2 * size_t(cw) * ch);
+    uint8_t* Y = yuv.data();
+    uint8_t* U = Y + size_t(w) * h;
+    uint8_t* V = U + size_t(cw) * ch;
+    job_system::current().parallel_for(0, ch, [&](int b, int e){
+        for(int cy = b; cy < e; ++cy)
+            for(int r = 0; r < 2; ++r){
+                const uint8_t* s0 = f.pixels + size_t(f.h - 1 - (2 * cy + r)) * f.w * 4;
+                uint8_t* yrow = Y + size_t(2 * cy + r) * w;
+                for(int x = 0; x < w; ++x){
+                    const int R = s0[x * 4], G = s0[x * 4 + 1], B = s0[x * 4 + 2];
+                    yrow[x] = uint8_t((19595 * R + 38470 * G + 7471 * B + 32768) >> 16);
+                }
+            }
+        for(int cy = b; cy < e; ++cy){
+            const uint8_t* s0 = f.pixels + size_t(f.h - 1 - 2 * cy) * f.w * 4;
+            const uint8_t* s1 = s0 - size_t(f.w) * 4;
+            for(int cx = 0; cx < cw; ++cx){
+                const uint8_t* p = s0 + cx * 8;
+                const uint8_t* q = s1 + cx * 8;
+                const int R = p[0] + p[4] + q[0] + q[4], G = p[1] + p[5] + q[1] + q[5], B = p[2] + p[6] + q[2] + q[6];
+                U[size_t(cy) * cw + cx] = uint8_t(std::clamp((-11059 * R - 21709 * G + 32768 * B + (128 << 18) + (1 << 17)) >> 18, 0, 255));
+                V[size_t(cy) * cw + cx] = uint8_t(std::clamp((32768 * R - 27439 * G - 5329 * B + (128 << 18) + (1 << 17)) >> 18, 0, 255));
+            }
+        }
+    }, 8, job_priority::low);
+}
+
+// ---------- capture sink ----------
+// Owned by a window. start()/stop()/screenshot() come from any thread, due() and push() from
+// the render thread. Frames are encoded by one low-priority job at a time, so a recording
+// stays in order; when more than max_queued frames wait, recording frames are dropped.
+// Stats: <prefix>.frames, .dropped, .encode_ms; the windows publish as capture.window<n>.
+struct frame_capture
+{
+    static constexpr size_t max_queued = 3;
+
+    ~frame_capture()
+    {
+        stop();
+        flush();
+    }
+    // record every frame that is due at `fps`; the format follows the extension
+    bool start(const std::string& path, int fps = 60)
+    {
+        stop();
+        std::lock_guard<std::mutex> lock(m);
+        fmt = capture_format_for(path);
+        if(fmt != capture_format::png){
+            out = std::fopen(path.c_str(), "wb");
+            if(!out){ std::cerr << "can not write " << path << "\n"; return false; }
+        }
+        base = fmt == capture_format::png ? path.substr(0, path.size() - 4) : path;
+        rate = std::max(1, fps);
+        period_ns = int64_t(1e9 / rate);
+        next_ns = 0;
+        written = 0;
+        dropped_before = dropped;
+        header = false;
+        session = ++sessions;
+        armed = true;
+        std::cout << "recording " << path << " at " << rate << " fps\n";
+        return true;
+    }
+    // encodes the frames queued so far, then closes the recording
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            if(0 == session) return;
+            armed = false;
+        }
+        flush();
+        std::lock_guard<std::mutex> lock(m);
+        session = 0;
+        if(out) std::fclose(out);
+        out = nullptr;
+        std::cout << "recorded " << written << " frames (" << dropped - dropped_before << " dropped)\n";
+    }
+    bool recording() const
+    {
+        std::lock_guard<std::mutex> lock(m);
+        return armed;
+    }
+    // F10: start or stop recording_<n>.y4m
+    void toggle()
+    {
+        if(recording()){
+            stop();
+            return;
+        }
+        int n;
+        {
+            std::lock_guard<std::mutex> lock(m);
+            n = sessions + 1;
+        }
+        start("recording_" + std::to_string(n) + ".y4m");
+    }
+    // PNG of the next rendered frame; "" names it screenshot_<n>.png
+    void screenshot(std::string path = "")
+    {
+        std::lock_guard<std::mutex> lock(m);
+        if(path.empty()) path = "screenshot_" + std::to_string(++shots) + ".png";
+        shot = path;
+    }
+    // render thread: whether the frame rendered at t_ns should be read back, and for what
+    bool due(int64_t t_ns, capture_request& r)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        r = {};
+        if(armed && t_ns >= next_ns){
+            r.session = session;
+            // keep the frame rate, but do not catch up after a stall
+            next_ns = std::max(next_ns + period_ns, t_ns - period_ns / 2);
+        }
+        r.screenshot.swap(shot);
+        return r.session || !r.screenshot.empty();
+    }
+    // render thread: queue a frame, or release it right away when the encoder is behind
+    void push(capture_frame&& f)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        if(queue.size() >= max_queued && f.request.screenshot.empty()){
+            ++dropped;
+            if(f.release) f.release();
+            return;
+        }
+        queue.push_back(std::move(f));
+        drain();
+    }
+    // copy of pixels the caller keeps using (the software framebuffer)
+    void push_copy(const uint32_t* rgba, int w, int h, const capture_request& r)
+    {
+        capture_frame f;
+        f.w = w;
+        f.h = h;
+        f.owned.resize(size_t(w) * h * 4);
+        std::memcpy(f.owned.data(), rgba, f.owned.size());
+        f.pixels = f.owned.data();
+        f.request = r;
+        push(std::move(f));
+    }
+    // render thread: the backend could not read back the frame due() asked for. A recording
+    // frame counts as dropped, a screenshot is taken from the next frame instead.
+    void drop(capture_request& r)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        if(r.session) ++dropped;
+        if(r.screenshot.empty()) return;
+        if(shot.empty()) shot.swap(r.screenshot);
+        else std::cerr << "screenshot " << r.screenshot << " skipped, " << shot << " is taken instead\n";
+    }
+    // block until the queued frames are encoded
+    void flush()
+    {
+        job_system::current().wait(jobs);
+    }
+    void publish(instrumentation& stats, const std::string& prefix = "capture") const
+    {
+        std::lock_guard<std::mutex> lock(m);
+        stats.set(prefix + ".frames", double(encoded));
+        stats.set(prefix + ".dropped", double(dropped));
+        stats.set(prefix + ".encode_ms", encode_ms);
+    }
+
+private:
+    // with m held: start the encoder job unless one runs
+    void drain()
+    {
+        if(draining) return;
+        draining = true;
+        job_system::current().submit([this]{
+            std::unique_lock<std::mutex> lock(m);
+            while(!queue.empty()){
+                capture_frame f = std::move(queue.front());
+                queue.pop_front();
+                const int live = session;
+                lock.unlock();
+                const auto t0 = std::chrono::steady_clock::now();
+                encode(f, live);
+                if(f.release) f.release();
+                const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+                lock.lock();
+                encode_ms = ms;
+            }
+            draining = false;
+        }, job_priority::low, &jobs);
+    }
+    // encoder job only; the stream fields change under m while no job runs (stop flushes first),
+    // frames of a recording that was stopped meanwhile are left out
+    void encode(const capture_frame& f, int live)
+    {
+        if(!f.request.screenshot.empty()) write_png(f.request.screenshot, f);
+        if(0 == f.request.session || f.request.session != live) return;
+        if(fmt == capture_format::png){
+            char n[16];
+            std::snprintf(n, sizeof(n), "_%06zu.png", written);
+            write_png(base + n, f);
+        }
+        else if(fmt == capture_format::y4m){
+            if(!header){
+                std::fprintf(out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", f.w & ~1, f.h & ~1, rate);
+                header = true;
+                frame_w = f.w;
+                frame_h = f.h;
+            }
+            if(f.w != frame_w || f.h != frame_h) return;  // y4m can not change size
+            rgba_to_i420(f, yuv);
+            std::fputs("FRAME\n", out);
+            std::fwrite(yuv.data(), 1, yuv.size(), out);
+        }
+        else{
+            for(int y = f.h - 1; y >= 0; --y) std::fwrite(f.pixels + size_t(y) * f.w * 4, 1, size_t(f.w) * 4, out);
+        }
+        ++written;
+        ++encoded;
+    }
+
+    mutable std::mutex m;
+    std::deque<capture_frame> queue;
+    bool draining = false;
+    job_group jobs;
+    int session = 0, sessions = 0, shots = 0;
+    bool armed = false;  // due() hands out frames of the session
+    std::string shot;
+    capture_format fmt = capture_format::y4m;
+    std::string base;
+    std::FILE* out = nullptr;
+    int rate = 60;
+    int64_t period_ns = 0, next_ns = 0;
+    bool header = false;
+    int frame_w = 0, frame_h = 0;
+    std::vector<uint8_t> yuv;
+    size_t written = 0, encoded = 0, dropped = 0, dropped_before = 0;
+    double encode_ms = 0;
+};
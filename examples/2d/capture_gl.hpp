@@ -0,0 +1,163 @@
+#pragma once
+#ifdef __APPLE__
+#   include <OpenGL/gl3.h>
+#else
+#   include <GL/glew.h>
+#endif
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "capture.hpp"
+
+// Asynchronous read back of the GL back buffer for frame_capture. When a frame is due,
+// frame() queues a glReadPixels into the next free pixel-pack buffer and returns at once.
+// Buffers whose fence signalled (without fences: ring - 1 frames later) are mapped and the
+// pixels go to the encoder as they are; the buffer is unmapped once the encoder released it.
+// When every buffer is still in flight the frame is dropped instead of stalling (a pending
+// screenshot moves to the next frame).
+struct pbo_capture
+{
+    static constexpr int ring = 4;
+
+    // render thread, with the context current
+    void init(bool use_fences)
+    {
+        fences = use_fences;
+        glGenBuffers(ring, pbo);
+    }
+    // render thread, after drawing and before the swap; returns the milliseconds it took
+    double frame(int w, int h, int64_t t_ns, frame_capture& sink)
+    {
+        const auto t0 = std::chrono::steady_clock::now();
+        ++tick;
+        unmap_released();
+        capture_request r;
+        if(sink.due(t_ns, r)) read(w, h, r, sink);
+        map_complete(sink);
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    }
+    // render thread, before the context goes: waits for the encoder, then frees the buffers
+    void release(frame_capture& sink)
+    {
+        sink.flush();
+        for(int k = 0; k < ring; ++k){
+            slot& s = slots[k];
+            if(s.state == encoding){
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[k]);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            drop_fence(s);
+            s.state = idle;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glDeleteBuffers(ring, pbo);
+    }
+private:
+    enum state_t { idle, reading, encoding };
+    struct slot
+    {
+        state_t state = idle;
+        std::atomic<bool> released{false};
+        size_t bytes = 0;
+        int w = 0, h = 0;
+        uint64_t frame = 0, issued = 0;
+        capture_request request;
+#ifdef GL_SYNC_GPU_COMMANDS_COMPLETE
+        GLsync fence = nullptr;
+#endif
+    };
+    void read(int w, int h, capture_request& r, frame_capture& sink)
+    {
+        slot* s = nullptr;
+        for(slot& c : slots)
+            if(c.state == idle){ s = &c; break; }
+        if(!s || w <= 0 || h <= 0){
+            sink.drop(r);
+            return;
+        }
+        const size_t bytes = size_t(w) * h * 4;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[s - slots]);
+        if(bytes != s->bytes){
+            glBufferData(GL_PIXEL_PACK_BUFFER, GLsizeiptr(bytes), nullptr, GL_STREAM_READ);
+            s->bytes = bytes;
+        }
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+#ifdef GL_SYNC_GPU_COMMANDS_COMPLETE
+        if(fences) s->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+        s->w = w;
+        s->h = h;
+        s->request = r;
+        s->frame = ++reads;
+        s->issued = tick;
+        s->state = reading;
+    }
+    void unmap_released()
+    {
+        for(int k = 0; k < ring; ++k){
+            slot& s = slots[k];
+            if(s.state == encoding && s.released.load()){
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[k]);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                s.state = idle;
+            }
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    // hand over completed read backs oldest first, so a recording stays in order
+    void map_complete(frame_capture& sink)
+    {
+        for(;;){
+            slot* s = nullptr;
+            for(slot& c : slots)
+                if(c.state == reading && (!s || c.frame < s->frame)) s = &c;
+            if(!s || !complete(*s)) break;
+            const int k = int(s - slots);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[k]);
+            const void* p = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            if(!p){
+                s->state = idle;
+                sink.drop(s->request);
+                continue;
+            }
+            s->state = encoding;
+            s->released = false;
+            capture_frame f;
+            f.w = s->w;
+            f.h = s->h;
+            f.pixels = static_cast<const uint8_t*>(p);
+            f.release = [s]{ s->released = true; };
+            f.request = std::move(s->request);
+            sink.push(std::move(f));
+        }
+    }
+    bool complete(slot& s)
+    {
+#ifdef GL_SYNC_GPU_COMMANDS_COMPLETE
+        if(s.fence){
+            const GLenum r = glClientWaitSync(s.fence, 0, 0);
+            if(r != GL_ALREADY_SIGNALED && r != GL_CONDITION_SATISFIED) return false;
+            drop_fence(s);
+            return true;
+        }
+#endif
+        // no fences: by now the transfer has most likely finished, mapping waits otherwise
+        return tick - s.issued >= uint64_t(ring - 1);
+    }
+    void drop_fence(slot& s)
+    {
+#ifdef GL_SYNC_GPU_COMMANDS_COMPLETE
+        if(s.fence) glDeleteSync(s.fence);
+        s.fence = nullptr;
+#else
+        (void)s;
+#endif
+    }
+    GLuint pbo[ring] = {};
+    slot slots[ring];
+    bool fences = false;
+    uint64_t reads = 0, tick = 0;
+};
@@ -0,0 +1,75 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+
+// How two textures of the window are compared; all views use the window's camera.
+//   split:       A left of the slider, B right of it (right mouse button drags the slider)
+//   flicker:     A and B alternate at flicker_hz
+//   abs_diff:    |B - A| in source units through inferno, 0 .. diff_range
+//   signed_diff: B - A, blue (negative) - white - red (positive), -diff_range .. diff_range
+// The difference views need the GL 3.3 window; the others show them as split.
+enum class compare_view : int { off, split, flicker, abs_diff, signed_diff };
+
+// Written from any thread (C cycles the view), read by the render thread every frame.
+struct compare_state
+{
+    // texture indices in append order
+    compare_state& set(int texture_a, int texture_b, compare_view v = compare_view::split)
+    {
+        a = texture_a;
+        b = texture_b;
+        view = int(v);
+        return *this;
+    }
+    compare_state& set_view(compare_view v)
+    {
+        view = int(v);
+        return *this;
+    }
+    // slider position as a fraction of the window width
+    compare_state& set_split(float fraction)
+    {
+        split = fraction < 0.0f ? 0.0f : fraction > 1.0f ? 1.0f : fraction;
+        return *this;
+    }
+    // 0: a tenth of A's display range
+    compare_state& set_diff_range(float range)
+    {
+        diff_range = range;
+        return *this;
+    }
+    compare_state& set_flicker_hz(float hz)
+    {
+        flicker_hz = hz;
+        return *this;
+    }
+    // off -> split -> flicker -> abs_diff -> signed_diff -> off
+    compare_state& cycle()
+    {
+        const int v = view.load() + 1;
+        view = v > int(compare_view::signed_diff) ? int(compare_view::off) : v;
+        return *this;
+    }
+    compare_view current() const
+    {
+        return a < 0 || b < 0 ? compare_view::off : compare_view(view.load());
+    }
+    // a view is selected and both textures exist among the first `textures`
+    bool active(size_t textures) const
+    {
+        return current() != compare_view::off && size_t(a.load()) < textures && size_t(b.load()) < textures;
+    }
+    // flicker phase: true while B is shown
+    bool flicker_b() const
+    {
+        const double s = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        return flicker_hz > 0 && std::fmod(s * flicker_hz, 2.0) >= 1.0;
+    }
+    std::atomic<int> a{-1}, b{-1};
+    std::atomic<int> view{int(compare_view::off)};
+    std::atomic<float> split{0.5f};
+    std::atomic<float> diff_range{0.0f};
+    std::atomic<float> flicker_hz{2.0f};
+};
@@ -0,0 +1,125 @@
+#pragma once
+#ifdef __APPLE__
+#   include <OpenGL/gl3.h>
+#else
+#   include <GL/glew.h>
+#endif
+#include <cmath>
+#include <iostream>
+#include "compare.hpp"
+#include "texture_codec.hpp"
+#include "colormaps.hpp"
+
+// ---------- compare shader (GL 3.3) ----------
+static const char* compareFS = R"(
+#version 330 core
+in vec2 TexCoord;
+out vec4 FragColor;
+uniform sampler2D uA;
+uniform sampler2D uB;
+uniform sampler2D uDiffMap;   // 256x1 inferno
+uniform vec4 uMapA;           // display scale, display offset, value scale, value offset
+uniform vec4 uMapB;
+uniform int uMode;            // compare_view
+uniform int uShowB;           // flicker phase
+uniform float uSplitX;        // slider, in framebuffer pixels
+uniform float uRange;
+void main() {
+    vec3 a = texture(uA, TexCoord).rgb, b = texture(uB, TexCoord).rgb;
+    if(uMode >= 3) {
+        // source units; the channel with the largest difference
+        vec3 d = (b * uMapB.z + uMapB.w) - (a * uMapA.z + uMapA.w);
+        vec3 m = abs(d);
+        float s = m.r >= max(m.g, m.b) ? d.r : (m.g >= m.b ? d.g : d.b);
+        if(uMode == 3) {
+            float t = clamp(abs(s) / uRange, 0.0, 1.0);
+            FragColor = vec4(texture(uDiffMap, vec2((t * 255.0 + 0.5) / 256.0, 0.5)).rgb, 1.0);
+        }
+        else {
+            float t = clamp(s / uRange, -1.0, 1.0);
+            vec3 c = t < 0.0 ? mix(vec3(1.0), vec3(0.23, 0.30, 0.75), -t) : mix(vec3(1.0), vec3(0.71, 0.02, 0.15), t);
+            FragColor = vec4(c, 1.0);
+        }
+        return;
+    }
+    bool showB = uMode == 2 ? uShowB != 0 : gl_FragCoord.x >= uSplitX;
+    vec3 c = showB ? b * uMapB.x + uMapB.y : a * uMapA.x + uMapA.y;
+    if(uMode == 1 && abs(gl_FragCoord.x - uSplitX) < 1.0) c = vec3(1.0, 1.0, 0.2);
+    FragColor = vec4(c, 1.0);
+}
+)";
+
+// Draws a compare_view of two textures in one full-screen pass with the window's quad VAO and
+// camera. Call from the render thread.
+struct compare_renderer
+{
+    bool init(GLuint (*compile)(GLenum, const char*), const char* quad_vs)
+    {
+        GLuint vs = compile(GL_VERTEX_SHADER, quad_vs), fs = compile(GL_FRAGMENT_SHADER, compareFS);
+        program = glCreateProgram();
+        glAttachShader(program, vs);
+        glAttachShader(program, fs);
+        glLinkProgram(program);
+        glDeleteShader(vs);
+        glDeleteShader(fs);
+        GLint ok = 0; glGetProgramiv(program, GL_LINK_STATUS, &ok);
+        if(!ok){
+            char buf[1024]; glGetProgramInfoLog(program, 1024, nullptr, buf);
+            std::cerr << "Compare program link error: " << buf << "\n";
+            glDeleteProgram(program);
+            program = 0;
+            return false;
+        }
+        glGenTextures(1, &diff_map);
+        glBindTexture(GL_TEXTURE_2D, diff_map);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, 256, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, get_colormap_color("inferno").data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return true;
+    }
+    void draw(const compare_state& state, const gpu_texture& a, const gpu_texture& b,
+              float zoom, float panX, float panY, int width)
+    {
+        if(0 == program) return;
+        const compare_view view = state.current();
+        float range = state.diff_range;
+        if(range <= 0) range = 0.1f * std::abs(a.value_scale / a.scale);
+        if(!(range > 0)) range = 1;
+        glUseProgram(program);
+        glUniform1f(glGetUniformLocation(program, "uZoom"), zoom);
+        glUniform2f(glGetUniformLocation(program, "uPan"), panX, panY);
+        glUniform4f(glGetUniformLocation(program, "uMapA"), a.scale, a.offset, a.value_scale, a.value_offset);
+        glUniform4f(glGetUniformLocation(program, "uMapB"), b.scale, b.offset, b.value_scale, b.value_offset);
+        glUniform1i(glGetUniformLocation(program, "uMode"), int(view));
+        glUniform1i(glGetUniformLocation(program, "uShowB"), state.flicker_b() ? 1 : 0);
+        glUniform1f(glGetUniformLocation(program, "uSplitX"), state.split * width);
+        glUniform1f(glGetUniformLocation(program, "uRange"), range);
+        glUniform1i(glGetUniformLocation(program, "uA"), 0);
+        glUniform1i(glGetUniformLocation(program, "uB"), 1);
+        glUniform1i(glGetUniformLocation(program, "uDiffMap"), 2);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, a.id);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, b.id);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, diff_map);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        for(GLenum unit : {GL_TEXTURE2, GL_TEXTURE1, GL_TEXTURE0}){
+            glActiveTexture(unit);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+        glUseProgram(0);
+    }
+    void release()
+    {
+        glDeleteProgram(program);
+        glDeleteTextures(1, &diff_map);
+        program = diff_map = 0;
+    }
+private:
+    GLuint program = 0, diff_map = 0;
+};
@@ -0,0 +1,395 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "../parallel_for.hpp"
+
+// Polylines of one iso-level in image pixels (sample (i,j) sits at pixel centre (i+0.5, j+0.5)).
+// Polyline k is xy[2*starts[k] .. 2*starts[k+1]); closed ones repeat their first point.
+struct contour_lines
+{
+    std::vector<float> xy;
+    std::vector<uint32_t> starts{0};
+    size_t polylines() const { return starts.size() - 1; }
+    size_t points() const { return xy.size() / 2; }
+};
+struct contour_level
+{
+    float level;
+    uint32_t color;  // RGBA8, see rgba()
+    std::shared_ptr<const contour_lines> lines;
+};
+using contour_snapshot = std::shared_ptr<const std::vector<contour_level>>;
+
+// Marching squares over 64x64-cell tiles on all hardware threads.
+// set_field() caches the min/max of every tile and of every 8x8-cell block; a level
+// change then only classifies the blocks whose range straddles the new level, and
+// the other levels are kept as they are. Tile chains are stitched into polylines
+// across tile borders. Saddles are resolved with the cell centre average; cells with
+// a NaN corner produce nothing.
+// Editing calls come from one thread, snapshot() may be called from any thread.
+struct contour_engine
+{
+    static constexpr int tile = 64;
+    static constexpr int block = 8;
+
+    void set_field(const float* data, int w, int h)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        W = w;
+        H = h;
+        field.assign(data, data + size_t(w) * h);
+        const int cw = std::max(0, W - 1), ch = std::max(0, H - 1);
+        bx_n = (cw + block - 1) / block;
+        by_n = (ch + block - 1) / block;
+        tx_n = (cw + tile - 1) / tile;
+        ty_n = (ch + tile - 1) / tile;
+        bmin.assign(size_t(bx_n) * by_n, 0);
+        bmax.assign(size_t(bx_n) * by_n, 0);
+        tmin.assign(size_t(tx_n) * ty_n, 0);
+        tmax.assign(size_t(tx_n) * ty_n, 0);
+        // block ranges include the shared border samples of their cells
+        parallel_for(0, by_n, [&](int b, int e){
+            for(int by = b; by < e; ++by){
+                const int y0 = by * block, y1 = std::min(H - 1, y0 + block);
+                for(int bx = 0; bx < bx_n; ++bx){
+                    const int x0 = bx * block, x1 = std::min(W - 1, x0 + block);
+                    float lo = std::numeric_limits<float>::infinity(), hi = -lo;
+                    for(int y = y0; y <= y1; ++y){
+                        const float* row = field.data() + size_t(y) * W;
+                        for(int x = x0; x <= x1; ++x){
+                            lo = std::min(lo, row[x]);  // NaN never wins
+                            hi = std::max(hi, row[x]);
+                        }
+                    }
+                    bmin[size_t(by) * bx_n + bx] = lo;
+                    bmax[size_t(by) * bx_n + bx] = hi;
+                }
+            }
+        });
+        constexpr int bpt = tile / block;
+        for(int ty = 0; ty < ty_n; ++ty){
+            for(int tx = 0; tx < tx_n; ++tx){
+                float lo = std::numeric_limits<float>::infinity(), hi = -lo;
+                for(int by = ty * bpt; by < std::min(by_n, (ty + 1) * bpt); ++by)
+                    for(int bx = tx * bpt; bx < std::min(bx_n, (tx + 1) * bpt); ++bx){
+                        lo = std::min(lo, bmin[size_t(by) * bx_n + bx]);
+                        hi = std::max(hi, bmax[size_t(by) * bx_n + bx]);
+                    }
+                tmin[size_t(ty) * tx_n + tx] = lo;
+                tmax[size_t(ty) * tx_n + tx] = hi;
+            }
+        }
+        for(auto& l : levels) l.lines = extract(l.level);
+        publish(t0);
+    }
+    int add_level(float level, uint32_t color)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        levels.push_back({level, color, extract(level)});
+        publish(t0);
+        return int(levels.size()) - 1;
+    }
+    void set_level(int i, float level)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        levels[i].level = level;
+        levels[i].lines = extract(level);
+        publish(t0);
+    }
+    void set_color(int i, uint32_t color)
+    {
+        levels[i].color = color;
+        publish(std::chrono::steady_clock::now());
+    }
+    void remove_level(int i)
+    {
+        levels.erase(levels.begin() + i);
+        publish(std::chrono::steady_clock::now());
+    }
+    size_t size() const
+    {
+        return levels.size();
+    }
+    // last edit, extraction included
+    double last_ms() const
+    {
+        return ms;
+    }
+    contour_snapshot snapshot() const
+    {
+        std::lock_guard<std::mutex> lock(m);
+        return published;
+    }
+
+private:
+    static constexpr uint64_t no_edge = ~0ull;
+
+    // edges of the sample grid: horizontal (x,y)-(x+1,y), vertical (x,y)-(x,y+1)
+    uint64_t h_edge(int x, int y) const { return (uint64_t(y) * W + x) * 2; }
+    uint64_t v_edge(int x, int y) const { return (uint64_t(y) * W + x) * 2 + 1; }
+    bool on_tile_border(uint64_t e) const
+    {
+        const uint64_t s = e >> 1;
+        const int x = int(s % W), y = int(s / W);
+        return (e & 1) ? (x % tile == 0 && x > 0 && x < W - 1) : (y % tile == 0 && y > 0 && y < H - 1);
+    }
+
+    // chains of one tile; chain k is xy[2*starts[k] ..), ends[2k], ends[2k+1] its end edges
+    struct tile_chains
+    {
+        std::vector<float> xy;
+        std::vector<uint32_t> starts;
+        std::vector<uint64_t> ends;
+        std::vector<uint8_t> closed;
+    };
+    struct segment
+    {
+        uint64_t e[2];
+        float p[4];
+        int local[2];
+    };
+
+    void process_tile(int tx, int ty, float L, tile_chains& out, std::vector<segment>& segs, std::vector<int>& slots) const
+    {
+        const int cw = W - 1, ch = H - 1;
+        const int x0 = tx * tile, y0 = ty * tile;
+        const int x1 = std::min(cw, x0 + tile), y1 = std::min(ch, y0 + tile);
+        const int tw = x1 - x0, th = y1 - y0;
+        const int nh = tw * (th + 1);
+        segs.clear();
+        auto cross = [&](float a, float b){ return std::min(1.0f, std::max(0.0f, (L - a) / (b - a))); };
+        for(int by = y0 / block; by * block < y1; ++by){
+            for(int bx = x0 / block; bx * block < x1; ++bx){
+                const size_t bi = size_t(by) * bx_n + bx;
+                if(!(bmin[bi] < L && bmax[bi] >= L)) continue;
+                const int cy1 = std::min(y1, (by + 1) * block), cx1 = std::min(x1, (bx + 1) * block);
+                for(int y = by * block; y < cy1; ++y){
+                    const float* r0 = field.data() + size_t(y) * W;
+                    const float* r1 = r0 + W;
+                    for(int x = bx * block; x < cx1; ++x){
+                        const float v0 = r0[x], v1 = r0[x + 1], v2 = r1[x + 1], v3 = r1[x];
+                        const int c = (v0 >= L) | (v1 >= L) << 1 | (v2 >= L) << 2 | (v3 >= L) << 3;
+                        if(c == 0 || c == 15) continue;
+                        if(std::isnan(v0 + v1 + v2 + v3)) continue;
+                        // edge k: 0 bottom, 1 right, 2 top, 3 left
+                        const float fx = x + 0.5f, fy = y + 0.5f;
+                        auto point = [&](int k, float* p){
+                            switch(k){
+                                case 0: p[0] = fx + cross(v0, v1); p[1] = fy; break;
+                                case 1: p[0] = fx + 1; p[1] = fy + cross(v1, v2); break;
+                                case 2: p[0] = fx + cross(v3, v2); p[1] = fy + 1; break;
+                                default: p[0] = fx; p[1] = fy + cross(v0, v3); break;
+                            }
+                        };
+                        auto edge = [&](int k){
+                            switch(k){
+                                case 0: return h_edge(x, y);
+                                case 1: return v_edge(x + 1, y);
+                                case 2: return h_edge(x, y + 1);
+                                default: return v_edge(x, y);
+                            }
+                        };
+                        auto local = [&](int k){
+                            const int lx = x - x0, ly = y - y0;
+                            switch(k){
+                                case 0: return ly * tw + lx;
+                                case 1: return nh + ly * (tw + 1) + lx + 1;
+                                case 2: return (ly + 1) * tw + lx;
+                                default: return nh + ly * (tw + 1) + lx;
+                            }
+                        };
+                        auto emit = [&](int a, int b){
+                            segment s;
+                            s.e[0] = edge(a); s.e[1] = edge(b);
+                            s.local[0] = local(a); s.local[1] = local(b);
+                            point(a, s.p); point(b, s.p + 2);
+                            segs.push_back(s);
+                        };
+                        static const int8_t table[16][4] = {
+                            {-1,-1,-1,-1}, {3,0,-1,-1}, {0,1,-1,-1}, {3,1,-1,-1},
+                            {1,2,-1,-1},   {3,0,1,2},   {0,2,-1,-1}, {3,2,-1,-1},
+                            {2,3,-1,-1},   {0,2,-1,-1}, {0,1,2,3},   {1,2,-1,-1},
+                            {1,3,-1,-1},   {0,1,-1,-1}, {3,0,-1,-1}, {-1,-1,-1,-1},
+                        };
+                        if((c == 5 || c == 10) && (v0 + v1 + v2 + v3) * 0.25f >= L){
+                            // centre inside: the lone outside corners are cut off instead
+                            if(c == 5){ emit(0, 1); emit(2, 3); }
+                            else{ emit(3, 0); emit(1, 2); }
+                            continue;
+                        }
+                        emit(table[c][0], table[c][1]);
+                        if(table[c][2] >= 0) emit(table[c][2], table[c][3]);
+                    }
+                }
+            }
+        }
+        if(segs.empty()) return;
+
+        // every crossed edge is shared by at most two segments of the tile
+        const size_t nslots = size_t(nh) + size_t(tw + 1) * th;
+        if(slots.size() < nslots * 2) slots.resize(nslots * 2, -1);
+        for(int i = 0; i < int(segs.size()); ++i)
+            for(int k = 0; k < 2; ++k){
+                int* s = &slots[size_t(segs[i].local[k]) * 2];
+                s[s[0] < 0 ? 0 : 1] = i;
+            }
+        auto other = [&](int seg, int side){
+            const int* s = &slots[size_t(segs[seg].local[side]) * 2];
+            return s[0] == seg ? s[1] : s[0];
+        };
+        // the side of `next` that touches the edge it shares with `seg` via `side`
+        auto entry_side = [&](int seg, int side, int next){
+            return segs[next].local[0] == segs[seg].local[side] ? 0 : 1;
+        };
+        std::vector<uint8_t> used(segs.size(), 0);
+        for(int i = 0; i < int(segs.size()); ++i){
+            if(used[i]) continue;
+            // walk back to the open end, if any
+            int s = i, side = 0;
+            bool closed = false;
+            for(;;){
+                const int n = other(s, side);
+                if(n < 0) break;
+                if(n == i){ closed = true; break; }
+                const int in = entry_side(s, side, n);
+                s = n;
+                side = 1 - in;
+            }
+            // s/side: chain start; walk forward from the opposite side
+            int cur = s, out_side = closed ? 1 : 1 - side;
+            if(closed){ cur = i; out_side = 1; }
+            const int start_side = 1 - out_side;
+            out.starts.push_back(uint32_t(out.xy.size() / 2));
+            out.ends.push_back(segs[cur].e[start_side]);
+            out.xy.push_back(segs[cur].p[start_side * 2]);
+            out.xy.push_back(segs[cur].p[start_side * 2 + 1]);
+            for(;;){
+                used[cur] = 1;
+                out.xy.push_back(segs[cur].p[out_side * 2]);
+                out.xy.push_back(segs[cur].p[out_side * 2 + 1]);
+                const int n = other(cur, out_side);
+                if(n < 0 || used[n]){
+                    out.ends.push_back(segs[cur].e[out_side]);
+                    break;
+                }
+                const int in = entry_side(cur, out_side, n);
+                cur = n;
+                out_side = 1 - in;
+            }
+            out.closed.push_back(closed);
+        }
+        for(const auto& sg : segs)
+            for(int k = 0; k < 2; ++k) slots[size_t(sg.local[k]) * 2] = slots[size_t(sg.local[k]) * 2 + 1] = -1;
+    }
+
+    std::shared_ptr<const contour_lines> extract(float L) const
+    {
+        auto lines = std::make_shared<contour_lines>();
+        const int n = tx_n * ty_n;
+        if(n <= 0) return lines;
+        std::vector<int> active;
+        for(int t = 0; t < n; ++t) if(tmin[t] < L && tmax[t] >= L) active.push_back(t);
+        std::vector<tile_chains> chains(active.size());
+        std::atomic<int> next{0};
+        const int workers = job_system::current().size();
+        parallel_for(0, std::min(workers, int(active.size())), [&](int, int){
+            std::vector<segment> segs;
+            std::vector<int> slots;
+            for(int i; (i = next.fetch_add(1)) < int(active.size());)
+                process_tile(active[i] % tx_n, active[i] / tx_n, L, chains[i], segs, slots);
+        });
+
+        // join chains whose ends lie on a shared tile border
+        struct ref { uint32_t tile, chain; };
+        std::vector<ref> all;
+        std::unordered_map<uint64_t, uint64_t> border;  // edge -> first end: (index in all) * 2 + side
+        std::vector<std::pair<uint64_t, uint64_t>> link;
+        for(uint32_t t = 0; t < chains.size(); ++t){
+            for(uint32_t c = 0; c < chains[t].closed.size(); ++c){
+                const uint64_t id = all.size();
+                all.push_back({t, c});
+                if(chains[t].closed[c]) continue;
+                for(int side = 0; side < 2; ++side){
+                    const uint64_t e = chains[t].ends[size_t(c) * 2 + side];
+                    if(!on_tile_border(e)) continue;
+                    auto [it, fresh] = border.emplace(e, id * 2 + side);
+                    if(!fresh) link.emplace_back(it->second, id * 2 + side);
+                }
+            }
+        }
+        std::vector<uint64_t> partner(all.size() * 2, no_edge);
+        for(const auto& [a, b] : link){ partner[a] = b; partner[b] = a; }
+
+        std::vector<uint8_t> done(all.size(), 0);
+        auto append = [&](uint64_t id, int from_side, bool skip_first){
+            const tile_chains& tc = chains[all[id].tile];
+            const uint32_t c = all[id].chain;
+            const uint32_t b = tc.starts[c];
+            const uint32_t e = c + 1 < tc.starts.size() ? tc.starts[c + 1] : uint32_t(tc.xy.size() / 2);
+            if(from_side == 0){
+                for(uint32_t p = b + skip_first; p < e; ++p){
+                    lines->xy.push_back(tc.xy[p * 2]); lines->xy.push_back(tc.xy[p * 2 + 1]);
+                }
+            }
+            else{
+                for(uint32_t p = e - 1 - skip_first; p + 1 > b; --p){
+                    lines->xy.push_back(tc.xy[p * 2]); lines->xy.push_back(tc.xy[p * 2 + 1]);
+                }
+            }
+        };
+        for(uint64_t id = 0; id < all.size(); ++id){
+            if(done[id]) continue;
+            // rewind to an unlinked end, or stop when the chain loops back
+            uint64_t s = id;
+            int side = 0;
+            for(;;){
+                const uint64_t p = partner[s * 2 + side];
+                if(p == no_edge || (p >> 1) == id) break;
+                s = p >> 1;
+                side = 1 - int(p & 1);
+            }
+            // walk forward leaving through 1 - side
+            bool first = true;
+            uint64_t cur = s;
+            int in = side;
+            for(;;){
+                done[cur] = 1;
+                append(cur, in, !first);
+                first = false;
+                const uint64_t p = partner[cur * 2 + 1 - in];
+                // a loop closes on the shared edge, so its last point already repeats the first
+                if(p == no_edge || done[p >> 1]) break;
+                cur = p >> 1;
+                in = int(p & 1);
+            }
+            lines->starts.push_back(uint32_t(lines->xy.size() / 2));
+        }
+        return lines;
+    }
+    void publish(std::chrono::steady_clock::time_point t0)
+    {
+        auto snap = std::make_shared<const std::vector<contour_level>>(levels);
+        {
+            std::lock_guard<std::mutex> lock(m);
+            published = std::move(snap);
+        }
+        ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    }
+
+    std::vector<float> field;
+    int W = 0, H = 0;
+    int bx_n = 0, by_n = 0, tx_n = 0, ty_n = 0;
+    std::vector<float> bmin, bmax, tmin, tmax;
+    std::vector<contour_level> levels;
+    mutable std::mutex m;
+    contour_snapshot published = std::make_shared<const std::vector<contour_level>>();
+    double ms = 0;
+};
@@ -0,0 +1,100 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <initializer_list>
+#include <vector>
+#include "../parallel_for.hpp"
+
+// Maps data coordinates to image pixels of a w x h plot, y up.
+struct curve_axes
+{
+    double x0 = 0, x1 = 1, y0 = 0, y1 = 1;
+    int w = 1024, h = 512;
+
+    float px(double x) const
+    {
+        return float((x - x0) / (x1 - x0) * w);
+    }
+    float py(double y) const
+    {
+        return float((y1 - y) / (y1 - y0) * h);
+    }
+    // bounds of the data, widened by a margin so the curves do not touch the frame
+    static curve_axes fit(const double* x, size_t n, std::initializer_list<const double*> ys, int w, int h,
+                          double margin = 0.03)
+    {
+        curve_axes a;
+        a.w = w;
+        a.h = h;
+        a.x0 = a.y0 = INFINITY;
+        a.x1 = a.y1 = -INFINITY;
+        for(size_t i = 0; i < n; ++i){
+            if(!std::isfinite(x[i])) continue;
+            a.x0 = std::min(a.x0, x[i]);
+            a.x1 = std::max(a.x1, x[i]);
+        }
+        for(const double* y : ys)
+            for(size_t i = 0; i < n; ++i){
+                if(!std::isfinite(y[i])) continue;
+                a.y0 = std::min(a.y0, y[i]);
+                a.y1 = std::max(a.y1, y[i]);
+            }
+        if(!(a.x0 < a.x1)){ a.x0 = std::isfinite(a.x0) ? a.x0 - 1 : 0; a.x1 = a.x0 + 2; }
+        if(!(a.y0 < a.y1)){ a.y0 = std::isfinite(a.y0) ? a.y0 - 1 : 0; a.y1 = a.y0 + 2; }
+        const double dy = (a.y1 - a.y0) * margin;
+        a.y0 -= dy;
+        a.y1 += dy;
+        return a;
+    }
+};
+
+// Polyline of a curve reduced to what a w-pixel wide plot can show: every run of consecutive
+// samples that falls into one pixel column keeps only its first, lowest, highest and last
+// point, so the drawn line is the same as with all samples. Runs are found in parallel over
+// chunks of the samples; non-finite samples are dropped. Returns interleaved x, y in pixels.
+inline std::vector<float> curve_envelope(const double* x, const double* y, size_t n, const curve_axes& a)
+{
+    constexpr int min_chunk = 1 << 16;
+    const int chunks = int(std::max<size_t>(1, std::min<size_t>(job_system::current().size() * 2, n / min_chunk)));
+    std::vector<std::vector<float>> parts(chunks);
+    parallel_for(0, chunks, [&](int cb, int ce){
+        for(int c = cb; c < ce; ++c){
+            std::vector<float>& out = parts[c];
+            const size_t b = n * c / chunks, e = n * (c + 1) / chunks;
+            long column = 0;
+            size_t first = 0, last = 0, lo = 0, hi = 0;
+            bool open = false;
+            auto flush = [&]{
+                size_t pts[4] = {first, lo, hi, last};
+                if(lo > hi) std::swap(pts[1], pts[2]);
+                for(int k = 0; k < 4; ++k){
+                    if(k && pts[k] == pts[k - 1]) continue;
+                    out.push_back(a.px(x[pts[k]]));
+                    out.push_back(a.py(y[pts[k]]));
+                }
+            };
+            for(size_t i = b; i < e; ++i){
+                if(!std::isfinite(x[i]) || !std::isfinite(y[i])) continue;
+                const long col = long(std::floor(a.px(x[i])));
+                if(open && col == column){
+                    last = i;
+                    if(y[i] < y[lo]) lo = i;
+                    if(y[i] > y[hi]) hi = i;
+                    continue;
+                }
+                if(open) flush();
+                column = col;
+                first = last = lo = hi = i;
+                open = true;
+            }
+            if(open) flush();
+        }
+    });
+    std::vector<float> xy;
+    size_t total = 0;
+    for(const auto& p : parts) total += p.size();
+    xy.reserve(total);
+    for(const auto& p : parts) xy.insert(xy.end(), p.begin(), p.end());
+    return xy;
+}
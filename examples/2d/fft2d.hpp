@@ -0,0 +1,182 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64)
+#   include <immintrin.h>
+#   ifndef DISPLAY_TOOL_SSE2
+#       define DISPLAY_TOOL_SSE2 1
+#   endif
+#endif
+#include "../parallel_for.hpp"
+
+inline int fft_size_for(int n)
+{
+    int p = 1;
+    while(p < n) p *= 2;
+    return p;
+}
+
+// Radix-2 decimation-in-time FFT of one power-of-two length on split real/imaginary arrays.
+// The twiddles of the stage with half-size m sit at [m, 2m), so every stage streams one
+// contiguous run of them; stages with m >= 4 do four butterflies per SSE2 step.
+struct fft_plan
+{
+    int n = 0;
+    std::vector<uint32_t> rev;
+    std::vector<float> wr, wi;
+
+    void init(int size)
+    {
+        if(size == n) return;
+        n = size;
+        int bits = 0;
+        while((1 << bits) < n) ++bits;
+        rev.resize(n);
+        for(int i = 0; i < n; ++i){
+            uint32_t r = 0;
+            for(int b = 0; b < bits; ++b) r |= uint32_t((i >> b) & 1) << (bits - 1 - b);
+            rev[i] = r;
+        }
+        wr.assign(std::max(2, n), 0.0f);
+        wi.assign(std::max(2, n), 0.0f);
+        for(int m = 1; m < n; m *= 2)
+            for(int j = 0; j < m; ++j){
+                const double a = -3.14159265358979323846 * j / m;
+                wr[m + j] = float(std::cos(a));
+                wi[m + j] = float(std::sin(a));
+            }
+    }
+    // dst = FFT(src); src_im may be null for real input. dst must not alias src.
+    void forward(const float* src_re, const float* src_im, float* re, float* im) const
+    {
+        for(int i = 0; i < n; ++i){
+            re[i] = src_re[rev[i]];
+            im[i] = src_im ? src_im[rev[i]] : 0.0f;
+        }
+        // m = 1 and m = 2 fused: one radix-4 pass
+        if(n >= 4){
+            for(int k = 0; k < n; k += 4){
+                const float ar = re[k] + re[k + 1], ai = im[k] + im[k + 1];
+                const float br = re[k] - re[k + 1], bi = im[k] - im[k + 1];
+                const float cr = re[k + 2] + re[k + 3], ci = im[k + 2] + im[k + 3];
+                const float dr = re[k + 2] - re[k + 3], di = im[k + 2] - im[k + 3];
+                re[k] = ar + cr;     im[k] = ai + ci;
+                re[k + 2] = ar - cr; im[k + 2] = ai - ci;
+                // d * -i
+                re[k + 1] = br + di; im[k + 1] = bi - dr;
+                re[k + 3] = br - di; im[k + 3] = bi + dr;
+            }
+        }
+        else if(n == 2){
+            const float r = re[0], i = im[0];
+            re[0] = r + re[1]; im[0] = i + im[1];
+            re[1] = r - re[1]; im[1] = i - im[1];
+        }
+        for(int m = 4; m < n; m *= 2)
+            for(int k = 0; k < n; k += 2 * m){
+                float* ar = re + k; float* ai = im + k;
+                float* br = re + k + m; float* bi = im + k + m;
+                const float* w_r = wr.data() + m; const float* w_i = wi.data() + m;
+                int j = 0;
+#ifdef DISPLAY_TOOL_SSE2
+                for(; j < m; j += 4){
+                    const __m128 xr = _mm_loadu_ps(br + j), xi = _mm_loadu_ps(bi + j);
+                    const __m128 cr = _mm_loadu_ps(w_r + j), ci = _mm_loadu_ps(w_i + j);
+                    const __m128 tr = _mm_sub_ps(_mm_mul_ps(xr, cr), _mm_mul_ps(xi, ci));
+                    const __m128 ti = _mm_add_ps(_mm_mul_ps(xr, ci), _mm_mul_ps(xi, cr));
+                    const __m128 yr = _mm_loadu_ps(ar + j), yi = _mm_loadu_ps(ai + j);
+                    _mm_storeu_ps(ar + j, _mm_add_ps(yr, tr));
+                    _mm_storeu_ps(ai + j, _mm_add_ps(yi, ti));
+                    _mm_storeu_ps(br + j, _mm_sub_ps(yr, tr));
+                    _mm_storeu_ps(bi + j, _mm_sub_ps(yi, ti));
+                }
+#endif
+                for(; j < m; ++j){
+                    const float tr = br[j] * w_r[j] - bi[j] * w_i[j];
+                    const float ti = br[j] * w_i[j] + bi[j] * w_r[j];
+                    br[j] = ar[j] - tr; bi[j] = ai[j] - ti;
+                    ar[j] += tr;        ai[j] += ti;
+                }
+            }
+    }
+};
+
+// Textbook row/column 2D FFT for reference and benchmarks: one thread, scalar butterflies,
+// columns transformed in place with a stride of w. Row-major in/out, w and h powers of two.
+inline void fft2d_naive(std::vector<float>& re, std::vector<float>& im, int w, int h)
+{
+    auto fft = [](float* r, float* i, int n, size_t stride){
+        for(int a = 1, b = 0; a < n; ++a){
+            int bit = n >> 1;
+            for(; b & bit; bit >>= 1) b ^= bit;
+            b ^= bit;
+            if(a < b){
+                std::swap(r[a * stride], r[b * stride]);
+                std::swap(i[a * stride], i[b * stride]);
+            }
+        }
+        for(int m = 1; m < n; m *= 2){
+            const float sr = float(std::cos(3.14159265358979323846 / m)), si = float(-std::sin(3.14159265358979323846 / m));
+            for(int k = 0; k < n; k += 2 * m){
+                float cr = 1.0f, ci = 0.0f;
+                for(int j = 0; j < m; ++j){
+                    float& ar = r[(k + j) * stride]; float& ai = i[(k + j) * stride];
+                    float& br = r[(k + j + m) * stride]; float& bi = i[(k + j + m) * stride];
+                    const float tr = br * cr - bi * ci, ti = br * ci + bi * cr;
+                    br = ar - tr; bi = ai - ti;
+                    ar += tr;     ai += ti;
+                    const float nr = cr * sr - ci * si;
+                    ci = cr * si + ci * sr;
+                    cr = nr;
+                }
+            }
+        }
+    };
+    for(int y = 0; y < h; ++y) fft(re.data() + size_t(y) * w, im.data() + size_t(y) * w, w, 1);
+    for(int x = 0; x < w; ++x) fft(re.data() + x, im.data() + x, h, size_t(w));
+}
+
+// Row pass: rows [b, e) of a row-major real image (stride `stride`, `w` samples used, scaled by
+// row_weight[x] and zero-padded to px.n) into row spectra of px.n complex values.
+inline void fft2d_rows(const fft_plan& px, const float* src, size_t stride, int w, const float* row_weight,
+                       int b, int e, float* rows_re, float* rows_im)
+{
+    std::vector<float> tmp(px.n, 0.0f);
+    for(int y = b; y < e; ++y){
+        const float* s = src + size_t(y) * stride;
+        for(int x = 0; x < w; ++x){
+            const float v = s[x] * (row_weight ? row_weight[x] : 1.0f);
+            tmp[x] = v == v ? v : 0.0f;  // NaN (masked pixels) -> 0
+        }
+        px.forward(tmp.data(), nullptr, rows_re + size_t(y - b) * px.n, rows_im + size_t(y - b) * px.n);
+    }
+}
+
+// Column pass, cache blocked: 16 columns of the h row spectra are gathered at a time (one
+// 64-byte line per row), scaled by col_weight[y], zero-padded to py.n and transformed.
+// The result is transposed: out[kx * py.n + ky]. Runs on all hardware threads.
+inline void fft2d_columns(const fft_plan& py, const float* rows_re, const float* rows_im, int nx, int h,
+                          const float* col_weight, float* out_re, float* out_im)
+{
+    constexpr int block = 16;
+    const int ny = py.n;
+    parallel_for(0, (nx + block - 1) / block, [&](int b, int e){
+        std::vector<float> gr(size_t(block) * ny, 0.0f), gi(size_t(block) * ny, 0.0f);
+        for(int blk = b; blk < e; ++blk){
+            const int x0 = blk * block, n = std::min(block, nx - x0);
+            for(int y = 0; y < h; ++y){
+                const float wgt = col_weight ? col_weight[y] : 1.0f;
+                const float* r = rows_re + size_t(y) * nx + x0;
+                const float* i = rows_im + size_t(y) * nx + x0;
+                for(int c = 0; c < n; ++c){
+                    gr[size_t(c) * ny + y] = r[c] * wgt;
+                    gi[size_t(c) * ny + y] = i[c] * wgt;
+                }
+            }
+            for(int c = 0; c < n; ++c)
+                py.forward(&gr[size_t(c) * ny], &gi[size_t(c) * ny], out_re + size_t(x0 + c) * ny, out_im + size_t(x0 + c) * ny);
+        }
+    });
+}
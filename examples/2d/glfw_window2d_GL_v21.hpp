@@ -13,7 +13,45 @@
 #include <atomic>
 #include <chrono>
 #include <cmath>
+#include <type_traits>
+#include <string>
+#include <memory>
+#include "managed_textures.hpp"
+#include "layer_stack.hpp"
+#include "compare.hpp"
+#include "spectrum.hpp"
+#include "input_trace.hpp"
+#include "capture_gl.hpp"
+#include "overlay_gl.hpp"
+#include "../frame_scheduler.hpp"
+#include "../glfw_initializer.h"
+#include "../seqlock.hpp"
 
+// once per process, with a context current
+inline bool init_glew()
+{
+#ifndef __APPLE__
+    static bool done = false;
+    if(!done){
+        glewExperimental = GL_TRUE;
+        if(glewInit() != GLEW_OK){ std::cerr<<"glew init failed\n"; return false; }
+        done = true;
+    }
+#endif
+    return true;
+}
+
+// Camera as the render thread sees it. input_ns stamps the input that produced it.
+struct view2d
+{
+    float zoom = 1.0f;
+    float panX = 0.0f;
+    float panY = 0.0f;
+    int64_t input_ns = 0;
+};
+
+// Owned by the input callbacks (event thread); the render thread only reads `view`.
+// The on_* handlers take the sizes explicitly so a recorded trace can drive them headless.
 struct Ortho2D 
 { 
     float zoom = 1.0f;  // 1.0 = fit full texture
@@ -24,6 +62,121 @@ struct Ortho2D
     float lastX{0};
     float lastY{0};
     bool dragging{false}; 
+    bool sliding{false};
+    window_size size;  // as of the last event
+    seqlock<view2d> view;
+    std::function<void(double x, double y, bool click)> pointer;  // hover/click in window coordinates
+    std::function<void(float fraction)> slider;                   // right button drag, fraction of the window width
+    std::function<void(int key, int mods)> key;                   // keys the window handles itself
+    void publish()
+    {
+        view.store(view2d{zoom, panX, panY, now_ns()});
+        if(trace_recorder* t = tracing()) t->add(trace_kind::camera, 0, 0, 0, zoom, panX, panY);
+    }
+    // event thread, or before it runs; recorded so a replay zooms and pans at the same speed
+    void set_speed(float scroll, float move)
+    {
+        scroll_speed = scroll;
+        move_speed = move;
+        trace_recorder* t = trace.load();
+        if(t && t->started()) t->add(trace_kind::speed, 0, 0, 0, scroll, move);
+    }
+    // record every following event and camera change; once per camera
+    bool record(const std::string& path, int scene)
+    {
+        if(recorder) return false;
+        auto r = std::make_unique<trace_recorder>();
+        if(!r->open(path, scene)) return false;
+        recorder = std::move(r);
+        trace = recorder.get();
+        return true;
+    }
+    void on_cursor(double x, double y, const window_size& s)
+    {
+        note(s);
+        if(trace_recorder* t = tracing()) t->add(trace_kind::cursor, 0, 0, 0, float(x), float(y));
+        if (sliding) {
+            if (s.w > 0) slider(float(x) / float(s.w));
+            return;
+        }
+        if (!dragging) {
+            if (pointer) pointer(x, y, false);
+            return;
+        }
+        
+        float dx = static_cast<float>(x - lastX);
+        float dy = static_cast<float>(y - lastY);
+        panX -= dx / float(s.fb_w) / zoom * move_speed;
+        panY += dy / float(s.fb_h) / zoom * move_speed;
+        lastX = static_cast<float>(x);
+        lastY = static_cast<float>(y);
+        publish();
+    }
+    // x, y: cursor position at the time of the event
+    void on_button(int button, int action, int mods, double x, double y, const window_size& s)
+    {
+        note(s);
+        if(trace_recorder* t = tracing()) t->add(trace_kind::button, button, action, mods, float(x), float(y));
+        if (button == GLFW_MOUSE_BUTTON_LEFT) {
+            if (action == GLFW_PRESS) {
+                dragging = true;
+                lastX = static_cast<float>(x);
+                lastY = static_cast<float>(y);
+                if (pointer) pointer(x, y, true);
+            } else if (action == GLFW_RELEASE) {
+                dragging = false;
+            }
+        }
+        if (button == GLFW_MOUSE_BUTTON_RIGHT && slider) {
+            sliding = action == GLFW_PRESS;
+            if (sliding && s.w > 0) slider(float(x) / float(s.w));
+        }
+    }
+    void on_key(int k, int action, int mods)
+    {
+        if(trace_recorder* t = tracing()) t->add(trace_kind::key, k, action, mods);
+        if (action == GLFW_PRESS && key) key(k, mods);
+    }
+    void on_scroll(double xoff, double yoff)
+    {
+        if(trace_recorder* t = tracing()) t->add(trace_kind::scroll, 0, 0, 0, float(xoff), float(yoff));
+        zoom *= (1.0f + scroll_speed * yoff);
+        //== max 500%
+        zoom = std::max(0.2f, zoom);
+        //== min 10%
+        zoom = std::min(10.0f, zoom); 
+        publish();
+    }
+    // Feed one recorded event back. Camera records are compared instead: false when the
+    // replayed input did not end up at the recorded camera.
+    bool replay(const trace_event& e)
+    {
+        switch(trace_kind(e.kind)){
+            case trace_kind::cursor: on_cursor(e.v[0], e.v[1], size); break;
+            case trace_kind::button: on_button(e.code, e.action, e.mods, e.v[0], e.v[1], size); break;
+            case trace_kind::key:    on_key(e.code, e.action, e.mods); break;
+            case trace_kind::scroll: on_scroll(e.v[0], e.v[1]); break;
+            case trace_kind::resize: size = {int(e.v[0]), int(e.v[1]), int(e.v[2]), int(e.v[3])}; break;
+            case trace_kind::speed:  scroll_speed = e.v[0]; move_speed = e.v[1]; break;
+            case trace_kind::camera:
+                return std::abs(zoom - e.v[0]) <= 1e-5f * zoom && std::abs(panX - e.v[1]) <= 1e-5f && std::abs(panY - e.v[2]) <= 1e-5f;
+        }
+        return true;
+    }
+private:
+    void note(const window_size& s)
+    {
+        size = s;
+        if(trace_recorder* t = tracing()) t->size(s);
+    }
+    trace_recorder* tracing()
+    {
+        trace_recorder* t = trace.load();
+        if(t && !t->started()) t->start(zoom, panX, panY, scroll_speed, move_speed);
+        return t;
+    }
+    std::unique_ptr<trace_recorder> recorder;
+    std::atomic<trace_recorder*> trace{nullptr};
 };
 
 // static GLuint make_checker_tex(int N = 256) {
@@ -44,38 +197,37 @@ struct Ortho2D
 //     return tex;
 // }
 
-static GLuint make_checker_tex(int N = 256)
+static texture_image make_checker_image(int N = 256)
 {
-    std::vector<unsigned char> img(N * N * 3);
+    texture_image img;
+    img.width = img.height = N;
+    img.value_scale = img.display_hi = 255.0f;
+    std::vector<unsigned char>& data = img.bytes;
+    data.resize(N * N * 3);
     for(int y=0;y<N;++y){
         for(int x=0;x<N;++x){
             int c = (((x>>4)&1) ^ ((y>>4)&1)) ? 255 : 60;
-            img[(y*N+x)*3+0] = (unsigned char)c;
-            img[(y*N+x)*3+1] = (unsigned char)c;
-            img[(y*N+x)*3+2] = (unsigned char)c;
+            data[(y*N+x)*3+0] = (unsigned char)c;
+            data[(y*N+x)*3+1] = (unsigned char)c;
+            data[(y*N+x)*3+2] = (unsigned char)c;
         }
     }
-    GLuint t; glGenTextures(1, &t);
-    glBindTexture(GL_TEXTURE_2D, t);
-
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); // or GL_NEAREST
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-    float borderColor[] = {0.0f, 0.0f, 0.0f, 1.0f};
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+    return img;
+}
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, N, N, 0, GL_RGB, GL_UNSIGNED_BYTE, img.data());
-    glBindTexture(GL_TEXTURE_2D, 0);
-    return t;
+static window_size sizes_of(GLFWwindow* window)
+{
+    window_size s;
+    glfwGetWindowSize(window, &s.w, &s.h);
+    glfwGetFramebufferSize(window, &s.fb_w, &s.fb_h);
+    return s;
 }
 
 static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
     //== TODO : load keybord-binding config file
+    auto* self = reinterpret_cast<Ortho2D*>(glfwGetWindowUserPointer(window));
+    if (self) self->on_key(key, action, mods);
     if (action == GLFW_PRESS) {
         // 普通键
         if (key == GLFW_KEY_ESCAPE) {
@@ -102,53 +254,42 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action, i
 
 static void cursorPosCallback(GLFWwindow* window, double xpos, double ypos) {
     auto* self = reinterpret_cast<Ortho2D*>(glfwGetWindowUserPointer(window));
-    if (!self || !self->dragging) return;
-    
-    float dx = static_cast<float>(xpos - self->lastX);
-    float dy = static_cast<float>(ypos - self->lastY);
-    int w,h; glfwGetFramebufferSize(window, &w, &h);
-    self->panX -= dx / float(w) / self->zoom * self->move_speed;
-    self->panY += dy / float(h) / self->zoom * self->move_speed;
-    self->lastX = static_cast<float>(xpos);
-    self->lastY = static_cast<float>(ypos);
+    if (!self) return;
+    self->on_cursor(xpos, ypos, sizes_of(window));
 }
 
 static void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
     auto* self = reinterpret_cast<Ortho2D*>(glfwGetWindowUserPointer(window));
     if (!self) return;
-
-    if (button == GLFW_MOUSE_BUTTON_LEFT) {
-        if (action == GLFW_PRESS) {
-            self->dragging = true;
-            double mx, my;
-            glfwGetCursorPos(window, &mx, &my);
-            self->lastX = static_cast<float>(mx);
-            self->lastY = static_cast<float>(my);
-        } else if (action == GLFW_RELEASE) {
-            self->dragging = false;
-        }
-    }
+    double mx, my;
+    glfwGetCursorPos(window, &mx, &my);
+    self->on_button(button, action, mods, mx, my, sizes_of(window));
 }
 
-static void scrollCallback(GLFWwindow* w, double, double yoff)
+static void scrollCallback(GLFWwindow* w, double xoff, double yoff)
 {
     auto* c = reinterpret_cast<Ortho2D*>(glfwGetWindowUserPointer(w));
     if (!c) return;
-    c->zoom *= (1.0f + c->scroll_speed * yoff);
-    //== max 500%
-    c->zoom = std::max(0.2f, c->zoom);
-    //== min 10%
-    c->zoom = std::min(10.0f, c->zoom); 
+    c->on_scroll(xoff, yoff);
 }
 
 struct glfw_window2d_GL_v21 final
 {
     GLFWwindow* win;
     Ortho2D cam;
-    std::vector<GLuint> texture_list;
+    glfw_initializer& owner;
+    managed_textures texture_list;
     std::thread t;
     std::atomic<bool> running{true};
-    glfw_window2d_GL_v21()
+    int index;
+    frame_scheduler scheduler;
+    overlay_state overlay;
+    layer_stack layers;
+    compare_state compare;
+    spectrum_engine spectrum;
+    frame_capture capture;
+    glfw_window2d_GL_v21(glfw_initializer& init) 
+        : owner(init), texture_list(init.resources, this, false), index(init.resources.add_window(this))
     {
         glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
         glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
@@ -158,12 +299,21 @@ struct glfw_window2d_GL_v21 final
         glfwSetScrollCallback(win, scrollCallback);
         glfwSetCursorPosCallback(win, cursorPosCallback);
         glfwSetMouseButtonCallback(win, mouseButtonCallback);
+        cam.pointer = [this](double x, double y, bool click){ pick(x, y, click); };
+        cam.slider = [this](float f){ compare.set_split(f); };
+        cam.key = [this](int key, int){
+            if(key == GLFW_KEY_C) compare.cycle();
+            else if(key == GLFW_KEY_F) spectrum.toggle();
+            else if(key == GLFW_KEY_P && spectrum.shown) spectrum.toggle_mode();
+            else if(key == GLFW_KEY_F12) capture.screenshot();
+            else if(key == GLFW_KEY_F10) capture.toggle();
+        };
     }
     ~glfw_window2d_GL_v21()
     {
         if(t.joinable())t.join();
-        glDeleteTextures(texture_list.size(), texture_list.data());
         if(win) glfwDestroyWindow(win);
+        owner.resources.remove_window(this);
     }
     bool valid() const
     {
@@ -181,30 +331,66 @@ struct glfw_window2d_GL_v21 final
         return *this;
     }
 
+    glfw_window2d_GL_v21& set_present_mode(present_mode m)
+    {
+        scheduler.request_mode(m);
+        return *this;
+    }
     glfw_window2d_GL_v21& set_scroll_speed(float speed = 0.1f)
     {
-        cam.scroll_speed = speed;
+        cam.set_speed(speed, cam.move_speed);
         return *this;
     }
     glfw_window2d_GL_v21& set_move_speed(float speed = 0.1f)
     {
-        cam.move_speed = speed;
+        cam.set_speed(cam.scroll_speed, speed);
         return *this;
     }
     glfw_window2d_GL_v21& append_texture(const char* path)
     {
         if(nullptr == path) 
-            texture_list.push_back(make_checker_tex());        
+            texture_list.enqueue({make_checker_image(), {}});
         //== TODO : load path
         return *this;
     }
-    template<class T> glfw_window2d_GL_v21& append_texture(std::vector<T>& vec, int xsize, int ysize)
+    // The loader re-creates the image when the resource manager dropped the host copy.
+    glfw_window2d_GL_v21& append_texture(std::function<texture_image()> loader)
     {
+        texture_list.enqueue({{}, std::move(loader)});
         return *this;
     }
+    // Encoding runs on the calling thread, the upload happens on the render thread.
+    // The fixed-function pipeline has no scale/offset uniforms, so scalar formats fall back to rgb8.
+    glfw_window2d_GL_v21& append_texture(const float* data, int xsize, int ysize, texture_format fmt)
+    {
+        if(is_scalar_format(fmt)){
+            std::cerr << "OpenGL2.1 can not display " << texture_format_name(fmt) << ", use rgb8\n";
+            fmt = texture_format::rgb8;
+        }
+        texture_list.enqueue({encode_scalar(data, xsize, ysize, fmt), {}});
+        return *this;
+    }
+    glfw_window2d_GL_v21& append_texture(const uint8_t* rgb, int xsize, int ysize, texture_format fmt)
+    {
+        texture_list.enqueue({encode_rgb(rgb, xsize, ysize, fmt), {}});
+        return *this;
+    }
+    template<class T> glfw_window2d_GL_v21& append_texture(std::vector<T>& vec, int xsize, int ysize, texture_format fmt = texture_format::rgb8)
+    {
+        static_assert(std::is_arithmetic_v<T>);
+        if constexpr(std::is_same_v<T, float>){
+            return append_texture(vec.data(), xsize, ysize, fmt);
+        }
+        else{
+            std::vector<float> f(vec.begin(), vec.end());
+            return append_texture(f.data(), xsize, ysize, fmt);
+        }
+    }
     glfw_window2d_GL_v21& async_loop(int maxFPS = 30)
     {
         glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+        // the camera is read by the event callbacks, so set it up before the render thread runs
+        set_scroll_speed(0.15).set_move_speed(2.0);
         t = std::thread(&glfw_window2d_GL_v21::loop, this, maxFPS);
         return *this;
     }
@@ -213,32 +399,129 @@ struct glfw_window2d_GL_v21 final
         constexpr float display_ratio = 1.0f;
         static_assert(0 < display_ratio && display_ratio <=1.0f);
 
-        activate().set_fps_ratio(1).set_scroll_speed(0.15).set_move_speed(2.0).append_texture(nullptr);
+        activate().set_fps_ratio(1);
+        if(!init_glew()){ activate(false); return; }
+        texture_list.update();
+        if(texture_list.empty()) append_texture(nullptr);
+#ifdef __APPLE__
+        capture_gl.init(false);
+#else
+        capture_gl.init(GLEW_ARB_sync);
+#endif
         
         using clock = std::chrono::high_resolution_clock;
         auto lastTime = clock::now();
         int frames = 0;
-        float frameDuration = 1.0 / maxFPS;
+        double capture_ms = 0;
+        scheduler.set_max_fps(maxFPS);
         while (running){
-            auto frameStart = clock::now();
+            // ---- 帧率限制: deadline pacing before the frame so the camera is sampled late ----
+            scheduler.begin_frame();
+            texture_list.update();
             int w,h; glfwGetFramebufferSize(win, &w, &h);
             glViewport(0,0,w,h);
             glClearColor(1.0f, 1.0f, 1.0f,1);
             glClear(GL_COLOR_BUFFER_BIT);
-            set_ortho(cam, w, h);
+            const view2d view = cam.view.load();
+            set_ortho(view, w, h);
             
-            glEnable(GL_TEXTURE_2D);
-            glBindTexture(GL_TEXTURE_2D, texture_list.back());
-            glColor3f(1,1,1);
-            glBegin(GL_QUADS);
-            glTexCoord2f(0,0); glVertex2f(-display_ratio,-display_ratio);
-            glTexCoord2f(1,0); glVertex2f( display_ratio,-display_ratio);
-            glTexCoord2f(1,1); glVertex2f( display_ratio, display_ratio);
-            glTexCoord2f(0,1); glVertex2f(-display_ratio, display_ratio);
-            glEnd();
-            glDisable(GL_TEXTURE_2D);
+            auto quad = [](){
+                glBegin(GL_QUADS);
+                glTexCoord2f(0,0); glVertex2f(-display_ratio,-display_ratio);
+                glTexCoord2f(1,0); glVertex2f( display_ratio,-display_ratio);
+                glTexCoord2f(1,1); glVertex2f( display_ratio, display_ratio);
+                glTexCoord2f(0,1); glVertex2f(-display_ratio, display_ratio);
+                glEnd();
+            };
+            layers.changed(layers_seen, layer_copy);
+            int iw = 0, ih = 0;
+            if(spectrum.shown && sync_spectrum()){
+                // ---- 2D FFT of the field instead of the image; annotations do not apply ----
+                glEnable(GL_TEXTURE_2D);
+                glBindTexture(GL_TEXTURE_2D, spectrum_tex.id);
+                glColor3f(1,1,1);
+                quad();
+                glDisable(GL_TEXTURE_2D);
+            }
+            else if(compare.active(texture_list.size())){
+                // ---- A/B compare: split or flicker, the difference views need the GL 3.3 window ----
+                const gpu_texture& a = texture_list.use(compare.a);
+                const gpu_texture& b = texture_list.use(compare.b);
+                glEnable(GL_TEXTURE_2D);
+                glColor3f(1,1,1);
+                if(compare.current() == compare_view::flicker){
+                    glBindTexture(GL_TEXTURE_2D, compare.flicker_b() ? b.id : a.id);
+                    quad();
+                }
+                else{
+                    const int sx = int(compare.split * w);
+                    glEnable(GL_SCISSOR_TEST);
+                    glScissor(0, 0, sx, h);
+                    glBindTexture(GL_TEXTURE_2D, a.id);
+                    quad();
+                    glScissor(sx, 0, w - sx, h);
+                    glBindTexture(GL_TEXTURE_2D, b.id);
+                    quad();
+                    glScissor(sx - 1, 0, 2, h);
+                    glClearColor(1.0f, 1.0f, 0.2f, 1);
+                    glClear(GL_COLOR_BUFFER_BIT);
+                    glDisable(GL_SCISSOR_TEST);
+                }
+                glDisable(GL_TEXTURE_2D);
+                iw = a.width;
+                ih = a.height;
+            }
+            else{
+                // ---- layer stack: one blended pass per layer, colormaps need the GL 3.3 window ----
+                for(const auto& l : layer_copy){
+                    if(!l.visible || l.texture < 0 || size_t(l.texture) >= texture_list.size()) continue;
+                    const gpu_texture& tex = texture_list.use(l.texture);
+                    if(0 == iw){
+                        iw = tex.width;
+                        ih = tex.height;
+                        glColor3f(0,0,0);
+                        quad();
+                        glEnable(GL_BLEND);
+                    }
+                    glEnable(GL_TEXTURE_2D);
+                    glBindTexture(GL_TEXTURE_2D, tex.id);
+                    if(l.blend == blend_mode::max){
+                        glBlendEquation(GL_MAX);
+                        glColor4f(l.opacity, l.opacity, l.opacity, 1);
+                    }
+                    else{
+                        glBlendEquation(GL_FUNC_ADD);
+                        glBlendFunc(GL_SRC_ALPHA, l.blend == blend_mode::alpha ? GL_ONE_MINUS_SRC_ALPHA : GL_ONE);
+                        glColor4f(1, 1, 1, l.opacity);
+                    }
+                    quad();
+                    glDisable(GL_TEXTURE_2D);
+                }
+                if(iw){
+                    glBlendEquation(GL_FUNC_ADD);
+                    glDisable(GL_BLEND);
+                }
+                else{
+                    glEnable(GL_TEXTURE_2D);
+                    const gpu_texture& tex = texture_list.use(texture_list.size() - 1);
+                    glBindTexture(GL_TEXTURE_2D, tex.id);
+                    glColor3f(1,1,1);
+                    quad();
+                    glDisable(GL_TEXTURE_2D);
+                    iw = tex.width;
+                    ih = tex.height;
+                }
+            }
+            overlay.image_w = iw;
+            overlay.image_h = ih;
+            if(iw){
+                draw_contours_fixed(overlay.contours.snapshot(), iw, ih);
+                draw_overlay_fixed(overlay.layer, overlay.hovered, iw, ih, 2.0f / (view.zoom * h));
+            }
+            capture_ms += capture_gl.frame(w, h, now_ns(), capture);
             
             glfwSwapBuffers(win);
+            scheduler.presented(view.input_ns);
 
             // ---- FPS 统计 ----
             constexpr float print_fps_time_in_second = 5.0; 
@@ -248,19 +531,21 @@ struct glfw_window2d_GL_v21 final
                 std::chrono::duration<float> elapsed = now - lastTime;
                 if (elapsed.count() >= print_fps_time_in_second) {
                     std::cout << "FPS: " << frames / elapsed.count() << std::endl;
+                    owner.stats.set("fps.window" + std::to_string(index), frames / elapsed.count());
+                    scheduler.publish(owner.stats, "latency.window" + std::to_string(index));
+                    owner.jobs.publish(owner.stats);
+                    capture.publish(owner.stats, "capture.window" + std::to_string(index));
+                    owner.stats.set("capture.window" + std::to_string(index) + ".readback_ms", capture_ms / frames);
+                    capture_ms = 0;
                     frames = 0;
                     lastTime = now;
                 }
             }
-            
-            // ---- 帧率限制 ----
-            auto frameEnd = clock::now();
-            std::chrono::duration<double> frameElapsed = frameEnd - frameStart;
-            double sleepTime = frameDuration - frameElapsed.count();
-            if (sleepTime > 0) {
-                std::this_thread::sleep_for(std::chrono::duration<float>(sleepTime));
-            }
         }
+        capture.stop();
+        capture_gl.release(capture);
+        texture_list.release();
+        release_spectrum();
         activate(false);
     }
     void event_loop()
@@ -272,7 +557,45 @@ struct glfw_window2d_GL_v21 final
     }
 
 private:
-    static void set_ortho(const Ortho2D& cam, int w, int h) {
+    // event thread: window coordinates -> image pixels through the glOrtho of set_ortho()
+    void pick(double x, double y, bool click)
+    {
+        int ww, wh; glfwGetWindowSize(win, &ww, &wh);
+        const int iw = overlay.image_w, ih = overlay.image_h;
+        if(ww <= 0 || wh <= 0 || 0 == iw || 0 == ih) return;
+        const float aspect = float(ww) / float(wh);
+        const float wx = cam.panX + (2.0f * float(x) / ww - 1.0f) * aspect / cam.zoom;
+        const float wy = cam.panY + (1.0f - 2.0f * float(y) / wh) / cam.zoom;
+        const float px = 0.5f * (iw + ih) / (cam.zoom * wh);
+        overlay.pointer((wx + 1) * 0.5f * iw, (wy + 1) * 0.5f * ih, px, click);
+    }
+    // render thread: re-upload the spectrum when the engine published a new one
+    bool sync_spectrum()
+    {
+        std::shared_ptr<const texture_image> s = spectrum.snapshot();
+        if(!s) return false;
+        if(s != spectrum_img){
+            release_spectrum();
+            spectrum_tex = upload_texture_image(*s, false);
+            spectrum_rid = owner.resources.track(this, resource_kind::texture, spectrum_tex.bytes, 0, false);
+            spectrum_img = std::move(s);
+        }
+        return true;
+    }
+    void release_spectrum()
+    {
+        if(spectrum_tex.id) glDeleteTextures(1, &spectrum_tex.id);
+        if(spectrum_rid) owner.resources.untrack(spectrum_rid);
+        spectrum_tex = {};
+        spectrum_rid = 0;
+    }
+    uint64_t layers_seen = 0;
+    std::vector<image_layer> layer_copy;
+    std::shared_ptr<const texture_image> spectrum_img;
+    gpu_texture spectrum_tex;
+    resource_id spectrum_rid = 0;
+    pbo_capture capture_gl;
+    static void set_ortho(const view2d& cam, int w, int h) {
         float aspect = h > 0 ? (float)w / (float)h : 1.0f;
         float s = 1.0f / cam.zoom;
         float vw = aspect * s;
@@ -5,6 +5,8 @@
 #include <GL/glew.h>
 #endif
 #include "glfw_window2d_GL_v21.hpp"
+#include "layer_gl.hpp"
+#include "compare_gl.hpp"
 
 
 // ---------- shaders ----------
@@ -31,9 +33,13 @@ static const char* fragmentShaderSrc = R"(
 in vec2 TexCoord;
 out vec4 FragColor;
 uniform sampler2D tex;
+uniform float uScale;  // stored texel -> display [0,1]
+uniform float uOffset;
 void main() {
     // Sampling outside [0,1] will be handled by texture wrap mode (we set GL_CLAMP)
-    FragColor = texture(tex, TexCoord);
+    // Scalar formats are swizzled to grey at upload.
+    vec3 c = texture(tex, TexCoord).rgb * uScale + uOffset;
+    FragColor = vec4(c, 1.0);
 }
 )";
 
@@ -104,13 +110,28 @@ struct glfw_window2d_GL_v33 final
 {
     GLFWwindow* win;
     Ortho2D cam;
-    std::vector<GLuint> texture_list;
+    glfw_initializer& owner;
+    managed_textures texture_list;
     std::thread t;
     std::atomic<bool> running{true};
+    int index;
+    frame_scheduler scheduler;
     GLuint program;
     GLuint vao;
-    GLint locZoom = -1, locPan = -1;
-    glfw_window2d_GL_v33()
+    resource_id quad_rid = 0;
+    overlay_state overlay;
+    overlay_renderer overlay_gl;
+    size_t overlay_bytes = 0;
+    layer_stack layers;
+    layer_compositor layer_gl;
+    compare_state compare;
+    compare_renderer compare_gl;
+    spectrum_engine spectrum;
+    frame_capture capture;
+    pbo_capture capture_gl;
+    GLint locZoom = -1, locPan = -1, locScale = -1, locOffset = -1;
+    glfw_window2d_GL_v33(glfw_initializer& init)
+        : owner(init), texture_list(init.resources, this, true), index(init.resources.add_window(this))
     {
         glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
         glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -124,12 +145,21 @@ struct glfw_window2d_GL_v33 final
         glfwSetScrollCallback(win, scrollCallback);
         glfwSetCursorPosCallback(win, cursorPosCallback);
         glfwSetMouseButtonCallback(win, mouseButtonCallback);
+        cam.pointer = [this](double x, double y, bool click){ pick(x, y, click); };
+        cam.slider = [this](float f){ compare.set_split(f); };
+        cam.key = [this](int key, int){
+            if(key == GLFW_KEY_C) compare.cycle();
+            else if(key == GLFW_KEY_F) spectrum.toggle();
+            else if(key == GLFW_KEY_P && spectrum.shown) spectrum.toggle_mode();
+            else if(key == GLFW_KEY_F12) capture.screenshot();
+            else if(key == GLFW_KEY_F10) capture.toggle();
+        };
     }
     ~glfw_window2d_GL_v33()
     {
         if(t.joinable())t.join();
-        glDeleteTextures(texture_list.size(), texture_list.data());
         if(win) glfwDestroyWindow(win);
+        owner.resources.remove_window(this);
     }
     bool valid() const
     {
@@ -146,57 +176,90 @@ struct glfw_window2d_GL_v33 final
         glfwSwapInterval(int(ratio));
         return *this;
     }
+    glfw_window2d_GL_v33& set_present_mode(present_mode m)
+    {
+        scheduler.request_mode(m);
+        return *this;
+    }
     glfw_window2d_GL_v33& set_scroll_speed(float speed = 0.1f)
     {
-        cam.scroll_speed = speed;
+        cam.set_speed(speed, cam.move_speed);
         return *this;
     }
     glfw_window2d_GL_v33& append_texture(const char* path)
     {
         if(nullptr == path) 
-            texture_list.push_back(make_checker_tex());        
+            texture_list.enqueue({make_checker_image(), {}});
         //== TODO : load path
         return *this;
     }
+    // The loader re-creates the image when the resource manager dropped the host copy.
+    glfw_window2d_GL_v33& append_texture(std::function<texture_image()> loader)
+    {
+        texture_list.enqueue({{}, std::move(loader)});
+        return *this;
+    }
+    // Encoding runs on the calling thread, the upload happens on the render thread.
+    glfw_window2d_GL_v33& append_texture(const float* data, int xsize, int ysize, texture_format fmt)
+    {
+        texture_list.enqueue({encode_scalar(data, xsize, ysize, fmt), {}});
+        return *this;
+    }
+    glfw_window2d_GL_v33& append_texture(const uint8_t* rgb, int xsize, int ysize, texture_format fmt)
+    {
+        texture_list.enqueue({encode_rgb(rgb, xsize, ysize, fmt), {}});
+        return *this;
+    }
     glfw_window2d_GL_v33& async_loop(int maxFPS = 30)
     {
         glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+        // the camera is read by the event callbacks, so set it up before the render thread runs
+        set_scroll_speed(0.15);
         t = std::thread(&glfw_window2d_GL_v33::loop, this, maxFPS);
         return *this;
     }
     glfw_window2d_GL_v33& loop(int maxFPS =  0)
     {
-        activate().set_fps_ratio(1).set_scroll_speed(0.15).append_texture(nullptr);
-#ifndef __APPLE__
-        static bool init_glew = true;
-        if(init_glew){
-            glewExperimental = GL_TRUE;
-            if(glewInit() != GLEW_OK){ std::cerr<<"glew init failed\n"; return *this; }
-            init_glew = false;
-        }
-#endif
+        activate().set_fps_ratio(1);
+        if(!init_glew()){ activate(false); return *this; }
         // build GL resources
         program = makeProgram();
         locZoom = glGetUniformLocation(program, "uZoom");
         locPan  = glGetUniformLocation(program, "uPan");
+        locScale  = glGetUniformLocation(program, "uScale");
+        locOffset = glGetUniformLocation(program, "uOffset");
         // ensure sampler is 0
         glUseProgram(program);
         GLint locTex = glGetUniformLocation(program, "tex");
         if(locTex >= 0) glUniform1i(locTex, 0);
         glUseProgram(0);
         vao = makeQuadVAO();
+        quad_rid = owner.resources.track(this, resource_kind::buffer, 16 * sizeof(float), 0, false);
+        overlay_gl.init(owner.resources, this, compileShader);
+        layer_gl.init(owner.resources, this, compileShader, vertexShaderSrc);
+        compare_gl.init(compileShader, vertexShaderSrc);
+        capture_gl.init(true);
+        texture_list.update();
+        if(texture_list.empty()) append_texture(nullptr);
         
         using clock = std::chrono::high_resolution_clock;
         auto lastTime = clock::now();
         int frames = 0;
-        float frameDuration = 1.0 / maxFPS;
+        double capture_ms = 0;
+        scheduler.set_max_fps(maxFPS);
         while (running){
-            auto frameStart = clock::now();
+            // ---- 帧率限制: deadline pacing before the frame so the camera is sampled late ----
+            scheduler.begin_frame();
+            texture_list.update();
             int w,h; glfwGetFramebufferSize(win, &w, &h);
             glBindVertexArray(vao);
-            renderFrame(w,h);
+            const view2d view = cam.view.load();
+            renderFrame(w,h,view);
             glBindVertexArray(0);
+            // ---- capture: read back into a pixel-pack buffer, encode the ones that arrived ----
+            capture_ms += capture_gl.frame(w, h, now_ns(), capture);
             glfwSwapBuffers(win);
+            scheduler.presented(view.input_ns);
 
             // ---- FPS 统计 ----
             constexpr float print_fps_time_in_second = 5.0; 
@@ -206,23 +269,30 @@ struct glfw_window2d_GL_v33 final
                 std::chrono::duration<float> elapsed = now - lastTime;
                 if (elapsed.count() >= print_fps_time_in_second) {
                     std::cout << "FPS: " << frames / elapsed.count() << std::endl;
+                    owner.stats.set("fps.window" + std::to_string(index), frames / elapsed.count());
+                    scheduler.publish(owner.stats, "latency.window" + std::to_string(index));
+                    owner.jobs.publish(owner.stats);
+                    owner.stats.set("overlay.window" + std::to_string(index) + ".upload_kb", overlay_bytes / 1024.0 / frames);
+                    capture.publish(owner.stats, "capture.window" + std::to_string(index));
+                    owner.stats.set("capture.window" + std::to_string(index) + ".readback_ms", capture_ms / frames);
+                    overlay_bytes = 0;
+                    capture_ms = 0;
                     frames = 0;
                     lastTime = now;
                 }
             }
-            
-            // ---- 帧率限制 ----
-            auto frameEnd = clock::now();
-            std::chrono::duration<double> frameElapsed = frameEnd - frameStart;
-            double sleepTime = frameDuration - frameElapsed.count();
-            if (sleepTime > 0) {
-                std::this_thread::sleep_for(std::chrono::duration<float>(sleepTime));
-            }
         }
-        activate(false);
-
+        capture.stop();
+        capture_gl.release(capture);
+        texture_list.release();
+        overlay_gl.release();
+        layer_gl.release();
+        compare_gl.release();
+        release_spectrum();
         glDeleteVertexArrays(1, &vao);
         glDeleteProgram(program);
+        owner.resources.untrack(quad_rid);
+        activate(false);
         return *this;
     }
     glfw_window2d_GL_v33& event_loop()
@@ -234,27 +304,103 @@ struct glfw_window2d_GL_v33 final
         return *this;
     }
 private:
+    // event thread: window coordinates -> image pixels, inverse of the vertex shader mapping
+    void pick(double x, double y, bool click)
+    {
+        int ww, wh; glfwGetWindowSize(win, &ww, &wh);
+        const int iw = overlay.image_w, ih = overlay.image_h;
+        if(ww <= 0 || wh <= 0 || 0 == iw || 0 == ih) return;
+        const float u = (float(x) / ww - 0.5f) / cam.zoom + 0.5f + cam.panX;
+        const float v = (0.5f - float(y) / wh) / cam.zoom + 0.5f + cam.panY;
+        const float px = 0.5f * (float(iw) / ww + float(ih) / wh) / cam.zoom;
+        overlay.pointer(u * iw, v * ih, px, click);
+    }
     // ---------- update GPU uniforms (call with program bound) ----------
-    void uploadCameraUniforms(){
-        glUniform1f(locZoom, cam.zoom);
-        glUniform2f(locPan, cam.panX, cam.panY);
+    void uploadCameraUniforms(const view2d& view){
+        glUniform1f(locZoom, view.zoom);
+        glUniform2f(locPan, view.panX, view.panY);
     }
-    // ---------- render ----------
-    void renderFrame(int width, int height)
+    void draw_texture(const gpu_texture& tex, const view2d& view)
     {
-        glViewport(0,0,width,height);
-        glClearColor(0.1f,0.1f,0.1f,1);
-        glClear(GL_COLOR_BUFFER_BIT);
-
         glUseProgram(program);
         // upload camera uniforms
-        uploadCameraUniforms();
+        uploadCameraUniforms(view);
 
         glActiveTexture(GL_TEXTURE0);
-        //== TODO : texture_list 扩容时可能存在问题。 注意危险
-        glBindTexture(GL_TEXTURE_2D, texture_list.back()); 
+        glUniform1f(locScale, tex.scale);
+        glUniform1f(locOffset, tex.offset);
+        glBindTexture(GL_TEXTURE_2D, tex.id); 
         glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
         glBindTexture(GL_TEXTURE_2D, 0);
         glUseProgram(0);
     }
+    // re-upload the spectrum when the engine published a new one
+    bool sync_spectrum()
+    {
+        std::shared_ptr<const texture_image> s = spectrum.snapshot();
+        if(!s) return false;
+        if(s != spectrum_img){
+            release_spectrum();
+            spectrum_tex = upload_texture_image(*s);
+            spectrum_rid = owner.resources.track(this, resource_kind::texture, spectrum_tex.bytes, 0, false);
+            spectrum_img = std::move(s);
+        }
+        return true;
+    }
+    void release_spectrum()
+    {
+        if(spectrum_tex.id) glDeleteTextures(1, &spectrum_tex.id);
+        if(spectrum_rid) owner.resources.untrack(spectrum_rid);
+        spectrum_tex = {};
+        spectrum_rid = 0;
+    }
+    std::shared_ptr<const texture_image> spectrum_img;
+    gpu_texture spectrum_tex;
+    resource_id spectrum_rid = 0;
+    // ---------- render ----------
+    void renderFrame(int width, int height, const view2d& view)
+    {
+        glViewport(0,0,width,height);
+        glClearColor(0.1f,0.1f,0.1f,1);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        int iw, ih;
+        const bool layered = layer_gl.sync(texture_list, layers);
+        if(spectrum.shown && sync_spectrum()){
+            // ---- 2D FFT of the field instead of the image; annotations do not apply ----
+            draw_texture(spectrum_tex, view);
+            overlay.image_w = overlay.image_h = 0;
+            return;
+        }
+        if(compare.active(texture_list.size())){
+            // ---- A/B compare: both textures in one pass ----
+            const gpu_texture& a = texture_list.use(compare.a);
+            const gpu_texture& b = texture_list.use(compare.b);
+            compare_gl.draw(compare, a, b, view.zoom, view.panX, view.panY, width);
+            iw = a.width;
+            ih = a.height;
+        }
+        else if(layered){
+            // ---- layer stack: one pass over the texture array ----
+            layer_gl.draw(view.zoom, view.panX, view.panY);
+            iw = layer_gl.width;
+            ih = layer_gl.height;
+        }
+        else{
+            //== TODO : texture_list 扩容时可能存在问题。 注意危险
+            const gpu_texture& tex = texture_list.use(texture_list.size() - 1);
+            draw_texture(tex, view);
+            iw = tex.width;
+            ih = tex.height;
+        }
+
+        // ---- overlay: changed instance ranges, contours, then three instanced draws ----
+        overlay.image_w = iw;
+        overlay.image_h = ih;
+        overlay_bytes += overlay_gl.upload(overlay.layer);
+        overlay_bytes += overlay_gl.upload(overlay.contours.snapshot());
+        overlay_gl.draw_contours(view.zoom, view.panX, view.panY, iw, ih, width, height);
+        overlay_gl.draw(overlay.layer, overlay.hovered, view.zoom, view.panX, view.panY,
+                        iw, ih, width, height);
+    }
 };
\ No newline at end of file
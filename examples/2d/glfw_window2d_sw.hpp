@@ -0,0 +1,490 @@
+#pragma once
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include "glfw_window2d_GL_v21.hpp"
+#include "sw_sampler.hpp"
+#include "colormaps.hpp"
+
+// CPU rasterizer backend: the framebuffer is split into tiles shaded as high-priority jobs of
+// glfw_initializer::jobs with the v33 zoom/pan mapping. With a display the result is blitted through a GL 2.1 texture;
+// without one (or with DISPLAY_TOOL_HEADLESS set) it only renders into `framebuffer`.
+struct glfw_window2d_sw final
+{
+    static constexpr int tile_w = 256;
+    static constexpr int tile_h = 32;
+
+    GLFWwindow* win = nullptr;
+    Ortho2D cam;
+    glfw_initializer& owner;
+    std::thread t;
+    std::atomic<bool> running{true};
+    std::atomic<int> frames_rendered{0};
+    int index;
+    frame_scheduler scheduler;
+    overlay_state overlay;
+    layer_stack layers;
+    compare_state compare;
+    spectrum_engine spectrum;
+    frame_capture capture;
+    std::vector<sw_texture> texture_list;
+    std::vector<resource_id> texture_rids;
+    std::vector<uint32_t> framebuffer;  // RGBA8, row 0 at the bottom (glReadPixels order)
+    int fb_w = 1920, fb_h = 1080;
+    glfw_window2d_sw(glfw_initializer& init) : owner(init), index(init.resources.add_window(this))
+    {
+        if(init.is_init && nullptr == std::getenv("DISPLAY_TOOL_HEADLESS")){
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+            win = glfwCreateWindow(960, 600, "image_2d (software)", nullptr, nullptr);
+        }
+        // headless, the camera still takes input from replay()
+        cam.pointer = [this](double x, double y, bool click){ pick(x, y, click); };
+        cam.slider = [this](float f){ compare.set_split(f); };
+        cam.key = [this](int key, int){
+            if(key == GLFW_KEY_C) compare.cycle();
+            else if(key == GLFW_KEY_F) spectrum.toggle();
+            else if(key == GLFW_KEY_P && spectrum.shown) spectrum.toggle_mode();
+            else if(key == GLFW_KEY_F12) capture.screenshot();
+            else if(key == GLFW_KEY_F10) capture.toggle();
+        };
+        if(win){
+            glfwSetWindowUserPointer(win, &cam);
+            glfwSetKeyCallback(win, keyCallback);
+            glfwSetScrollCallback(win, scrollCallback);
+            glfwSetCursorPosCallback(win, cursorPosCallback);
+            glfwSetMouseButtonCallback(win, mouseButtonCallback);
+        }
+        else{
+            scheduler.has_context = false;
+            std::cout << "software renderer: headless " << fb_w << "x" << fb_h << "\n";
+        }
+    }
+    ~glfw_window2d_sw()
+    {
+        running = false;
+        if(t.joinable())t.join();
+        if(win) glfwDestroyWindow(win);
+        owner.resources.remove_window(this);
+    }
+    bool valid() const
+    {
+        return true;
+    }
+    glfw_window2d_sw& set_viewport(int w, int h)
+    {
+        fb_w = w;
+        fb_h = h;
+        return *this;
+    }
+    glfw_window2d_sw& set_present_mode(present_mode m)
+    {
+        scheduler.request_mode(m);
+        return *this;
+    }
+    glfw_window2d_sw& set_scroll_speed(float speed = 0.1f)
+    {
+        cam.set_speed(speed, cam.move_speed);
+        return *this;
+    }
+    glfw_window2d_sw& set_move_speed(float speed = 1.0f)
+    {
+        cam.set_speed(cam.scroll_speed, speed);
+        return *this;
+    }
+    glfw_window2d_sw& append_texture(const char* path)
+    {
+        if(nullptr == path) push(make_checker_image());
+        //== TODO : load path
+        return *this;
+    }
+    // the loader runs on the render thread, software textures keep no other host copy
+    glfw_window2d_sw& append_texture(std::function<texture_image()> loader)
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        pending.push_back({{}, std::move(loader)});
+        return *this;
+    }
+    // every format is sampled from RGBA8 here, so encode straight to rgb8
+    glfw_window2d_sw& append_texture(const float* data, int xsize, int ysize, texture_format)
+    {
+        return push(encode_scalar(data, xsize, ysize, texture_format::rgb8));
+    }
+    glfw_window2d_sw& append_texture(const uint8_t* rgb, int xsize, int ysize, texture_format)
+    {
+        return push(encode_rgb(rgb, xsize, ysize, texture_format::rgb8));
+    }
+    glfw_window2d_sw& async_loop(int maxFPS = 30)
+    {
+        if(win) glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+        // as the GL 3.3 window, whose texture-space pan this shares: 2.0 in the GL 2.1 window
+        // pans its [-1, 1] world at the same on-screen speed
+        set_scroll_speed(0.15).set_move_speed(1.0);
+        t = std::thread(&glfw_window2d_sw::loop, this, maxFPS);
+        return *this;
+    }
+    // Shade one frame of the spectrum, the A/B comparison, the layer stack or the last texture into
+    // `framebuffer`; returns milliseconds. The difference views are shown as split here.
+    double render(const view2d& view)
+    {
+        using clock = std::chrono::high_resolution_clock;
+        auto t0 = clock::now();
+        framebuffer.resize(size_t(fb_w) * fb_h);
+        if(texture_list.empty()) return 0;
+        const int tx = (fb_w + tile_w - 1) / tile_w, ty = (fb_h + tile_h - 1) / tile_h;
+        if(spectrum.shown && sync_spectrum()){
+            // 2D FFT of the field instead of the image; annotations do not apply
+            tiles(tx * ty, [&](int i){
+                const int x0 = (i % tx) * tile_w, y0 = (i / tx) * tile_h;
+                sw_shade_rect(spectrum_tex, view.zoom, view.panX, view.panY, framebuffer.data(), fb_w, fb_h,
+                              x0, y0, std::min(fb_w, x0 + tile_w), std::min(fb_h, y0 + tile_h));
+            });
+            overlay.image_w = overlay.image_h = 0;
+            return std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+        }
+        if(layers.changed(layers_seen, layer_copy)){
+            layer_luts.clear();
+            for(const auto& l : layer_copy)
+                layer_luts.push_back(l.colormap.empty() ? nullptr : &get_colormap_color(l.colormap));
+        }
+        std::vector<int> passes;
+        for(int k = 0; k < int(layer_copy.size()); ++k){
+            const auto& l = layer_copy[k];
+            if(l.visible && l.texture >= 0 && size_t(l.texture) < texture_list.size()) passes.push_back(k);
+        }
+        const bool compared = compare.active(texture_list.size());
+        const sw_texture& tex = compared ? texture_list[compare.a] : passes.empty() ? texture_list.back() : texture_list[layer_copy[passes[0]].texture];
+        if(!passes.empty()) scratch.resize(framebuffer.size());
+        const sw_texture* cmp[2] = {&tex, compared ? &texture_list[compare.b] : nullptr};
+        const bool flicker = compared && compare.current() == compare_view::flicker;
+        const int split = flicker ? (compare.flicker_b() ? 0 : fb_w) : int(compare.split * fb_w);
+        tiles(tx * ty, [&](int i){
+            const int x0 = (i % tx) * tile_w, y0 = (i / tx) * tile_h;
+            const int x1 = std::min(fb_w, x0 + tile_w), y1 = std::min(fb_h, y0 + tile_h);
+            if(compared){
+                // A left of the split column, B right of it; flicker moves the split to an edge
+                const int xs = std::min(x1, std::max(x0, split));
+                if(xs > x0) sw_shade_rect(*cmp[0], view.zoom, view.panX, view.panY, framebuffer.data(), fb_w, fb_h, x0, y0, xs, y1);
+                if(x1 > xs) sw_shade_rect(*cmp[1], view.zoom, view.panX, view.panY, framebuffer.data(), fb_w, fb_h, xs, y0, x1, y1);
+                if(!flicker)
+                    for(int x = std::max(x0, split - 1); x < std::min(x1, split + 1); ++x)
+                        for(int y = y0; y < y1; ++y) framebuffer[size_t(y) * fb_w + x] = 0xff33ffffu;
+                return;
+            }
+            if(passes.empty()){
+                sw_shade_rect(tex, view.zoom, view.panX, view.panY, framebuffer.data(), fb_w, fb_h, x0, y0, x1, y1);
+                return;
+            }
+            // each layer is shaded into the tile's part of `scratch`, then blended
+            for(size_t p = 0; p < passes.size(); ++p){
+                const auto& l = layer_copy[passes[p]];
+                sw_shade_rect(texture_list[l.texture], view.zoom, view.panX, view.panY, scratch.data(), fb_w, fb_h, x0, y0, x1, y1);
+                sw_blend_rect(scratch.data(), framebuffer.data(), fb_w, x0, y0, x1, y1, layer_luts[passes[p]],
+                              int(l.opacity * 256.0f + 0.5f), l.blend, p == 0);
+            }
+        });
+        overlay.image_w = tex.width;
+        overlay.image_h = tex.height;
+        draw_overlay(view, tex.width, tex.height);
+        return std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+    }
+    // Headless, deterministic replay of a recorded session, instead of loop(): a virtual clock
+    // at `fps` feeds the events recorded up to each frame through the camera, then the frame is
+    // shaded at the recorded framebuffer size. realtime paces frames to the recorded timeline,
+    // otherwise they run back to back.
+    replay_stats replay(const input_trace& trace, float fps = 60.0f, bool realtime = false)
+    {
+        using clock = std::chrono::steady_clock;
+        replay_stats r;
+        update_textures();
+        if(texture_list.empty()){
+            append_texture(nullptr);
+            update_textures();
+        }
+        cam.zoom = trace.header.zoom;
+        cam.panX = trace.header.panX;
+        cam.panY = trace.header.panY;
+        cam.scroll_speed = trace.header.scroll_speed;
+        cam.move_speed = trace.header.move_speed;
+        cam.view.store(view2d{cam.zoom, cam.panX, cam.panY, now_ns()});
+        const int64_t period = int64_t(1e9 / std::max(1.0f, fps));
+        const auto t0 = clock::now();
+        size_t next = 0;
+        for(int64_t t = 0;; t += period){
+            for(; next < trace.events.size() && trace.events[next].t_ns <= t; ++next){
+                const trace_event& e = trace.events[next];
+                if(!cam.replay(e)) ++r.camera_mismatches;
+                if(trace_kind(e.kind) == trace_kind::resize && cam.size.fb_w > 0 && cam.size.fb_h > 0){
+                    fb_w = cam.size.fb_w;
+                    fb_h = cam.size.fb_h;
+                }
+            }
+            if(realtime) std::this_thread::sleep_until(t0 + std::chrono::nanoseconds(t));
+            r.frame_ms.push_back(render(cam.view.load()));
+            capture_frame_at(t);
+            ++frames_rendered;
+            if(next == trace.events.size()) break;
+        }
+        r.events = next;
+        r.wall_ms = std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+        return r;
+    }
+    bool save_ppm(const char* path) const
+    {
+        FILE* f = std::fopen(path, "wb");
+        if(!f){ std::cerr << "can not write " << path << "\n"; return false; }
+        std::fprintf(f, "P6\n%d %d\n255\n", fb_w, fb_h);
+        std::vector<uint8_t> row(size_t(fb_w) * 3);
+        for(int y = fb_h - 1; y >= 0; --y){
+            const uint32_t* p = framebuffer.data() + size_t(y) * fb_w;
+            for(int x = 0; x < fb_w; ++x){
+                row[x*3] = uint8_t(p[x]); row[x*3+1] = uint8_t(p[x] >> 8); row[x*3+2] = uint8_t(p[x] >> 16);
+            }
+            std::fwrite(row.data(), 1, row.size(), f);
+        }
+        std::fclose(f);
+        return true;
+    }
+    void loop(int maxFPS = 0)
+    {
+        if(win) glfwMakeContextCurrent(win);
+        update_textures();
+        if(texture_list.empty()) append_texture(nullptr);
+
+        using clock = std::chrono::high_resolution_clock;
+        auto lastTime = clock::now();
+        int frames = 0;
+        double shade_ms = 0;
+        scheduler.set_max_fps(maxFPS);
+        while (running){
+            // ---- 帧率限制 ----
+            scheduler.begin_frame();
+            update_textures();
+            if(win) glfwGetFramebufferSize(win, &fb_w, &fb_h);
+            const view2d view = cam.view.load();
+            shade_ms += render(view);
+            capture_frame_at(now_ns());
+            if(win){
+                blit();
+                glfwSwapBuffers(win);
+            }
+            scheduler.presented(view.input_ns);
+            ++frames_rendered;
+
+            // ---- FPS 统计 ----
+            constexpr float print_fps_time_in_second = 5.0;
+            if constexpr(0 < print_fps_time_in_second){
+                frames++;
+                auto now = clock::now();
+                std::chrono::duration<float> elapsed = now - lastTime;
+                if (elapsed.count() >= print_fps_time_in_second) {
+                    std::cout << "FPS: " << frames / elapsed.count() << " (shade " << shade_ms / frames
+                              << " ms, " << owner.jobs.size() << " threads)" << std::endl;
+                    owner.stats.set("fps.window" + std::to_string(index), frames / elapsed.count());
+                    owner.stats.set("sw.window" + std::to_string(index) + ".shade_ms", shade_ms / frames);
+                    scheduler.publish(owner.stats, "latency.window" + std::to_string(index));
+                    owner.jobs.publish(owner.stats);
+                    capture.publish(owner.stats, "capture.window" + std::to_string(index));
+                    frames = 0;
+                    shade_ms = 0;
+                    lastTime = now;
+                }
+            }
+        }
+        capture.stop();
+        capture.flush();
+        if(win){
+            if(blit_tex) glDeleteTextures(1, &blit_tex);
+            glfwMakeContextCurrent(nullptr);
+        }
+        for(auto rid : texture_rids) owner.resources.untrack(rid);
+        texture_rids.clear();
+    }
+    // Headless: wait for the first frame, then stop the render thread.
+    void event_loop()
+    {
+        if(win){
+            while (!glfwWindowShouldClose(win)) {
+                glfwWaitEvents();
+            }
+        }
+        else{
+            while(t.joinable() && frames_rendered.load() == 0) std::this_thread::yield();
+        }
+        running = false;
+    }
+
+private:
+    // the framebuffer is reused by the next frame, so a due frame is copied
+    void capture_frame_at(int64_t t_ns)
+    {
+        capture_request r;
+        if(capture.due(t_ns, r)) capture.push_copy(framebuffer.data(), fb_w, fb_h, r);
+    }
+    template<class F> void tiles(int n, F&& shade)
+    {
+        owner.jobs.parallel_for(0, n, [&](int b, int e){ for(int i = b; i < e; ++i) shade(i); }, 1, job_priority::high);
+    }
+    // event thread: same mapping as the GL 3.3 window
+    void pick(double x, double y, bool click)
+    {
+        int ww = cam.size.w, wh = cam.size.h;
+        if(win) glfwGetWindowSize(win, &ww, &wh);
+        const int iw = overlay.image_w, ih = overlay.image_h;
+        if(ww <= 0 || wh <= 0 || 0 == iw || 0 == ih) return;
+        const float u = (float(x) / ww - 0.5f) / cam.zoom + 0.5f + cam.panX;
+        const float v = (0.5f - float(y) / wh) / cam.zoom + 0.5f + cam.panY;
+        const float px = 0.5f * (float(iw) / ww + float(ih) / wh) / cam.zoom;
+        overlay.pointer(u * iw, v * ih, px, click);
+    }
+    void blend(int x, int y, uint32_t c)
+    {
+        if(x < 0 || y < 0 || x >= fb_w || y >= fb_h) return;
+        uint32_t& d = framebuffer[size_t(y) * fb_w + x];
+        const uint32_t a = c >> 24;
+        uint32_t out = 0xff000000u;
+        for(int k = 0; k < 24; k += 8)
+            out |= ((((c >> k) & 255) * a + ((d >> k) & 255) * (255 - a) + 127) / 255) << k;
+        d = out;
+    }
+    // 1 px line, clipped to the framebuffer before stepping
+    void line(float x0, float y0, float x1, float y1, uint32_t c)
+    {
+        float t0 = 0, t1 = 1;
+        const float dx = x1 - x0, dy = y1 - y0;
+        const float p[4] = {-dx, dx, -dy, dy}, q[4] = {x0, fb_w - 1 - x0, y0, fb_h - 1 - y0};
+        for(int i = 0; i < 4; ++i){
+            if(p[i] == 0){ if(q[i] < 0) return; continue; }
+            const float r = q[i] / p[i];
+            if(p[i] < 0) t0 = std::max(t0, r); else t1 = std::min(t1, r);
+        }
+        if(t0 > t1) return;
+        const float ax = x0 + t0 * dx, ay = y0 + t0 * dy;
+        const float len = (t1 - t0) * std::max(std::abs(dx), std::abs(dy));
+        const int n = int(len) + 1;
+        for(int i = 0; i <= n; ++i){
+            const float t = len > 0 ? float(i) / n * (t1 - t0) : 0.0f;
+            blend(int(ax + t * dx + 0.5f), int(ay + t * dy + 0.5f), c);
+        }
+    }
+    // contours and the whole layer every frame: markers as discs, boxes and polylines as 1 px lines
+    void draw_overlay(const view2d& view, int iw, int ih)
+    {
+        const overlay_id hovered = overlay.hovered;
+        overlay_kind hl_kind = overlay_kind::marker;
+        int hl_first = 0, hl_count = 0;
+        if(hovered < 0 || !overlay.layer.instances(hovered, hl_kind, hl_first, hl_count)) hl_count = 0;
+        auto sx = [&](float x){ return ((x / iw - 0.5f - view.panX) * view.zoom + 0.5f) * fb_w; };
+        auto sy = [&](float y){ return ((y / ih - 0.5f - view.panY) * view.zoom + 0.5f) * fb_h; };
+        const contour_snapshot contours = overlay.contours.snapshot();
+        for(const auto& l : *contours){
+            const contour_lines& ln = *l.lines;
+            for(size_t k = 0; k < ln.polylines(); ++k)
+                for(uint32_t p = ln.starts[k]; p + 1 < ln.starts[k + 1]; ++p)
+                    line(sx(ln.xy[p * 2]), sy(ln.xy[p * 2 + 1]), sx(ln.xy[p * 2 + 2]), sy(ln.xy[p * 2 + 3]), l.color);
+        }
+        overlay.layer.flush([&](overlay_kind kind, const void* data, size_t, size_t count,
+                                const std::vector<std::pair<size_t, size_t>>&, uint32_t){
+            auto color = [&](size_t i, uint32_t c){
+                return kind == hl_kind && int(i) >= hl_first && int(i) < hl_first + hl_count ? rgba(255, 255, 51) : c;
+            };
+            if(kind == overlay_kind::marker){
+                const overlay_marker* m = static_cast<const overlay_marker*>(data);
+                for(size_t i = 0; i < count; ++i){
+                    if(0 == (m[i].color >> 24)) continue;
+                    const float cx = sx(m[i].x), cy = sy(m[i].y), r = m[i].size * 0.5f;
+                    const uint32_t c = color(i, m[i].color);
+                    for(int y = int(std::floor(cy - r)); y <= int(std::ceil(cy + r)); ++y)
+                        for(int x = int(std::floor(cx - r)); x <= int(std::ceil(cx + r)); ++x)
+                            if((x + 0.5f - cx) * (x + 0.5f - cx) + (y + 0.5f - cy) * (y + 0.5f - cy) <= r * r) blend(x, y, c);
+                }
+                return;
+            }
+            const overlay_line* l = static_cast<const overlay_line*>(data);
+            for(size_t i = 0; i < count; ++i){
+                if(0 == (l[i].color >> 24)) continue;
+                const uint32_t c = color(i, l[i].color);
+                const float x0 = sx(l[i].x0), y0 = sy(l[i].y0), x1 = sx(l[i].x1), y1 = sy(l[i].y1);
+                if(kind == overlay_kind::segment){
+                    line(x0, y0, x1, y1, c);
+                    continue;
+                }
+                line(x0, y0, x1, y0, c); line(x1, y0, x1, y1, c);
+                line(x1, y1, x0, y1, c); line(x0, y1, x0, y0, c);
+            }
+        });
+    }
+    // render thread: re-sample the spectrum when the engine published a new one
+    bool sync_spectrum()
+    {
+        std::shared_ptr<const texture_image> s = spectrum.snapshot();
+        if(!s) return false;
+        if(s != spectrum_img && make_sw_texture(*s, spectrum_tex)) spectrum_img = std::move(s);
+        return true;
+    }
+    glfw_window2d_sw& push(texture_image&& img)
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        pending.push_back({std::move(img), {}});
+        return *this;
+    }
+    void update_textures()
+    {
+        std::vector<texture_host> todo;
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex);
+            todo.swap(pending);
+        }
+        for(auto& h : todo){
+            if(h.image.bytes.empty() && h.reload) h.image = h.reload();
+            sw_texture tex;
+            if(!make_sw_texture(h.image, tex)){
+                std::cerr << "software renderer can not sample " << texture_format_name(h.image.fmt) << "\n";
+                continue;
+            }
+            texture_rids.push_back(owner.resources.track(this, resource_kind::texture, 0,
+                tex.texels.size() * sizeof(uint32_t), false));
+            texture_list.push_back(std::move(tex));
+        }
+    }
+    // draw the framebuffer as one screen-sized texture
+    void blit()
+    {
+        glViewport(0, 0, fb_w, fb_h);
+        glMatrixMode(GL_PROJECTION); glLoadIdentity();
+        glMatrixMode(GL_MODELVIEW); glLoadIdentity();
+        if(0 == blit_tex){
+            glGenTextures(1, &blit_tex);
+            glBindTexture(GL_TEXTURE_2D, blit_tex);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+        glBindTexture(GL_TEXTURE_2D, blit_tex);
+        if(blit_w != fb_w || blit_h != fb_h){
+            blit_w = fb_w; blit_h = fb_h;
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, fb_w, fb_h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        }
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, fb_w, fb_h, GL_RGBA, GL_UNSIGNED_BYTE, framebuffer.data());
+        glEnable(GL_TEXTURE_2D);
+        glColor3f(1,1,1);
+        glBegin(GL_QUADS);
+        glTexCoord2f(0,0); glVertex2f(-1,-1);
+        glTexCoord2f(1,0); glVertex2f( 1,-1);
+        glTexCoord2f(1,1); glVertex2f( 1, 1);
+        glTexCoord2f(0,1); glVertex2f(-1, 1);
+        glEnd();
+        glDisable(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    std::mutex pending_mutex;
+    std::vector<texture_host> pending;
+    uint64_t layers_seen = 0;
+    std::vector<image_layer> layer_copy;
+    std::vector<const std::array<std::array<uint8_t, 3>, 256>*> layer_luts;
+    std::vector<uint32_t> scratch;
+    std::shared_ptr<const texture_image> spectrum_img;
+    sw_texture spectrum_tex;
+    GLuint blit_tex = 0;
+    int blit_w = 0, blit_h = 0;
+};
@@ -0,0 +1,177 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64)
+#   include <immintrin.h>
+#   ifndef DISPLAY_TOOL_SSE2
+#       define DISPLAY_TOOL_SSE2 1
+#   endif
+#endif
+#include "../instrumentation.h"
+#include "../parallel_for.hpp"
+
+// Error of `test` against `reference`, element by element. NaN in either image counts as a
+// mismatch and is left out of max_abs / rmse. PSNR uses the reference's value range as
+// peak unless one is given.
+struct diff_stats
+{
+    size_t count = 0;
+    size_t mismatches = 0;  // |reference - test| > tolerance, or NaN
+    size_t nans = 0;
+    double max_abs = 0;
+    double rmse = 0;
+    double psnr = 0;        // dB, infinity for identical images
+    double ref_min = 0, ref_max = 0;
+
+    void publish(instrumentation& stats, const std::string& prefix) const
+    {
+        stats.set(prefix + ".max_abs", max_abs);
+        stats.set(prefix + ".rmse", rmse);
+        stats.set(prefix + ".psnr", psnr);
+        stats.set(prefix + ".mismatches", double(mismatches));
+    }
+};
+
+// per 64k-element chunk, reduced in chunk order so the result does not depend on the thread count
+struct diff_partial
+{
+    double sum_sq = 0;
+    float max_abs = 0;
+    float lo = std::numeric_limits<float>::infinity();
+    float hi = -std::numeric_limits<float>::infinity();
+    size_t mismatches = 0;
+    size_t nans = 0;
+};
+
+template<class T>
+void diff_range(const T* a, const T* b, size_t i, size_t end, float tolerance, diff_partial& p)
+{
+#ifdef DISPLAY_TOOL_SSE2
+    static const uint8_t bits[16] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+    const __m128 tol = _mm_set1_ps(tolerance);
+    __m128 vmax = _mm_setzero_ps(), vlo = _mm_set1_ps(p.lo), vhi = _mm_set1_ps(p.hi);
+    size_t miss = 0, nans = 0;
+    if constexpr(std::is_same_v<T, float>){
+        const __m128 sign = _mm_set1_ps(-0.0f);
+        __m128d sq0 = _mm_setzero_pd(), sq1 = _mm_setzero_pd();
+        for(; i + 4 <= end; i += 4){
+            const __m128 x = _mm_loadu_ps(a + i), y = _mm_loadu_ps(b + i);
+            const __m128 ord = _mm_cmpord_ps(x, y);
+            const __m128 d = _mm_and_ps(_mm_sub_ps(x, y), ord);  // NaN lanes -> 0
+            const __m128 ad = _mm_andnot_ps(sign, d);
+            vmax = _mm_max_ps(vmax, ad);
+            // min/max of the reference, NaN lanes keep the running value
+            vlo = _mm_min_ps(x, vlo);
+            vhi = _mm_max_ps(x, vhi);
+            sq0 = _mm_add_pd(sq0, _mm_mul_pd(_mm_cvtps_pd(d), _mm_cvtps_pd(d)));
+            const __m128 dh = _mm_movehl_ps(d, d);
+            sq1 = _mm_add_pd(sq1, _mm_mul_pd(_mm_cvtps_pd(dh), _mm_cvtps_pd(dh)));
+            const int nan = _mm_movemask_ps(ord) ^ 15;
+            miss += bits[_mm_movemask_ps(_mm_cmpgt_ps(ad, tol)) | nan];
+            nans += bits[nan];
+        }
+        double s[2];
+        _mm_storeu_pd(s, _mm_add_pd(sq0, sq1));
+        p.sum_sq += s[0] + s[1];
+    }
+    else if constexpr(std::is_same_v<T, uint16_t> || std::is_same_v<T, uint8_t>){
+        // widened to i32: differences are exact and never NaN, squares add up exactly in 64-bit lanes
+        const __m128i zero = _mm_setzero_si128();
+        __m128i sq = _mm_setzero_si128();
+        auto lanes = [&](__m128i x, __m128i y){
+            const __m128i d = _mm_sub_epi32(x, y), neg = _mm_srai_epi32(d, 31);
+            const __m128i ad = _mm_sub_epi32(_mm_xor_si128(d, neg), neg);
+            const __m128 adf = _mm_cvtepi32_ps(ad), xf = _mm_cvtepi32_ps(x);
+            vmax = _mm_max_ps(vmax, adf);
+            vlo = _mm_min_ps(xf, vlo);
+            vhi = _mm_max_ps(xf, vhi);
+            const __m128i odd = _mm_srli_epi64(ad, 32);
+            sq = _mm_add_epi64(sq, _mm_add_epi64(_mm_mul_epu32(ad, ad), _mm_mul_epu32(odd, odd)));
+            miss += bits[_mm_movemask_ps(_mm_cmpgt_ps(adf, tol))];
+        };
+        auto words = [&](__m128i x, __m128i y){
+            lanes(_mm_unpacklo_epi16(x, zero), _mm_unpacklo_epi16(y, zero));
+            lanes(_mm_unpackhi_epi16(x, zero), _mm_unpackhi_epi16(y, zero));
+        };
+        for(; i + 16 / sizeof(T) <= end; i += 16 / sizeof(T)){
+            const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+            if constexpr(sizeof(T) == 1){
+                words(_mm_unpacklo_epi8(x, zero), _mm_unpacklo_epi8(y, zero));
+                words(_mm_unpackhi_epi8(x, zero), _mm_unpackhi_epi8(y, zero));
+            }
+            else words(x, y);
+        }
+        uint64_t s[2];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(s), sq);
+        p.sum_sq += double(s[0] + s[1]);
+    }
+    float m[4], l[4], h[4];
+    _mm_storeu_ps(m, vmax); _mm_storeu_ps(l, vlo); _mm_storeu_ps(h, vhi);
+    for(int k = 0; k < 4; ++k){
+        p.max_abs = std::max(p.max_abs, m[k]);
+        p.lo = std::min(p.lo, l[k]);
+        p.hi = std::max(p.hi, h[k]);
+    }
+    p.mismatches += miss;
+    p.nans += nans;
+#endif
+    for(; i < end; ++i){
+        const float x = float(a[i]), y = float(b[i]);
+        if constexpr(std::is_floating_point_v<T>){
+            if(std::isnan(x) || std::isnan(y)){
+                ++p.mismatches;
+                ++p.nans;
+                if(!std::isnan(x)){ p.lo = std::min(p.lo, x); p.hi = std::max(p.hi, x); }
+                continue;
+            }
+        }
+        const float d = x - y, ad = std::abs(d);
+        p.max_abs = std::max(p.max_abs, ad);
+        p.lo = std::min(p.lo, x);
+        p.hi = std::max(p.hi, x);
+        p.sum_sq += double(d) * d;
+        if(ad > tolerance) ++p.mismatches;
+    }
+}
+
+// Multithreaded over 64k-element chunks; memory bound, one pass over both images.
+// peak <= 0: use the reference's max - min.
+template<class T>
+diff_stats compare_images(const T* reference, const T* test, size_t n, float tolerance = 0.0f, double peak = 0.0)
+{
+    constexpr size_t chunk = 65536;
+    const int chunks = int((n + chunk - 1) / chunk);
+    std::vector<diff_partial> part(chunks);
+    parallel_for(0, chunks, [&](int b, int e){
+        for(int c = b; c < e; ++c)
+            diff_range(reference, test, size_t(c) * chunk, std::min(n, size_t(c + 1) * chunk), tolerance, part[c]);
+    });
+    diff_stats s;
+    s.count = n;
+    double sum_sq = 0;
+    float lo = std::numeric_limits<float>::infinity(), hi = -lo;
+    for(const auto& p : part){
+        sum_sq += p.sum_sq;
+        s.max_abs = std::max(s.max_abs, double(p.max_abs));
+        s.mismatches += p.mismatches;
+        s.nans += p.nans;
+        lo = std::min(lo, p.lo);
+        hi = std::max(hi, p.hi);
+    }
+    s.ref_min = n ? lo : 0;
+    s.ref_max = n ? hi : 0;
+    const size_t valid = n - s.nans;
+    const double mse = valid ? sum_sq / double(valid) : 0.0;
+    s.rmse = std::sqrt(mse);
+    if(peak <= 0) peak = s.ref_max - s.ref_min;
+    if(peak <= 0) peak = 1;
+    s.psnr = mse > 0 ? 10.0 * std::log10(peak * peak / mse) : std::numeric_limits<double>::infinity();
+    return s;
+}
@@ -0,0 +1,177 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../instrumentation.h"
+
+// Window and framebuffer size in pixels, as the input callbacks see them.
+struct window_size
+{
+    int w = 0, h = 0;
+    int fb_w = 0, fb_h = 0;
+    bool operator!=(const window_size& o) const
+    {
+        return w != o.w || h != o.h || fb_w != o.fb_w || fb_h != o.fb_h;
+    }
+};
+
+// ---------- trace file ----------
+//   header  { "DTTRACE1", uint32 version, int32 scene, float zoom, panX, panY, scroll_speed, move_speed, uint32 0 }
+//   events  32 bytes each, in the order they were handled
+enum class trace_kind : uint8_t
+{
+    cursor,  // v = x, y in window coordinates
+    button,  // code = button, action, mods, v = cursor x, y
+    key,     // code = key, action, mods
+    scroll,  // v = x, y offset
+    resize,  // v = window w, h, framebuffer w, h; recorded before the event that saw it
+    camera,  // v = zoom, panX, panY after the preceding events; checked, not applied, on replay
+    speed,   // v = scroll speed, move speed, when the window changed them after the header
+};
+struct trace_event
+{
+    int64_t t_ns;    // since the recording started
+    uint8_t kind;
+    uint8_t action;
+    uint16_t mods;
+    int32_t code;
+    float v[4];
+};
+static_assert(sizeof(trace_event) == 32);
+
+struct trace_header
+{
+    char magic[8];
+    uint32_t version;
+    int32_t scene;   // what was displayed, for the replay to rebuild it (image_2d: texture format, -1 none)
+    float zoom, panX, panY;  // camera at the first event
+    float scroll_speed, move_speed;  // at the first event, later changes are speed events
+    uint32_t reserved;
+};
+static_assert(sizeof(trace_header) == 40);
+
+struct input_trace
+{
+    static constexpr uint32_t version = 1;
+    trace_header header{};
+    std::vector<trace_event> events;
+
+    bool load(const std::string& path)
+    {
+        std::FILE* f = std::fopen(path.c_str(), "rb");
+        if(!f){ std::cerr << "can not open " << path << "\n"; return false; }
+        const bool ok = std::fread(&header, sizeof(header), 1, f) == 1
+                     && 0 == std::memcmp(header.magic, "DTTRACE1", 8) && header.version == version;
+        events.clear();
+        trace_event e;
+        while(ok && std::fread(&e, sizeof(e), 1, f) == 1) events.push_back(e);
+        std::fclose(f);
+        if(!ok) std::cerr << path << ": not an input trace of this version\n";
+        return ok;
+    }
+    double seconds() const
+    {
+        return events.empty() ? 0.0 : events.back().t_ns * 1e-9;
+    }
+};
+
+// Appends events to a buffered file; written by the event thread only. The header goes out
+// with the first event, once the window has set up its camera.
+struct trace_recorder
+{
+    ~trace_recorder()
+    {
+        close();
+    }
+    bool open(const std::string& path, int trace_scene)
+    {
+        f = std::fopen(path.c_str(), "wb");
+        if(!f){ std::cerr << "can not write " << path << "\n"; return false; }
+        scene = trace_scene;
+        return true;
+    }
+    bool started() const
+    {
+        return started_;
+    }
+    void start(float zoom, float panX, float panY, float scroll_speed, float move_speed)
+    {
+        if(!f || started_) return;
+        trace_header h{};
+        std::memcpy(h.magic, "DTTRACE1", 8);
+        h.version = input_trace::version;
+        h.scene = scene;
+        h.zoom = zoom; h.panX = panX; h.panY = panY;
+        h.scroll_speed = scroll_speed; h.move_speed = move_speed;
+        std::fwrite(&h, sizeof(h), 1, f);
+        t0 = std::chrono::steady_clock::now();
+        started_ = true;
+    }
+    void add(trace_kind kind, int code, int action, int mods, float a = 0, float b = 0, float c = 0, float d = 0)
+    {
+        if(!started_) return;
+        const trace_event e{std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count(),
+                            uint8_t(kind), uint8_t(action), uint16_t(mods), int32_t(code), {a, b, c, d}};
+        std::fwrite(&e, sizeof(e), 1, f);
+    }
+    // a resize event whenever the sizes differ from the last recorded ones
+    void size(const window_size& s)
+    {
+        if(!(s != last)) return;
+        last = s;
+        add(trace_kind::resize, 0, 0, 0, float(s.w), float(s.h), float(s.fb_w), float(s.fb_h));
+    }
+    void close()
+    {
+        if(f) std::fclose(f);
+        f = nullptr;
+    }
+private:
+    std::FILE* f = nullptr;
+    int scene = -1;
+    bool started_ = false;
+    std::chrono::steady_clock::time_point t0;
+    window_size last;
+};
+
+// Per-frame shading times of a replay.
+struct replay_stats
+{
+    std::vector<double> frame_ms;
+    size_t events = 0;
+    size_t camera_mismatches = 0;  // camera records the replayed input did not reproduce
+    double wall_ms = 0;
+
+    double mean() const
+    {
+        double s = 0;
+        for(double v : frame_ms) s += v;
+        return frame_ms.empty() ? 0.0 : s / frame_ms.size();
+    }
+    // nearest rank, q in [0, 1]
+    double percentile(double q) const
+    {
+        if(frame_ms.empty()) return 0;
+        std::vector<double> v(frame_ms);
+        const size_t k = std::min(v.size() - 1, size_t(q * v.size()));
+        std::nth_element(v.begin(), v.begin() + k, v.end());
+        return v[k];
+    }
+    void publish(instrumentation& stats, const std::string& prefix = "replay") const
+    {
+        stats.set(prefix + ".frames", double(frame_ms.size()));
+        stats.set(prefix + ".events", double(events));
+        stats.set(prefix + ".camera_mismatches", double(camera_mismatches));
+        stats.set(prefix + ".mean_ms", mean());
+        stats.set(prefix + ".p50_ms", percentile(0.50));
+        stats.set(prefix + ".p95_ms", percentile(0.95));
+        stats.set(prefix + ".p99_ms", percentile(0.99));
+        stats.set(prefix + ".max_ms", percentile(1.0));
+        stats.set(prefix + ".wall_ms", wall_ms);
+    }
+};
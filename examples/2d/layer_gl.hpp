@@ -0,0 +1,226 @@
+#pragma once
+#ifdef __APPLE__
+#   include <OpenGL/gl3.h>
+#else
+#   include <GL/glew.h>
+#endif
+#include <array>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "layer_stack.hpp"
+#include "managed_textures.hpp"
+#include "colormaps.hpp"
+
+// ---------- layer shaders (GL 3.3) ----------
+static const char* layerBakeVS = R"(
+#version 330 core
+layout(location = 0) in vec2 aPos;
+layout(location = 1) in vec2 aTex;
+out vec2 TexCoord;
+void main() {
+    TexCoord = aTex;
+    gl_Position = vec4(aPos, 0.0, 1.0);
+}
+)";
+
+// source texture -> display value, the same mapping as the single-texture shader
+static const char* layerBakeFS = R"(
+#version 330 core
+in vec2 TexCoord;
+out vec4 FragColor;
+uniform sampler2D uSource;
+uniform float uScale;
+uniform float uOffset;
+void main() {
+    FragColor = vec4(texture(uSource, TexCoord).rgb * uScale + uOffset, 1.0);
+}
+)";
+
+static const char* layerCompositeFS = R"(
+#version 330 core
+in vec2 TexCoord;
+out vec4 FragColor;
+uniform sampler2DArray uLayers;
+uniform sampler2D uColormaps;   // one 256-texel row per layer
+uniform int uCount;
+uniform vec4 uLayer[16];        // array layer, opacity, blend mode, colormap row (-1 = none)
+void main() {
+    vec3 acc = vec3(0.0);
+    for(int i = 0; i < uCount; ++i) {
+        vec4 p = uLayer[i];
+        vec3 c = texture(uLayers, vec3(TexCoord, p.x)).rgb;
+        if(p.w >= 0.0) c = texture(uColormaps, vec2((c.r * 255.0 + 0.5) / 256.0, (p.w + 0.5) / 16.0)).rgb;
+        int mode = int(p.z);
+        if(mode == 0)      acc = mix(acc, c, p.y);
+        else if(mode == 1) acc = min(acc + c * p.y, vec3(1.0));
+        else               acc = max(acc, c * p.y);
+    }
+    FragColor = vec4(acc, 1.0);
+}
+)";
+
+// Composites a layer_stack in one full-screen pass. Every texture the stack uses is baked once
+// (display mapping applied) into a layer of an RGBA8 texture array sized like the bottom
+// layer; after that a frame samples the array once per visible layer, whatever the sources'
+// formats are. Call from the render thread with the window's quad VAO bound.
+struct layer_compositor
+{
+    bool init(resource_manager& r, const void* o, GLuint (*compile)(GLenum, const char*), const char* quad_vs)
+    {
+        rm = &r;
+        owner = o;
+        bake_program = link(compile(GL_VERTEX_SHADER, layerBakeVS), compile(GL_FRAGMENT_SHADER, layerBakeFS));
+        composite_program = link(compile(GL_VERTEX_SHADER, quad_vs), compile(GL_FRAGMENT_SHADER, layerCompositeFS));
+        if(!bake_program || !composite_program) return false;
+        glGenFramebuffers(1, &fbo);
+        glGenTextures(1, &colormap_tex);
+        glBindTexture(GL_TEXTURE_2D, colormap_tex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, 256, layer_stack::max_layers, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return true;
+    }
+    // Follow the stack and bake textures that are new to the array.
+    // Returns false while nothing is visible, then the caller draws its single texture.
+    bool sync(managed_textures& list, const layer_stack& stack)
+    {
+        const bool edited = stack.changed(seen, layers);
+        if(!edited && list.size() == seen_textures) return count > 0;
+        seen_textures = list.size();
+
+        // distinct textures of the visible layers, bottom first
+        std::vector<int> used;
+        count = 0;
+        for(const auto& l : layers){
+            if(!l.visible || l.texture < 0 || size_t(l.texture) >= list.size()) continue;
+            int slot = 0;
+            while(slot < int(used.size()) && used[slot] != l.texture) ++slot;
+            if(slot == int(used.size())) used.push_back(l.texture);
+            const int row = count;
+            if(!l.colormap.empty() && row_colormap[row] != l.colormap){
+                row_colormap[row] = l.colormap;
+                glBindTexture(GL_TEXTURE_2D, colormap_tex);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, row, 256, 1, GL_RGB, GL_UNSIGNED_BYTE, get_colormap_color(l.colormap).data());
+                glBindTexture(GL_TEXTURE_2D, 0);
+            }
+            params[count++] = {float(slot), l.opacity, float(int(l.blend)), l.colormap.empty() ? -1.0f : float(row)};
+        }
+        if(0 == count) return false;
+
+        const gpu_texture& base = list.use(used[0]);
+        if(base.width != width || base.height != height || int(used.size()) > int(baked.size())){
+            allocate(base.width, base.height, int(used.size()));
+        }
+        for(int slot = 0; slot < int(used.size()); ++slot)
+            if(baked[slot] != used[slot]) bake(list, used[slot], slot);
+        return true;
+    }
+    void draw(float zoom, float panX, float panY)
+    {
+        glUseProgram(composite_program);
+        glUniform1f(glGetUniformLocation(composite_program, "uZoom"), zoom);
+        glUniform2f(glGetUniformLocation(composite_program, "uPan"), panX, panY);
+        glUniform1i(glGetUniformLocation(composite_program, "uCount"), count);
+        glUniform4fv(glGetUniformLocation(composite_program, "uLayer"), count, params[0].data());
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+        glUniform1i(glGetUniformLocation(composite_program, "uLayers"), 0);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, colormap_tex);
+        glUniform1i(glGetUniformLocation(composite_program, "uColormaps"), 1);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        glUseProgram(0);
+    }
+    void release()
+    {
+        if(array_rid) rm->untrack(array_rid);
+        const GLuint tex[2] = {array, colormap_tex};
+        glDeleteTextures(2, tex);
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteProgram(bake_program);
+        glDeleteProgram(composite_program);
+        array = colormap_tex = fbo = bake_program = composite_program = 0;
+        array_rid = 0;
+    }
+    int width = 0, height = 0;  // of the bottom layer, in texels
+private:
+    static GLuint link(GLuint vs, GLuint fs)
+    {
+        GLuint p = glCreateProgram();
+        glAttachShader(p, vs);
+        glAttachShader(p, fs);
+        glLinkProgram(p);
+        glDeleteShader(vs);
+        glDeleteShader(fs);
+        GLint ok = 0; glGetProgramiv(p, GL_LINK_STATUS, &ok);
+        if(!ok){
+            char buf[1024]; glGetProgramInfoLog(p, 1024, nullptr, buf);
+            std::cerr << "Layer program link error: " << buf << "\n";
+            glDeleteProgram(p);
+            return 0;
+        }
+        return p;
+    }
+    void allocate(int w, int h, int n)
+    {
+        width = w;
+        height = h;
+        if(0 == array) glGenTextures(1, &array);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, w, h, n, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        baked.assign(n, -1);
+        if(array_rid) rm->untrack(array_rid);
+        array_rid = rm->track(owner, resource_kind::texture, size_t(w) * h * 4 * n, 0, false);
+    }
+    // render texture i of the list into array layer `slot`, stretched to the array size
+    void bake(managed_textures& list, int i, int slot)
+    {
+        const gpu_texture& src = list.use(i);
+        GLint prev_fbo = 0, vp[4];
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prev_fbo);
+        glGetIntegerv(GL_VIEWPORT, vp);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, array, 0, slot);
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE){
+            std::cerr << "layer bake: incomplete framebuffer\n";
+        }
+        glViewport(0, 0, width, height);
+        glUseProgram(bake_program);
+        glUniform1f(glGetUniformLocation(bake_program, "uScale"), src.scale);
+        glUniform1f(glGetUniformLocation(bake_program, "uOffset"), src.offset);
+        glUniform1i(glGetUniformLocation(bake_program, "uSource"), 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, src.id);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glUseProgram(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, GLuint(prev_fbo));
+        glViewport(vp[0], vp[1], vp[2], vp[3]);
+        baked[slot] = i;
+    }
+
+    resource_manager* rm = nullptr;
+    const void* owner = nullptr;
+    GLuint bake_program = 0, composite_program = 0, fbo = 0, array = 0, colormap_tex = 0;
+    resource_id array_rid = 0;
+    uint64_t seen = 0;
+    size_t seen_textures = 0;
+    std::vector<image_layer> layers;
+    std::vector<int> baked;  // list index held by each array layer, -1 = none
+    std::array<std::string, layer_stack::max_layers> row_colormap;
+    std::array<std::array<float, 4>, layer_stack::max_layers> params;
+    int count = 0;
+};
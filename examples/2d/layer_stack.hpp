@@ -0,0 +1,102 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// How a layer combines with what is below it (c = layer colour, a = opacity):
+//   alpha:    dst = dst * (1 - a) + c * a
+//   additive: dst = min(dst + c * a, 1)
+//   max:      dst = max(dst, c * a)
+enum class blend_mode : int { alpha, additive, max };
+
+// `texture` is the position in the window's texture list (append order). With a colormap the
+// layer's grey value is looked up in it, otherwise the texture's own colours are used.
+struct image_layer
+{
+    int texture = 0;
+    float opacity = 1.0f;
+    std::string colormap;
+    blend_mode blend = blend_mode::alpha;
+    bool visible = true;
+};
+
+// Bottom-to-top stack of co-registered layers, composited over black. While it is empty the
+// window shows its last texture as before. Edits may come from any thread; the render thread
+// copies the stack when it changed.
+struct layer_stack
+{
+    static constexpr int max_layers = 16;
+
+    // returns the layer index, -1 when the stack is full
+    int add(int texture, blend_mode blend = blend_mode::alpha, float opacity = 1.0f, const std::string& colormap = "")
+    {
+        std::lock_guard<std::mutex> lock(m);
+        if(int(layers.size()) >= max_layers) return -1;
+        image_layer l;
+        l.texture = texture;
+        l.opacity = opacity;
+        l.colormap = colormap;
+        l.blend = blend;
+        layers.push_back(l);
+        ++generation;
+        return int(layers.size()) - 1;
+    }
+    layer_stack& set_opacity(int i, float opacity)
+    {
+        return edit(i, [&](image_layer& l){ l.opacity = opacity; });
+    }
+    layer_stack& set_visible(int i, bool visible)
+    {
+        return edit(i, [&](image_layer& l){ l.visible = visible; });
+    }
+    layer_stack& set_blend(int i, blend_mode blend)
+    {
+        return edit(i, [&](image_layer& l){ l.blend = blend; });
+    }
+    layer_stack& set_colormap(int i, const std::string& colormap)
+    {
+        return edit(i, [&](image_layer& l){ l.colormap = colormap; });
+    }
+    layer_stack& remove(int i)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        if(i < 0 || i >= int(layers.size())) return *this;
+        layers.erase(layers.begin() + i);
+        ++generation;
+        return *this;
+    }
+    layer_stack& clear()
+    {
+        std::lock_guard<std::mutex> lock(m);
+        layers.clear();
+        ++generation;
+        return *this;
+    }
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(m);
+        return layers.size();
+    }
+    // copy into `out` if the stack changed since `seen`
+    bool changed(uint64_t& seen, std::vector<image_layer>& out) const
+    {
+        std::lock_guard<std::mutex> lock(m);
+        if(seen == generation) return false;
+        seen = generation;
+        out = layers;
+        return true;
+    }
+private:
+    template<class F> layer_stack& edit(int i, F&& f)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        if(i < 0 || i >= int(layers.size())) return *this;
+        f(layers[i]);
+        ++generation;
+        return *this;
+    }
+    mutable std::mutex m;
+    std::vector<image_layer> layers;
+    uint64_t generation = 1;
+};
@@ -0,0 +1,101 @@
+#pragma once
+#include <functional>
+#include <mutex>
+#include "texture_codec.hpp"
+#include "../resource_manager.h"
+
+// Host side of a texture: the encoded copy used for re-upload after an eviction,
+// and optionally a loader that can re-create it once the host copy was dropped too.
+struct texture_host
+{
+    texture_image image;
+    std::function<texture_image()> reload;
+};
+
+// Textures of one window, registered with the process-wide resource_manager.
+// enqueue() may be called from any thread, everything else from the render thread.
+struct managed_textures
+{
+    managed_textures(resource_manager& rm, const void* owner, bool swizzle_grey)
+        : rm(rm), owner(owner), swizzle_grey(swizzle_grey)
+    {
+    }
+    ~managed_textures()
+    {
+        release();
+    }
+    void enqueue(texture_host&& h)
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        pending.push_back(std::move(h));
+    }
+    // upload queued textures, then hand back what the manager asked for
+    void update()
+    {
+        std::vector<texture_host> todo;
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex);
+            todo.swap(pending);
+        }
+        for(auto& h : todo){
+            if(h.image.bytes.empty() && h.reload) h.image = h.reload();
+            gpu_texture t = upload_texture_image(h.image, swizzle_grey);
+            t.rid = rm.track(owner, resource_kind::texture, t.bytes, h.image.bytes.size(), true, bool(h.reload));
+            list.push_back(t);
+            hosts.push_back(std::move(h));
+        }
+        for(const auto& e : rm.take_evictions(owner)){
+            for(size_t i = 0; i < list.size(); ++i){
+                if(list[i].rid != e.id) continue;
+                if(e.gpu && list[i].id){
+                    glDeleteTextures(1, &list[i].id);
+                    list[i].id = 0;
+                    rm.evicted(e.id);
+                }
+                if(e.host){
+                    hosts[i].image.bytes.clear();
+                    hosts[i].image.bytes.shrink_to_fit();
+                    rm.host_dropped(e.id);
+                }
+            }
+        }
+    }
+    // make texture i resident and mark it drawn; returns the GL name
+    const gpu_texture& use(size_t i)
+    {
+        gpu_texture& t = list[i];
+        if(0 == t.id){
+            texture_host& h = hosts[i];
+            if(h.image.bytes.empty() && h.reload) h.image = h.reload();
+            const resource_id rid = t.rid;
+            t = upload_texture_image(h.image, swizzle_grey);
+            t.rid = rid;
+            rm.restored(rid, t.bytes, h.image.bytes.size());
+        }
+        rm.touch(t.rid);
+        return t;
+    }
+    // call with the context current
+    void release()
+    {
+        for(auto& t : list){
+            if(t.id) glDeleteTextures(1, &t.id);
+            rm.untrack(t.rid);
+        }
+        list.clear();
+        hosts.clear();
+    }
+    bool empty() const { return list.empty(); }
+    size_t size() const { return list.size(); }
+    const gpu_texture& back() const { return list.back(); }
+    const gpu_texture& operator[](size_t i) const { return list[i]; }
+
+private:
+    resource_manager& rm;
+    const void* owner;
+    const bool swizzle_grey;
+    std::vector<gpu_texture> list;
+    std::vector<texture_host> hosts;
+    std::mutex pending_mutex;
+    std::vector<texture_host> pending;
+};
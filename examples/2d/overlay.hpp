@@ -0,0 +1,367 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "contour.hpp"
+
+// Vector annotations drawn over the image. Coordinates are image pixels: x in [0,width),
+// y in [0,height), pixel (i,j) covers [i,i+1)x[j,j+1) and row j is row j of the uploaded data.
+// Colors are RGBA8 packed as 0xAABBGGRR, see rgba().
+
+inline uint32_t rgba(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255)
+{
+    return uint32_t(r) | uint32_t(g) << 8 | uint32_t(b) << 16 | uint32_t(a) << 24;
+}
+
+// GPU instance layouts, one instance per marker / box / polyline segment
+struct overlay_marker
+{
+    float x, y;
+    float size;  // diameter in screen pixels
+    uint32_t color;
+};
+struct overlay_line
+{
+    float x0, y0, x1, y1;
+    uint32_t color;
+};
+enum class overlay_kind : uint8_t { marker, box, segment };
+constexpr int overlay_kinds = 3;
+
+using overlay_id = int;
+
+struct overlay_hit
+{
+    overlay_id id = -1;
+    float distance = 0;  // image pixels, 0 inside a box
+};
+
+// Uniform hash grid over image space. Items whose bounds cover too many cells go to
+// a short list that every query scans.
+struct spatial_grid
+{
+    explicit spatial_grid(float cell = 32.0f) : cell(cell) {}
+    void insert(int id, float x0, float y0, float x1, float y1)
+    {
+        if(too_large(x0, y0, x1, y1)){ large.push_back(id); return; }
+        for_cells(x0, y0, x1, y1, [&](int64_t k){ cells[k].push_back(id); });
+    }
+    void erase(int id, float x0, float y0, float x1, float y1)
+    {
+        auto drop = [id](std::vector<int>& v){ v.erase(std::remove(v.begin(), v.end(), id), v.end()); };
+        if(too_large(x0, y0, x1, y1)){ drop(large); return; }
+        for_cells(x0, y0, x1, y1, [&](int64_t k){
+            auto it = cells.find(k);
+            if(it == cells.end()) return;
+            drop(it->second);
+            if(it->second.empty()) cells.erase(it);
+        });
+    }
+    // visit the ids registered in cells overlapping the rectangle (may repeat)
+    template<class F> void query(float x0, float y0, float x1, float y1, F&& f) const
+    {
+        for(int id : large) f(id);
+        for_cells(x0, y0, x1, y1, [&](int64_t k){
+            auto it = cells.find(k);
+            if(it != cells.end()) for(int id : it->second) f(id);
+        });
+    }
+    void clear()
+    {
+        cells.clear();
+        large.clear();
+    }
+private:
+    static constexpr int64_t max_cells = 4096;
+    int32_t cell_of(float v) const
+    {
+        return int32_t(std::floor(v / cell));
+    }
+    bool too_large(float x0, float y0, float x1, float y1) const
+    {
+        return int64_t(cell_of(x1) - cell_of(x0) + 1) * (cell_of(y1) - cell_of(y0) + 1) > max_cells;
+    }
+    template<class F> void for_cells(float x0, float y0, float x1, float y1, F&& f) const
+    {
+        const int32_t cx1 = cell_of(x1), cy1 = cell_of(y1);
+        for(int32_t cy = cell_of(y0); cy <= cy1; ++cy)
+            for(int32_t cx = cell_of(x0); cx <= cx1; ++cx)
+                f(int64_t(cy) << 32 | uint32_t(cx));
+    }
+    float cell;
+    std::unordered_map<int64_t, std::vector<int>> cells;
+    std::vector<int> large;
+};
+
+// Annotations of one 2D window. Edits may come from any thread; the render thread
+// calls flush() once per frame and uploads only the instance ranges that changed.
+// Removed annotations keep their slots (alpha 0) until clear().
+struct overlay_layer
+{
+    // instances are tracked dirty in chunks of this size
+    static constexpr size_t chunk = 1024;
+
+    overlay_id add_marker(float x, float y, float size_px, uint32_t color)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        const overlay_id id = new_entry(overlay_kind::marker, markers.size(), 1, x, y, x, y);
+        markers.push_back({x, y, size_px, color});
+        max_marker = std::max(max_marker, size_px);
+        mark(overlay_kind::marker, markers.size() - 1, 1);
+        return id;
+    }
+    overlay_id add_box(float x0, float y0, float x1, float y1, uint32_t color)
+    {
+        if(x1 < x0) std::swap(x0, x1);
+        if(y1 < y0) std::swap(y0, y1);
+        std::lock_guard<std::mutex> lock(m);
+        const overlay_id id = new_entry(overlay_kind::box, boxes.size(), 1, x0, y0, x1, y1);
+        boxes.push_back({x0, y0, x1, y1, color});
+        mark(overlay_kind::box, boxes.size() - 1, 1);
+        return id;
+    }
+    // xy holds n points, interleaved
+    overlay_id add_polyline(const float* xy, int n, uint32_t color, bool closed = false)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        if(n < 2) return -1;
+        const int count = closed ? n : n - 1;
+        const overlay_id id = int(entries.size());
+        entries.push_back({overlay_kind::segment, segments.size(), size_t(count), true});
+        for(int i = 0; i < count; ++i){
+            const float* a = xy + 2 * i;
+            const float* b = xy + 2 * ((i + 1) % n);
+            segments.push_back({a[0], a[1], b[0], b[1], color});
+            grid.insert(id, std::min(a[0], b[0]), std::min(a[1], b[1]), std::max(a[0], b[0]), std::max(a[1], b[1]));
+        }
+        mark(overlay_kind::segment, segments.size() - count, count);
+        return id;
+    }
+    void move_marker(overlay_id id, float x, float y)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        if(!alive(id, overlay_kind::marker)) return;
+        overlay_marker& k = markers[entries[id].first];
+        grid.erase(id, k.x, k.y, k.x, k.y);
+        k.x = x;
+        k.y = y;
+        grid.insert(id, x, y, x, y);
+        mark(overlay_kind::marker, entries[id].first, 1);
+    }
+    void set_color(overlay_id id, uint32_t color)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        if(!alive(id)) return;
+        const entry& e = entries[id];
+        for(size_t i = e.first; i < e.first + e.count; ++i){
+            if(e.kind == overlay_kind::marker) markers[i].color = color;
+            else line_list(e.kind)[i].color = color;
+        }
+        mark(e.kind, e.first, e.count);
+    }
+    void remove(overlay_id id)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        if(!alive(id)) return;
+        entry& e = entries[id];
+        for(size_t i = e.first; i < e.first + e.count; ++i){
+            if(e.kind == overlay_kind::marker){
+                const overlay_marker& k = markers[i];
+                grid.erase(id, k.x, k.y, k.x, k.y);
+                markers[i].color = 0;
+            }
+            else{
+                overlay_line& l = line_list(e.kind)[i];
+                grid.erase(id, std::min(l.x0, l.x1), std::min(l.y0, l.y1), std::max(l.x0, l.x1), std::max(l.y0, l.y1));
+                l.color = 0;
+            }
+        }
+        e.alive = false;
+        mark(e.kind, e.first, e.count);
+    }
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(m);
+        markers.clear();
+        boxes.clear();
+        segments.clear();
+        entries.clear();
+        grid.clear();
+        max_marker = 0;
+        for(auto& d : dirty) d.clear();
+        ++generation;
+    }
+    // Nearest annotation within radius_px of image point (x,y); px is the size of one screen
+    // pixel in image pixels. Boxes count as filled, ties go to the nearest outline.
+    overlay_hit pick(float x, float y, float radius_px, float px) const
+    {
+        std::lock_guard<std::mutex> lock(m);
+        const float r = (radius_px + max_marker * 0.5f) * px;
+        overlay_hit best;
+        float best_edge = 0;
+        if(++stamp == 0){ std::fill(seen.begin(), seen.end(), 0u); stamp = 1; }
+        seen.resize(entries.size(), 0u);
+        grid.query(x - r, y - r, x + r, y + r, [&](int id){
+            if(seen[id] == stamp) return;
+            seen[id] = stamp;
+            float d, edge;
+            distance(id, x, y, px, d, edge);
+            if(d > radius_px * px) return;
+            if(best.id < 0 || d < best.distance || (d == best.distance && edge < best_edge)){
+                best.id = id;
+                best.distance = d;
+                best_edge = edge;
+            }
+        });
+        return best;
+    }
+    // kind and instance range [first, first+count) of an annotation, for highlighting
+    bool instances(overlay_id id, overlay_kind& kind, int& first, int& count) const
+    {
+        std::lock_guard<std::mutex> lock(m);
+        if(!alive(id)) return false;
+        kind = entries[id].kind;
+        first = int(entries[id].first);
+        count = int(entries[id].count);
+        return true;
+    }
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(m);
+        return entries.size();
+    }
+
+    // Render thread. f(kind, data, stride, count, runs, generation) is called for every kind
+    // under the lock; runs are [first,count) instance ranges to upload. generation changes
+    // when the buffers were cleared and must be uploaded again from scratch.
+    template<class F> void flush(F&& f)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        for(int k = 0; k < overlay_kinds; ++k){
+            const overlay_kind kind = overlay_kind(k);
+            const void* data = kind == overlay_kind::marker ? (const void*)markers.data() : line_list(kind).data();
+            const size_t count = kind == overlay_kind::marker ? markers.size() : line_list(kind).size();
+            const size_t stride = kind == overlay_kind::marker ? sizeof(overlay_marker) : sizeof(overlay_line);
+            runs.clear();
+            std::vector<uint8_t>& d = dirty[k];
+            for(size_t c = 0; c < d.size(); ++c){
+                if(!d[c]) continue;
+                size_t e = c;
+                while(e < d.size() && d[e]) ++e;
+                const size_t first = c * chunk;
+                runs.emplace_back(first, std::min(count, e * chunk) - first);
+                c = e;
+            }
+            f(kind, data, stride, count, runs, generation);
+            std::fill(d.begin(), d.end(), uint8_t(0));
+        }
+    }
+
+private:
+    struct entry
+    {
+        overlay_kind kind;
+        size_t first;
+        size_t count;
+        bool alive;
+    };
+    overlay_id new_entry(overlay_kind kind, size_t first, size_t count, float x0, float y0, float x1, float y1)
+    {
+        const overlay_id id = int(entries.size());
+        entries.push_back({kind, first, count, true});
+        grid.insert(id, x0, y0, x1, y1);
+        return id;
+    }
+    bool alive(overlay_id id) const
+    {
+        return id >= 0 && id < int(entries.size()) && entries[id].alive;
+    }
+    bool alive(overlay_id id, overlay_kind kind) const
+    {
+        return alive(id) && entries[id].kind == kind;
+    }
+    std::vector<overlay_line>& line_list(overlay_kind kind)
+    {
+        return kind == overlay_kind::box ? boxes : segments;
+    }
+    const std::vector<overlay_line>& line_list(overlay_kind kind) const
+    {
+        return kind == overlay_kind::box ? boxes : segments;
+    }
+    void mark(overlay_kind kind, size_t first, size_t count)
+    {
+        std::vector<uint8_t>& d = dirty[int(kind)];
+        const size_t last = (first + count + chunk - 1) / chunk;
+        if(d.size() < last) d.resize(last, 0);
+        for(size_t c = first / chunk; c < last; ++c) d[c] = 1;
+    }
+    static float to_segment(float x, float y, const overlay_line& l)
+    {
+        const float dx = l.x1 - l.x0, dy = l.y1 - l.y0;
+        const float len2 = dx * dx + dy * dy;
+        float t = len2 > 0 ? ((x - l.x0) * dx + (y - l.y0) * dy) / len2 : 0.0f;
+        t = std::min(1.0f, std::max(0.0f, t));
+        return std::hypot(x - l.x0 - t * dx, y - l.y0 - t * dy);
+    }
+    // d: distance used for ranking, edge: distance to the drawn outline
+    void distance(overlay_id id, float x, float y, float px, float& d, float& edge) const
+    {
+        const entry& e = entries[id];
+        if(e.kind == overlay_kind::marker){
+            const overlay_marker& k = markers[e.first];
+            d = edge = std::max(0.0f, std::hypot(x - k.x, y - k.y) - k.size * 0.5f * px);
+        }
+        else if(e.kind == overlay_kind::box){
+            const overlay_line& b = boxes[e.first];
+            const float ox = std::max({b.x0 - x, 0.0f, x - b.x1});
+            const float oy = std::max({b.y0 - y, 0.0f, y - b.y1});
+            d = std::hypot(ox, oy);
+            edge = d > 0 ? d : std::min({x - b.x0, b.x1 - x, y - b.y0, b.y1 - y});
+        }
+        else{
+            d = std::numeric_limits<float>::max();
+            for(size_t i = e.first; i < e.first + e.count; ++i) d = std::min(d, to_segment(x, y, segments[i]));
+            edge = d;
+        }
+    }
+
+    mutable std::mutex m;
+    std::vector<overlay_marker> markers;
+    std::vector<overlay_line> boxes;
+    std::vector<overlay_line> segments;
+    std::vector<entry> entries;
+    std::vector<uint8_t> dirty[overlay_kinds];
+    std::vector<std::pair<size_t, size_t>> runs;
+    spatial_grid grid;
+    float max_marker = 0;
+    uint32_t generation = 0;
+    mutable std::vector<uint32_t> seen;
+    mutable uint32_t stamp = 0;
+};
+
+// Overlay of one window plus its pointer state. The window maps cursor positions to image
+// pixels and calls pointer() from the event thread; the render thread reads `hovered`.
+struct overlay_state
+{
+    overlay_layer layer;
+    contour_engine contours;  // drawn below the annotations
+    std::atomic<int> hovered{-1};
+    std::atomic<int> image_w{0}, image_h{0};  // size of the displayed texture, set by the render thread
+    float pick_radius_px = 6.0f;
+    std::function<void(overlay_id, bool click)> on_pick;  // set before async_loop()
+
+    // (x,y) in image pixels, px = image pixels per screen pixel
+    void pointer(float x, float y, float px, bool click)
+    {
+        const overlay_hit hit = layer.pick(x, y, pick_radius_px, px);
+        const int before = hovered.exchange(hit.id);
+        if(on_pick && (click || before != hit.id)) on_pick(hit.id, click);
+    }
+};
@@ -0,0 +1,392 @@
+#pragma once
+#ifdef __APPLE__
+#   include <OpenGL/gl3.h>
+#else
+#   include <GL/glew.h>
+#endif
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include "overlay.hpp"
+#include "../instrumentation.h"
+#include "../resource_manager.h"
+
+// ---------- overlay shaders (GL 3.3) ----------
+// image pixel -> NDC with the same zoom/pan mapping as the image quad of the v33 window
+static const char* overlayHeader = R"(#version 330 core
+uniform float uZoom;
+uniform vec2  uPan;
+uniform vec2  uImage;     // image size in pixels
+uniform vec2  uViewport;  // framebuffer size in pixels
+uniform ivec2 uHighlight; // instance range drawn highlighted
+vec2 to_ndc(vec2 p) {
+    return ((p / uImage - vec2(0.5) - uPan) * uZoom + vec2(0.5)) * 2.0 - 1.0;
+}
+vec4 shade(vec4 c) {
+    bool hl = gl_InstanceID >= uHighlight.x && gl_InstanceID < uHighlight.x + uHighlight.y;
+    return hl && c.a > 0.0 ? vec4(1.0, 1.0, 0.2, 1.0) : c;
+}
+)";
+
+static const char* overlayMarkerVS = R"(
+layout(location = 0) in vec2 aPos;
+layout(location = 1) in float aSize;
+layout(location = 2) in vec4 aColor;
+out vec4 vColor;
+out vec2 vLocal;
+const vec2 corners[4] = vec2[](vec2(-1,-1), vec2(1,-1), vec2(-1,1), vec2(1,1));
+void main() {
+    vLocal = corners[gl_VertexID];
+    vColor = shade(aColor);
+    gl_Position = vec4(to_ndc(aPos) + vLocal * aSize / uViewport, 0.0, 1.0);
+}
+)";
+
+static const char* overlayMarkerFS = R"(
+#version 330 core
+in vec4 vColor;
+in vec2 vLocal;
+out vec4 FragColor;
+void main() {
+    if(vColor.a == 0.0 || dot(vLocal, vLocal) > 1.0) discard;
+    FragColor = vColor;
+}
+)";
+
+// boxes: GL_LINE_LOOP over 4 corners, segments: GL_LINES over 2 end points
+static const char* overlayLineVS = R"(
+layout(location = 0) in vec4 aLine;
+layout(location = 2) in vec4 aColor;
+uniform int uBox;
+out vec4 vColor;
+void main() {
+    vec2 p;
+    if(uBox != 0) {
+        int i = gl_VertexID;
+        p = vec2(i == 1 || i == 2 ? aLine.z : aLine.x, i >= 2 ? aLine.w : aLine.y);
+    } else {
+        p = gl_VertexID == 0 ? aLine.xy : aLine.zw;
+    }
+    vColor = shade(aColor);
+    gl_Position = vec4(to_ndc(p), 0.0, 1.0);
+}
+)";
+
+// contour polylines: plain vertices, one GL_LINE_STRIP per polyline
+static const char* overlayContourVS = R"(
+layout(location = 0) in vec2 aPos;
+uniform vec4 uColor;
+out vec4 vColor;
+void main() {
+    vColor = uColor;
+    gl_Position = vec4(to_ndc(aPos), 0.0, 1.0);
+}
+)";
+
+static const char* overlayLineFS = R"(
+#version 330 core
+in vec4 vColor;
+out vec4 FragColor;
+void main() {
+    if(vColor.a == 0.0) discard;
+    FragColor = vColor;
+}
+)";
+
+// Instanced renderer of an overlay_layer: one instance buffer per primitive kind,
+// three draw calls per frame. Buffers grow by doubling; otherwise only dirty
+// ranges are re-uploaded. Call everything with the context current.
+struct overlay_renderer
+{
+    // compile is the window's shader helper, e.g. compileShader of the v33 window
+    template<class Compile> void init(resource_manager& rm, const void* owner, Compile&& compile)
+    {
+        this->rm = &rm;
+        this->owner = owner;
+        // vertex shaders share the mapping header
+        const std::string marker_vs = std::string(overlayHeader) + overlayMarkerVS;
+        const std::string line_vs = std::string(overlayHeader) + overlayLineVS;
+        const std::string contour_vs = std::string(overlayHeader) + overlayContourVS;
+        marker_program = link(compile(GL_VERTEX_SHADER, marker_vs.c_str()), compile(GL_FRAGMENT_SHADER, overlayMarkerFS));
+        line_program = link(compile(GL_VERTEX_SHADER, line_vs.c_str()), compile(GL_FRAGMENT_SHADER, overlayLineFS));
+        contour_program = link(compile(GL_VERTEX_SHADER, contour_vs.c_str()), compile(GL_FRAGMENT_SHADER, overlayLineFS));
+        glGenVertexArrays(1, &contour_vao);
+        glGenBuffers(1, &contour_vbo);
+        glBindVertexArray(contour_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, contour_vbo);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glGenVertexArrays(overlay_kinds, vao);
+        glGenBuffers(overlay_kinds, vbo);
+        for(int k = 0; k < overlay_kinds; ++k){
+            glBindVertexArray(vao[k]);
+            glBindBuffer(GL_ARRAY_BUFFER, vbo[k]);
+            if(overlay_kind(k) == overlay_kind::marker){
+                constexpr GLsizei stride = sizeof(overlay_marker);
+                glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(overlay_marker, x));
+                glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(overlay_marker, size));
+                glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)offsetof(overlay_marker, color));
+                glEnableVertexAttribArray(1);
+                glVertexAttribDivisor(1, 1);
+            }
+            else{
+                constexpr GLsizei stride = sizeof(overlay_line);
+                glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(overlay_line, x0));
+                glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)offsetof(overlay_line, color));
+            }
+            glEnableVertexAttribArray(0);
+            glVertexAttribDivisor(0, 1);
+            glEnableVertexAttribArray(2);
+            glVertexAttribDivisor(2, 1);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    // upload what changed since the last frame; returns uploaded bytes
+    size_t upload(overlay_layer& layer)
+    {
+        size_t bytes = 0;
+        layer.flush([&](overlay_kind kind, const void* data, size_t stride, size_t count,
+                        const std::vector<std::pair<size_t, size_t>>& runs, uint32_t generation){
+            const int k = int(kind);
+            glBindBuffer(GL_ARRAY_BUFFER, vbo[k]);
+            if(count > capacity[k] || generation != uploaded_generation[k]){
+                uploaded_generation[k] = generation;
+                capacity[k] = std::max<size_t>(overlay_layer::chunk, count * 2);
+                glBufferData(GL_ARRAY_BUFFER, capacity[k] * stride, nullptr, GL_DYNAMIC_DRAW);
+                glBufferSubData(GL_ARRAY_BUFFER, 0, count * stride, data);
+                bytes += count * stride;
+                if(rid[k]) rm->untrack(rid[k]);
+                rid[k] = rm->track(owner, resource_kind::buffer, capacity[k] * stride, 0, false);
+            }
+            else{
+                for(const auto& [first, n] : runs){
+                    glBufferSubData(GL_ARRAY_BUFFER, first * stride, n * stride,
+                                    static_cast<const uint8_t*>(data) + first * stride);
+                    bytes += n * stride;
+                }
+            }
+            instances[k] = count;
+        });
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return bytes;
+    }
+    // hovered: annotation drawn highlighted, -1 for none
+    void draw(const overlay_layer& layer, overlay_id hovered, float zoom, float panX, float panY,
+              int image_w, int image_h, int width, int height)
+    {
+        if(0 == image_w || 0 == image_h) return;
+        overlay_kind hl_kind = overlay_kind::marker;
+        int hl_first = 0, hl_count = 0;
+        if(hovered >= 0 && !layer.instances(hovered, hl_kind, hl_first, hl_count)) hl_count = 0;
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        for(int k = 0; k < overlay_kinds; ++k){
+            if(0 == instances[k]) continue;
+            const overlay_kind kind = overlay_kind(k);
+            const GLuint p = kind == overlay_kind::marker ? marker_program : line_program;
+            glUseProgram(p);
+            glUniform1f(glGetUniformLocation(p, "uZoom"), zoom);
+            glUniform2f(glGetUniformLocation(p, "uPan"), panX, panY);
+            glUniform2f(glGetUniformLocation(p, "uImage"), float(image_w), float(image_h));
+            glUniform2f(glGetUniformLocation(p, "uViewport"), float(width), float(height));
+            if(hl_kind == kind) glUniform2i(glGetUniformLocation(p, "uHighlight"), hl_first, hl_count);
+            else glUniform2i(glGetUniformLocation(p, "uHighlight"), 0, 0);
+            glBindVertexArray(vao[k]);
+            switch(kind){
+                case overlay_kind::marker:
+                    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GLsizei(instances[k]));
+                    break;
+                case overlay_kind::box:
+                    glUniform1i(glGetUniformLocation(p, "uBox"), 1);
+                    glDrawArraysInstanced(GL_LINE_LOOP, 0, 4, GLsizei(instances[k]));
+                    break;
+                case overlay_kind::segment:
+                    glUniform1i(glGetUniformLocation(p, "uBox"), 0);
+                    glDrawArraysInstanced(GL_LINES, 0, 2, GLsizei(instances[k]));
+                    break;
+            }
+        }
+        glBindVertexArray(0);
+        glUseProgram(0);
+        glDisable(GL_BLEND);
+    }
+    // Re-upload the contour vertices when a level got new lines; a color change alone
+    // only updates the draw list. Returns uploaded bytes.
+    size_t upload(const contour_snapshot& snap)
+    {
+        if(snap == contour_snap) return 0;
+        contour_snap = snap;
+        bool same = snap->size() == contour_lines_seen.size();
+        for(size_t i = 0; same && i < snap->size(); ++i) same = (*snap)[i].lines == contour_lines_seen[i];
+        if(same) return 0;
+        contour_lines_seen.clear();
+        contour_first.clear();
+        contour_count.clear();
+        std::vector<float> xy;
+        for(const auto& l : *snap){
+            contour_lines_seen.push_back(l.lines);
+            const GLint base = GLint(xy.size() / 2);
+            for(size_t k = 0; k < l.lines->polylines(); ++k){
+                contour_first.push_back(base + GLint(l.lines->starts[k]));
+                contour_count.push_back(GLsizei(l.lines->starts[k + 1] - l.lines->starts[k]));
+            }
+            xy.insert(xy.end(), l.lines->xy.begin(), l.lines->xy.end());
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, contour_vbo);
+        glBufferData(GL_ARRAY_BUFFER, xy.size() * sizeof(float), xy.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        if(contour_rid) rm->untrack(contour_rid);
+        contour_rid = rm->track(owner, resource_kind::buffer, xy.size() * sizeof(float), 0, false);
+        return xy.size() * sizeof(float);
+    }
+    // one glMultiDrawArrays per level
+    void draw_contours(float zoom, float panX, float panY, int image_w, int image_h, int width, int height)
+    {
+        if(!contour_snap || 0 == image_w || 0 == image_h) return;
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glUseProgram(contour_program);
+        glUniform1f(glGetUniformLocation(contour_program, "uZoom"), zoom);
+        glUniform2f(glGetUniformLocation(contour_program, "uPan"), panX, panY);
+        glUniform2f(glGetUniformLocation(contour_program, "uImage"), float(image_w), float(image_h));
+        glUniform2f(glGetUniformLocation(contour_program, "uViewport"), float(width), float(height));
+        glUniform2i(glGetUniformLocation(contour_program, "uHighlight"), 0, 0);
+        const GLint locColor = glGetUniformLocation(contour_program, "uColor");
+        glBindVertexArray(contour_vao);
+        size_t first = 0;
+        for(const auto& l : *contour_snap){
+            const size_t n = l.lines->polylines();
+            const uint32_t c = l.color;
+            glUniform4f(locColor, (c & 255) / 255.0f, (c >> 8 & 255) / 255.0f, (c >> 16 & 255) / 255.0f, (c >> 24) / 255.0f);
+            if(n) glMultiDrawArrays(GL_LINE_STRIP, contour_first.data() + first, contour_count.data() + first, GLsizei(n));
+            first += n;
+        }
+        glBindVertexArray(0);
+        glUseProgram(0);
+        glDisable(GL_BLEND);
+    }
+    void release()
+    {
+        if(0 == marker_program) return;
+        glDeleteBuffers(overlay_kinds, vbo);
+        glDeleteVertexArrays(overlay_kinds, vao);
+        glDeleteBuffers(1, &contour_vbo);
+        glDeleteVertexArrays(1, &contour_vao);
+        glDeleteProgram(marker_program);
+        glDeleteProgram(line_program);
+        glDeleteProgram(contour_program);
+        marker_program = line_program = contour_program = 0;
+        for(auto& r : rid){
+            if(r) rm->untrack(r);
+            r = 0;
+        }
+        if(contour_rid) rm->untrack(contour_rid);
+        contour_rid = 0;
+        contour_snap.reset();
+        contour_lines_seen.clear();
+    }
+private:
+    static GLuint link(GLuint vs, GLuint fs)
+    {
+        GLuint p = glCreateProgram();
+        glAttachShader(p, vs);
+        glAttachShader(p, fs);
+        glLinkProgram(p);
+        GLint ok=0; glGetProgramiv(p, GL_LINK_STATUS, &ok);
+        if(!ok){
+            char buf[1024]; glGetProgramInfoLog(p, 1024, nullptr, buf);
+            std::cerr<<"Overlay program link error: "<<buf<<"\n";
+        }
+        glDeleteShader(vs);
+        glDeleteShader(fs);
+        return p;
+    }
+    resource_manager* rm = nullptr;
+    const void* owner = nullptr;
+    GLuint marker_program = 0, line_program = 0;
+    GLuint vao[overlay_kinds] = {};
+    GLuint vbo[overlay_kinds] = {};
+    size_t capacity[overlay_kinds] = {};
+    size_t instances[overlay_kinds] = {};
+    uint32_t uploaded_generation[overlay_kinds] = {};
+    resource_id rid[overlay_kinds] = {};
+    GLuint contour_program = 0, contour_vao = 0, contour_vbo = 0;
+    resource_id contour_rid = 0;
+    contour_snapshot contour_snap;
+    std::vector<std::shared_ptr<const contour_lines>> contour_lines_seen;
+    std::vector<GLint> contour_first;
+    std::vector<GLsizei> contour_count;
+};
+
+// GL 2.1 fallback: the whole layer in immediate mode, in the v21 window's world space
+// where the image spans [-1,1]^2. world_px is the size of one screen pixel in world units.
+static void draw_overlay_fixed(overlay_layer& layer, overlay_id hovered, int image_w, int image_h, float world_px)
+{
+    if(0 == image_w || 0 == image_h) return;
+    const float sx = 2.0f / image_w, sy = 2.0f / image_h;
+    overlay_kind hl_kind = overlay_kind::marker;
+    int hl_first = 0, hl_count = 0;
+    if(hovered < 0 || !layer.instances(hovered, hl_kind, hl_first, hl_count)) hl_count = 0;
+    auto color = [&](overlay_kind kind, size_t i, uint32_t c){
+        if(kind == hl_kind && int(i) >= hl_first && int(i) < hl_first + hl_count) c = rgba(255, 255, 51);
+        glColor4ub(GLubyte(c), GLubyte(c >> 8), GLubyte(c >> 16), GLubyte(c >> 24));
+    };
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    layer.flush([&](overlay_kind kind, const void* data, size_t, size_t count,
+                    const std::vector<std::pair<size_t, size_t>>&, uint32_t){
+        if(kind == overlay_kind::marker){
+            const overlay_marker* m = static_cast<const overlay_marker*>(data);
+            glBegin(GL_QUADS);
+            for(size_t i = 0; i < count; ++i){
+                if(0 == (m[i].color >> 24)) continue;
+                const float x = m[i].x * sx - 1, y = m[i].y * sy - 1, r = m[i].size * 0.5f * world_px;
+                color(kind, i, m[i].color);
+                glVertex2f(x - r, y - r); glVertex2f(x + r, y - r);
+                glVertex2f(x + r, y + r); glVertex2f(x - r, y + r);
+            }
+            glEnd();
+            return;
+        }
+        const overlay_line* l = static_cast<const overlay_line*>(data);
+        glBegin(GL_LINES);
+        for(size_t i = 0; i < count; ++i){
+            if(0 == (l[i].color >> 24)) continue;
+            color(kind, i, l[i].color);
+            const float x0 = l[i].x0 * sx - 1, y0 = l[i].y0 * sy - 1, x1 = l[i].x1 * sx - 1, y1 = l[i].y1 * sy - 1;
+            if(kind == overlay_kind::segment){
+                glVertex2f(x0, y0); glVertex2f(x1, y1);
+                continue;
+            }
+            glVertex2f(x0, y0); glVertex2f(x1, y0);
+            glVertex2f(x1, y0); glVertex2f(x1, y1);
+            glVertex2f(x1, y1); glVertex2f(x0, y1);
+            glVertex2f(x0, y1); glVertex2f(x0, y0);
+        }
+        glEnd();
+    });
+    glDisable(GL_BLEND);
+    glColor4f(1, 1, 1, 1);
+}
+
+// GL 2.1 fallback for the contour lines, same world space as draw_overlay_fixed()
+static void draw_contours_fixed(const contour_snapshot& snap, int image_w, int image_h)
+{
+    if(!snap || 0 == image_w || 0 == image_h) return;
+    const float sx = 2.0f / image_w, sy = 2.0f / image_h;
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    for(const auto& l : *snap){
+        const uint32_t c = l.color;
+        glColor4ub(GLubyte(c), GLubyte(c >> 8), GLubyte(c >> 16), GLubyte(c >> 24));
+        const contour_lines& ln = *l.lines;
+        for(size_t k = 0; k < ln.polylines(); ++k){
+            glBegin(GL_LINE_STRIP);
+            for(uint32_t p = ln.starts[k]; p < ln.starts[k + 1]; ++p) glVertex2f(ln.xy[p * 2] * sx - 1, ln.xy[p * 2 + 1] * sy - 1);
+            glEnd();
+        }
+    }
+    glDisable(GL_BLEND);
+    glColor4f(1, 1, 1, 1);
+}
@@ -0,0 +1,250 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "fft2d.hpp"
+#include "texture_format.hpp"
+#include "colormaps.hpp"
+
+enum class spectrum_mode : int
+{
+    log_magnitude,  // log(1 + |F|), DC excluded from the normalisation
+    phase,          // arg F over [-pi, pi]
+};
+
+// 2D FFT view of a scalar field or a rectangle of it, centred (fftshift) and colour mapped
+// into an RGB8 texture_image of the padded transform size. Edits compute on the calling
+// thread and publish a new snapshot; moving the ROI vertically only transforms the rows
+// that entered it, a mode or colormap change skips the transform altogether.
+// The ROI is clipped to max_size per axis and zero padded to a power of two.
+struct spectrum_engine
+{
+    static constexpr int max_size = 4096;
+
+    void set_field(const float* data, int w, int h)
+    {
+        std::lock_guard<std::mutex> lock(edit);
+        auto t0 = std::chrono::steady_clock::now();
+        W = w;
+        H = h;
+        field.assign(data, data + size_t(w) * h);
+        rows_n = 0;
+        transform();
+        publish(t0);
+    }
+    // w or h <= 0 selects the whole field
+    void set_roi(int x, int y, int w, int h)
+    {
+        std::lock_guard<std::mutex> lock(edit);
+        auto t0 = std::chrono::steady_clock::now();
+        roi[0] = x; roi[1] = y; roi[2] = w; roi[3] = h;
+        transform();
+        publish(t0);
+    }
+    void set_mode(spectrum_mode m)
+    {
+        std::lock_guard<std::mutex> lock(edit);
+        auto t0 = std::chrono::steady_clock::now();
+        view = m;
+        values();
+        publish(t0);
+    }
+    void toggle_mode()
+    {
+        set_mode(mode() == spectrum_mode::phase ? spectrum_mode::log_magnitude : spectrum_mode::phase);
+    }
+    void set_colormap(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock(edit);
+        auto t0 = std::chrono::steady_clock::now();
+        colormap = name;
+        colors();
+        publish(t0);
+    }
+    // Hann taper against the leakage of the ROI edges, on by default
+    void set_window(bool hann)
+    {
+        std::lock_guard<std::mutex> lock(edit);
+        auto t0 = std::chrono::steady_clock::now();
+        taper = hann;
+        rows_n = 0;
+        transform();
+        publish(t0);
+    }
+    spectrum_mode mode() const
+    {
+        std::lock_guard<std::mutex> lock(edit);
+        return view;
+    }
+    // shown instead of the image; F toggles it
+    void show(bool on = true)
+    {
+        shown = on;
+    }
+    void toggle()
+    {
+        shown = !shown;
+    }
+    // last edit, transform included
+    double last_ms() const
+    {
+        return ms;
+    }
+    // rgb8 spectrum, nullptr before the first set_field
+    std::shared_ptr<const texture_image> snapshot() const
+    {
+        std::lock_guard<std::mutex> lock(m);
+        return published;
+    }
+    std::atomic<bool> shown{false};
+
+private:
+    void transform()
+    {
+        if(field.empty()) return;
+        const int x0 = std::clamp(roi[0], 0, W - 1), y0 = std::clamp(roi[1], 0, H - 1);
+        const int rw = std::min(max_size, roi[2] > 0 && roi[3] > 0 ? std::min(roi[2], W - x0) : W - x0);
+        const int rh = std::min(max_size, roi[2] > 0 && roi[3] > 0 ? std::min(roi[3], H - y0) : H - y0);
+        const int nx = fft_size_for(rw), ny = fft_size_for(rh);
+        px.init(nx);
+        py.init(ny);
+        if(rw != int(wx.size())) wx = hann(rw);
+        if(rh != int(wy.size())) wy = hann(rh);
+
+        // row spectra [rh][nx]: keep the rows the old ROI shares with the new one
+        const size_t row = size_t(nx);
+        int keep0 = 0, keep1 = 0;
+        if(rows_n && x0 == rows_x && rw == rows_w && nx == rows_nx){
+            keep0 = std::max(y0, rows_y);
+            keep1 = std::min(y0 + rh, rows_y + rows_n);
+        }
+        std::vector<float> re(row * rh), im(row * rh);
+        if(keep0 < keep1){
+            std::copy_n(rows_re.begin() + (keep0 - rows_y) * row, (keep1 - keep0) * row, re.begin() + (keep0 - y0) * row);
+            std::copy_n(rows_im.begin() + (keep0 - rows_y) * row, (keep1 - keep0) * row, im.begin() + (keep0 - y0) * row);
+        }
+        else keep0 = keep1 = y0;
+        const float* src = field.data() + size_t(x0);
+        const float* weight = taper ? wx.data() : nullptr;
+        auto rows = [&](int b, int e){
+            // b, e are ROI rows
+            parallel_for(b, e, [&](int rb, int re_){
+                fft2d_rows(px, src + size_t(y0) * W, size_t(W), rw, weight, rb, re_, &re[rb * row], &im[rb * row]);
+            }, 8);
+        };
+        rows(0, keep0 - y0);
+        rows(keep1 - y0, rh);
+        rows_re.swap(re);
+        rows_im.swap(im);
+        rows_x = x0; rows_y = y0; rows_w = rw; rows_n = rh; rows_nx = nx;
+
+        spec_re.resize(row * ny);
+        spec_im.resize(row * ny);
+        fft2d_columns(py, rows_re.data(), rows_im.data(), nx, rh, taper ? wy.data() : nullptr, spec_re.data(), spec_im.data());
+        values();
+    }
+    // spec -> value in [0, 1], transposed like spec: value[kx * ny + ky]
+    void values()
+    {
+        const int nx = px.n, ny = py.n;
+        const size_t n = size_t(nx) * ny;
+        if(spec_re.size() != n) return;
+        value.resize(n);
+        const int chunks = int((n + 65535) / 65536);
+        struct mm { float lo, hi; };
+        std::vector<mm> part(chunks, mm{1e30f, -1e30f});
+        const bool phase = view == spectrum_mode::phase;
+        parallel_for(0, chunks, [&](int b, int e){
+            for(int c = b; c < e; ++c){
+                const size_t i0 = size_t(c) * 65536, i1 = std::min(n, i0 + 65536);
+                float lo = 1e30f, hi = -1e30f;
+                for(size_t i = i0; i < i1; ++i){
+                    if(phase){
+                        value[i] = std::atan2(spec_im[i], spec_re[i]) * 0.15915494f + 0.5f;
+                        continue;
+                    }
+                    const float v = std::log1p(std::sqrt(spec_re[i] * spec_re[i] + spec_im[i] * spec_im[i]));
+                    value[i] = v;
+                    if(0 == i) continue;  // DC
+                    lo = std::min(lo, v);
+                    hi = std::max(hi, v);
+                }
+                part[c] = {lo, hi};
+            }
+        });
+        if(!phase){
+            float lo = 1e30f, hi = -1e30f;
+            for(const mm& p : part){ lo = std::min(lo, p.lo); hi = std::max(hi, p.hi); }
+            const float s = hi > lo ? 1.0f / (hi - lo) : 1.0f;
+            parallel_for(0, chunks, [&](int b, int e){
+                for(size_t i = size_t(b) * 65536; i < std::min(n, size_t(e) * 65536); ++i)
+                    value[i] = std::clamp((value[i] - lo) * s, 0.0f, 1.0f);
+            });
+        }
+        colors();
+    }
+    // value -> centred RGB8, in 32 x 32 blocks: the transpose reads value down its columns
+    void colors()
+    {
+        const int nx = px.n, ny = py.n;
+        if(value.size() != size_t(nx) * ny || 0 == value.size()) return;
+        const auto& lut = get_colormap_color(colormap);
+        auto img = std::make_shared<texture_image>();
+        img->width = nx;
+        img->height = ny;
+        img->bytes.resize(size_t(nx) * ny * 3);
+        img->value_scale = 255.0f;
+        img->display_hi = 255.0f;
+        uint8_t* dst = img->bytes.data();
+        constexpr int block = 32;
+        parallel_for(0, (ny + block - 1) / block, [&](int b, int e){
+            for(int by = b * block; by < std::min(ny, e * block); by += block)
+                for(int bx = 0; bx < nx; bx += block)
+                    for(int x = bx; x < std::min(nx, bx + block); ++x){
+                        const float* col = value.data() + size_t((x + nx / 2) & (nx - 1)) * ny;
+                        for(int y = by; y < std::min(ny, by + block); ++y){
+                            const float v = col[(y + ny / 2) & (ny - 1)];
+                            const auto& c = lut[int(v * 255.0f + 0.5f)];
+                            uint8_t* p = dst + (size_t(y) * nx + x) * 3;
+                            p[0] = c[0]; p[1] = c[1]; p[2] = c[2];
+                        }
+                    }
+        });
+        next = std::move(img);
+    }
+    static std::vector<float> hann(int n)
+    {
+        std::vector<float> w(n, 1.0f);
+        for(int i = 0; i < n && n > 1; ++i) w[i] = float(0.5 - 0.5 * std::cos(6.283185307179586 * i / (n - 1)));
+        return w;
+    }
+    void publish(std::chrono::steady_clock::time_point t0)
+    {
+        ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        std::lock_guard<std::mutex> lock(m);
+        if(next) published = std::move(next);
+    }
+
+    mutable std::mutex edit;
+    int W = 0, H = 0;
+    std::vector<float> field;
+    int roi[4] = {0, 0, 0, 0};
+    spectrum_mode view = spectrum_mode::log_magnitude;
+    std::string colormap = "viridis";
+    bool taper = true;
+    fft_plan px, py;
+    std::vector<float> wx, wy;
+    std::vector<float> rows_re, rows_im;        // row spectra of ROI rows [rows_y, rows_y + rows_n)
+    int rows_x = 0, rows_y = 0, rows_w = 0, rows_n = 0, rows_nx = 0;
+    std::vector<float> spec_re, spec_im, value;  // [nx][ny]
+    std::shared_ptr<texture_image> next;
+    std::atomic<double> ms{0};
+    mutable std::mutex m;
+    std::shared_ptr<const texture_image> published;
+};
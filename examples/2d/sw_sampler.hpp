@@ -0,0 +1,183 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64)
+#   include <immintrin.h>
+#   ifndef DISPLAY_TOOL_SSE2
+#       define DISPLAY_TOOL_SSE2 1
+#   endif
+#endif
+#include "layer_stack.hpp"
+#include "texture_format.hpp"
+
+// CPU copy of a texture for the software backend, RGBA8 packed little-endian
+// (r in the low byte). Row 0 is the bottom row, as in GL.
+struct sw_texture
+{
+    int width = 0;
+    int height = 0;
+    std::vector<uint32_t> texels;
+};
+
+inline float half_to_float(uint16_t h)
+{
+    const int e = (h >> 10) & 31, m = h & 1023;
+    const float v = e == 0 ? std::ldexp(float(m), -24)
+                  : e == 31 ? (m ? NAN : INFINITY)
+                  : std::ldexp(float(m | 1024), e - 25);
+    return (h & 0x8000) ? -v : v;
+}
+
+// Decode rgb8 and the uncompressed scalar formats; scalars are mapped to grey with the
+// same scale/offset the GL 3.3 shader uses. Block formats are not decoded.
+inline bool make_sw_texture(const texture_image& img, sw_texture& t)
+{
+    if(is_block_format(img.fmt)) return false;
+    t.width = img.width;
+    t.height = img.height;
+    const size_t n = size_t(img.width) * img.height;
+    t.texels.resize(n);
+    const uint8_t* s = img.bytes.data();
+    if(img.fmt == texture_format::rgb8){
+        for(size_t i = 0; i < n; ++i, s += 3)
+            t.texels[i] = uint32_t(s[0]) | uint32_t(s[1]) << 8 | uint32_t(s[2]) << 16 | 0xff000000u;
+        return true;
+    }
+    const float range = img.display_hi - img.display_lo;
+    const float scale = img.value_scale / range, offset = (img.value_offset - img.display_lo) / range;
+    for(size_t i = 0; i < n; ++i){
+        float v;
+        switch(img.fmt){
+            case texture_format::r8q:  v = s[i] / 255.0f; break;
+            case texture_format::r16q: v = reinterpret_cast<const uint16_t*>(s)[i] / 65535.0f; break;
+            default:                   v = half_to_float(reinterpret_cast<const uint16_t*>(s)[i]); break;
+        }
+        const uint32_t g = uint32_t(std::min(255.0f, std::max(0.0f, (v * scale + offset) * 255.0f + 0.5f)));
+        t.texels[i] = g | g << 8 | g << 16 | 0xff000000u;
+    }
+    return true;
+}
+
+// Bilinear blend of four RGBA8 texels, weights in 1/256.
+inline uint32_t bilerp_rgba8(uint32_t t00, uint32_t t10, uint32_t t01, uint32_t t11, int fx, int fy)
+{
+#ifdef DISPLAY_TOOL_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    // low 4 lanes: left texel, high 4 lanes: right texel
+    __m128i a = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, int(t10), int(t00)), zero);
+    __m128i b = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, int(t11), int(t01)), zero);
+    __m128i c = _mm_add_epi16(_mm_mullo_epi16(a, _mm_set1_epi16(short(256 - fy))),
+                              _mm_mullo_epi16(b, _mm_set1_epi16(short(fy))));
+    c = _mm_srli_epi16(c, 8);
+    const short wl = short(256 - fx), wr = short(fx);
+    c = _mm_mullo_epi16(c, _mm_set_epi16(wr, wr, wr, wr, wl, wl, wl, wl));
+    c = _mm_srli_epi16(_mm_add_epi16(c, _mm_srli_si128(c, 8)), 8);
+    return uint32_t(_mm_cvtsi128_si32(_mm_packus_epi16(c, zero)));
+#else
+    uint32_t out = 0;
+    for(int k = 0; k < 32; k += 8){
+        const int top = (int((t00 >> k) & 255) * (256 - fx) + int((t10 >> k) & 255) * fx) >> 8;
+        const int bot = (int((t01 >> k) & 255) * (256 - fx) + int((t11 >> k) & 255) * fx) >> 8;
+        out |= uint32_t((top * (256 - fy) + bot * fy) >> 8) << k;
+    }
+    return out;
+#endif
+}
+
+// Shade the framebuffer rectangle [x0,x1) x [y0,y1) with the v33 shader's mapping:
+//   uv = (pixel_uv - 0.5) / zoom + 0.5 + pan, GL_REPEAT wrap, GL_LINEAR filter.
+// fb is fbw x fbh, row 0 at the bottom.
+inline void sw_shade_rect(const sw_texture& tex, float zoom, float panX, float panY,
+                          uint32_t* fb, int fbw, int fbh, int x0, int y0, int x1, int y1)
+{
+    const int W = tex.width, H = tex.height;
+    const float fw = float(W), fh = float(H);
+    const float inv_zoom = 1.0f / zoom;
+    // texel-space position of pixel i: base + i * step (texel centres at +0.5)
+    const float sx = fw * inv_zoom / fbw;
+    const float bx = fw * ((0.5f / fbw - 0.5f) * inv_zoom + 0.5f + panX) - 0.5f;
+    const float sy = fh * inv_zoom / fbh;
+    const float by = fh * ((0.5f / fbh - 0.5f) * inv_zoom + 0.5f + panY) - 0.5f;
+    const float inv_w = 1.0f / fw;
+
+    // column coordinates do not depend on the row: wrap them once per rectangle
+    const int n = x1 - x0;
+    std::vector<int32_t> col(size_t(n) + 4), wx(size_t(n) + 4);
+    int x = 0;
+#ifdef DISPLAY_TOOL_SSE2
+    const __m128 vstep = _mm_set1_ps(sx), vw = _mm_set1_ps(fw), vinv = _mm_set1_ps(inv_w);
+    const __m128 vone = _mm_set1_ps(1.0f), v256 = _mm_set1_ps(256.0f);
+    const __m128i vmax = _mm_set1_epi32(W - 1);
+    for(; x + 4 <= n; x += 4){
+        const int p = x0 + x;
+        __m128 tx = _mm_add_ps(_mm_set1_ps(bx), _mm_mul_ps(vstep,
+                    _mm_cvtepi32_ps(_mm_setr_epi32(p, p + 1, p + 2, p + 3))));
+        // tx -= W * floor(tx / W)
+        __m128 q = _mm_mul_ps(tx, vinv);
+        __m128 fq = _mm_cvtepi32_ps(_mm_cvttps_epi32(q));
+        fq = _mm_sub_ps(fq, _mm_and_ps(_mm_cmpgt_ps(fq, q), vone));
+        tx = _mm_sub_ps(tx, _mm_mul_ps(vw, fq));
+        __m128i i = _mm_cvttps_epi32(tx);
+        // clamp rounding spill at W (SSE2 has no min_epi32)
+        const __m128i over = _mm_cmpgt_epi32(i, vmax);
+        i = _mm_or_si128(_mm_andnot_si128(over, i), _mm_and_si128(over, vmax));
+        __m128i f = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(tx, _mm_cvtepi32_ps(i)), v256));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(col.data() + x), i);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(wx.data() + x), f);
+    }
+#endif
+    for(; x < n; ++x){
+        float tx = bx + (x0 + x) * sx;
+        tx -= fw * std::floor(tx * inv_w);
+        col[x] = std::min(W - 1, int(tx));
+        wx[x] = int((tx - col[x]) * 256.0f);
+    }
+    for(int k = 0; k < n; ++k) wx[k] = std::min(256, std::max(0, wx[k]));
+
+    for(int y = y0; y < y1; ++y){
+        float ty = by + y * sy;
+        ty -= fh * std::floor(ty / fh);
+        const int iy = std::min(H - 1, int(ty));
+        const int fy = int((ty - iy) * 256.0f);
+        const uint32_t* r0 = tex.texels.data() + size_t(iy) * W;
+        const uint32_t* r1 = tex.texels.data() + size_t(iy + 1 == H ? 0 : iy + 1) * W;
+        uint32_t* out = fb + size_t(y) * fbw + x0;
+        for(int k = 0; k < n; ++k){
+            const int c0 = col[k], c1 = c0 + 1 == W ? 0 : c0 + 1;
+            out[k] = bilerp_rgba8(r0[c0], r0[c1], r1[c0], r1[c1], wx[k], fy);
+        }
+    }
+}
+
+// Blend the rectangle of a shaded layer (src) into dst, both fbw wide, with the layer's mode
+// (see blend_mode); opacity in 1/256. lut maps the red channel to a colour, nullptr keeps
+// src's colours. The first layer is blended over black.
+inline void sw_blend_rect(const uint32_t* src, uint32_t* dst, int fbw, int x0, int y0, int x1, int y1,
+                          const std::array<std::array<uint8_t, 3>, 256>* lut, int opacity, blend_mode mode, bool first)
+{
+    const int a = std::min(256, std::max(0, opacity));
+    for(int y = y0; y < y1; ++y){
+        const uint32_t* s = src + size_t(y) * fbw;
+        uint32_t* d = dst + size_t(y) * fbw;
+        for(int x = x0; x < x1; ++x){
+            int c[3] = {int(s[x] & 255), int((s[x] >> 8) & 255), int((s[x] >> 16) & 255)};
+            if(lut){
+                const auto& e = (*lut)[c[0]];
+                c[0] = e[0]; c[1] = e[1]; c[2] = e[2];
+            }
+            const uint32_t under = first ? 0u : d[x];
+            uint32_t out = 0xff000000u;
+            for(int k = 0; k < 3; ++k){
+                const int u = int((under >> (8 * k)) & 255), v = c[k] * a >> 8;
+                const int r = mode == blend_mode::alpha    ? (u * (256 - a) + c[k] * a) >> 8
+                            : mode == blend_mode::additive ? std::min(255, u + v)
+                            :                                std::max(u, v);
+                out |= uint32_t(r) << (8 * k);
+            }
+            d[x] = out;
+        }
+    }
+}
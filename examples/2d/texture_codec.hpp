@@ -0,0 +1,381 @@
+#pragma once
+#ifdef __APPLE__
+#   include <OpenGL/gl3.h>
+#else
+#   include <GL/glew.h>
+#endif
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64)
+#   include <immintrin.h>
+#   define DISPLAY_TOOL_SSE2 1
+#endif
+#include "../parallel_for.hpp"
+#include "texture_format.hpp"
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#   define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RED_RGTC1
+#   define GL_COMPRESSED_RED_RGTC1 0x8DBB
+#endif
+
+// Uploaded texture plus what the shader needs to display it.
+struct gpu_texture
+{
+    GLuint id = 0;
+    texture_format fmt = texture_format::rgb8;
+    int width = 0;
+    int height = 0;
+    size_t bytes = 0;
+    float scale = 1.0f;  // uScale
+    float offset = 0.0f; // uOffset
+    float value_scale = 1.0f;   // stored texel -> source value
+    float value_offset = 0.0f;
+    uint64_t rid = 0;    // resource_manager id
+};
+
+// ---------- scalar helpers ----------
+inline void minmax_of(const float* v, size_t n, float& lo, float& hi)
+{
+    struct mm { float lo, hi; };
+    const int rows = int((n + 65535) / 65536);
+    std::vector<mm> part(rows, mm{ 1e30f, -1e30f });
+    parallel_for(0, rows, [&](int b, int e){
+        for(int r = b; r < e; ++r){
+            size_t i = size_t(r) * 65536, end = std::min(n, i + 65536);
+            float l = part[r].lo, h = part[r].hi;
+#ifdef DISPLAY_TOOL_SSE2
+            __m128 vl = _mm_set1_ps(l), vh = _mm_set1_ps(h);
+            for(; i + 4 <= end; i += 4){
+                __m128 x = _mm_loadu_ps(v + i);
+                vl = _mm_min_ps(vl, x);
+                vh = _mm_max_ps(vh, x);
+            }
+            float tl[4], th[4];
+            _mm_storeu_ps(tl, vl); _mm_storeu_ps(th, vh);
+            for(int k = 0; k < 4; ++k){ l = std::min(l, tl[k]); h = std::max(h, th[k]); }
+#endif
+            for(; i < end; ++i){ l = std::min(l, v[i]); h = std::max(h, v[i]); }
+            part[r] = { l, h };
+        }
+    });
+    lo = 1e30f; hi = -1e30f;
+    for(auto& p : part){ lo = std::min(lo, p.lo); hi = std::max(hi, p.hi); }
+    if(n == 0){ lo = 0; hi = 1; }
+    if(hi <= lo) hi = lo + 1.0f;
+}
+
+inline uint16_t float_to_half(float f)
+{
+    uint32_t x; std::memcpy(&x, &f, 4);
+    const uint32_t sign = (x >> 16) & 0x8000u;
+    int32_t exp = int32_t((x >> 23) & 0xff) - 127 + 15;
+    uint32_t mant = x & 0x7fffffu;
+    if(((x >> 23) & 0xff) == 0xff) return uint16_t(sign | 0x7c00u | (mant ? 0x200u | (mant >> 13) : 0u));
+    if(exp >= 31) return uint16_t(sign | 0x7c00u);
+    if(exp <= 0){
+        if(exp < -10) return uint16_t(sign);
+        mant |= 0x800000u;
+        const uint32_t shift = uint32_t(14 - exp);
+        uint32_t h = mant >> shift;
+        const uint32_t rest = mant & ((1u << shift) - 1u), half = 1u << (shift - 1);
+        if(rest > half || (rest == half && (h & 1u))) ++h;
+        return uint16_t(sign | h);
+    }
+    uint32_t h = sign | (uint32_t(exp) << 10) | (mant >> 13);
+    // round half to even like _mm256_cvtps_ph; carries into the exponent correctly
+    const uint32_t rest = mant & 0x1fffu;
+    if(rest > 0x1000u || (rest == 0x1000u && (h & 1u))) ++h;
+    return uint16_t(h);
+}
+
+// ---------- encoders (multithreaded over rows / block rows) ----------
+inline void encode_half(const float* src, size_t n, uint16_t* dst)
+{
+    const int rows = int((n + 65535) / 65536);
+    parallel_for(0, rows, [&](int b, int e){
+        size_t i = size_t(b) * 65536, end = std::min(n, size_t(e) * 65536);
+#if defined(__F16C__)
+        for(; i + 8 <= end; i += 8){
+            __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+        }
+#endif
+        for(; i < end; ++i) dst[i] = float_to_half(src[i]);
+    });
+}
+
+// q = (v - lo) / (hi - lo) * qmax rounded to nearest, ties to even (as _mm_cvtps_epi32),
+// clamped to [0, qmax]; NaN gives 0.
+template<class Q>
+void quantize(const float* src, size_t n, Q* dst, float lo, float hi)
+{
+    constexpr float qmax = float(Q(~Q(0)));
+    const float s = qmax / (hi - lo);
+    const int rows = int((n + 65535) / 65536);
+    parallel_for(0, rows, [&](int b, int e){
+        size_t i = size_t(b) * 65536, end = std::min(n, size_t(e) * 65536);
+#ifdef DISPLAY_TOOL_SSE2
+        const __m128 vlo = _mm_set1_ps(lo), vs = _mm_set1_ps(s);
+        const __m128 vzero = _mm_setzero_ps(), vmax = _mm_set1_ps(qmax);
+        for(; i + 4 <= end; i += 4){
+            __m128 x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(src + i), vlo), vs);
+            x = _mm_min_ps(_mm_max_ps(x, vzero), vmax);
+            alignas(16) int32_t q[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(q), _mm_cvtps_epi32(x));
+            dst[i] = Q(q[0]); dst[i+1] = Q(q[1]); dst[i+2] = Q(q[2]); dst[i+3] = Q(q[3]);
+        }
+#endif
+        for(; i < end; ++i){
+            // operand order as _mm_max_ps/_mm_min_ps, so NaN clamps to 0 like the SIMD body
+            float x = std::min(std::max(0.0f, (src[i] - lo) * s), qmax);
+            dst[i] = Q(std::nearbyint(x));
+        }
+    });
+}
+
+// One RGTC1 block from 16 normalized bytes. Uses the 8-level mode (red0 > red1).
+inline void encode_bc4_block(const uint8_t px[16], uint8_t out[8])
+{
+    uint8_t lo, hi;
+#ifdef DISPLAY_TOOL_SSE2
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(px));
+    __m128i mn = _mm_min_epu8(v, _mm_srli_si128(v, 8));
+    __m128i mx = _mm_max_epu8(v, _mm_srli_si128(v, 8));
+    mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 4)); mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 4));
+    mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 2)); mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 2));
+    mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 1)); mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 1));
+    lo = uint8_t(_mm_cvtsi128_si32(mn) & 0xff);
+    hi = uint8_t(_mm_cvtsi128_si32(mx) & 0xff);
+#else
+    lo = 255; hi = 0;
+    for(int i = 0; i < 16; ++i){ lo = std::min(lo, px[i]); hi = std::max(hi, px[i]); }
+#endif
+    out[0] = hi;
+    out[1] = lo;
+    uint64_t bits = 0;
+    if(hi > lo){
+        const int range = hi - lo;
+        for(int i = 0; i < 16; ++i){
+            const int k = ((px[i] - lo) * 7 + range / 2) / range;  // 0 = lo .. 7 = hi
+            const uint64_t idx = k == 7 ? 0 : k == 0 ? 1 : uint64_t(8 - k);
+            bits |= idx << (3 * i);
+        }
+    }
+    for(int i = 0; i < 6; ++i) out[2 + i] = uint8_t(bits >> (8 * i));
+}
+
+inline uint16_t pack565(int r, int g, int b)
+{
+    return uint16_t(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+}
+inline void unpack565(uint16_t c, int rgb[3])
+{
+    rgb[0] = ((c >> 11) & 31) * 255 / 31;
+    rgb[1] = ((c >> 5) & 63) * 255 / 63;
+    rgb[2] = (c & 31) * 255 / 31;
+}
+
+// One DXT1 block from 16 RGB texels. Endpoints are the colour bounding box corners.
+inline void encode_bc1_block(const uint8_t px[16 * 3], uint8_t out[8])
+{
+    int mn[3] = {255, 255, 255}, mx[3] = {0, 0, 0};
+    for(int i = 0; i < 16; ++i){
+        for(int c = 0; c < 3; ++c){
+            mn[c] = std::min(mn[c], int(px[i*3+c]));
+            mx[c] = std::max(mx[c], int(px[i*3+c]));
+        }
+    }
+    // pick the box diagonal that follows the data: flip channels anti-correlated
+    // with the widest one
+    int ref = 0;
+    for(int c = 1; c < 3; ++c) if(mx[c] - mn[c] > mx[ref] - mn[ref]) ref = c;
+    int mean[3] = {0, 0, 0};
+    for(int i = 0; i < 16; ++i) for(int c = 0; c < 3; ++c) mean[c] += px[i*3+c];
+    for(int c = 0; c < 3; ++c) mean[c] /= 16;
+    for(int c = 0; c < 3; ++c){
+        if(c == ref) continue;
+        int cov = 0;
+        for(int i = 0; i < 16; ++i) cov += (px[i*3+ref] - mean[ref]) * (px[i*3+c] - mean[c]);
+        if(cov < 0) std::swap(mn[c], mx[c]);
+    }
+    uint16_t c0 = pack565(mx[0], mx[1], mx[2]);
+    uint16_t c1 = pack565(mn[0], mn[1], mn[2]);
+    if(c0 < c1) std::swap(c0, c1);
+    uint32_t bits = 0;
+    if(c0 != c1){
+        int e0[3], e1[3];
+        unpack565(c0, e0); unpack565(c1, e1);
+        const int d[3] = { e1[0]-e0[0], e1[1]-e0[1], e1[2]-e0[2] };
+        const int dd = std::max(1, d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+        static constexpr uint32_t remap[4] = { 0, 2, 3, 1 }; // t = 0, 1/3, 2/3, 1
+        for(int i = 0; i < 16; ++i){
+            const int dot = (px[i*3]-e0[0])*d[0] + (px[i*3+1]-e0[1])*d[1] + (px[i*3+2]-e0[2])*d[2];
+            const int k = std::min(3, std::max(0, (dot * 3 + dd / 2) / dd));
+            bits |= remap[k] << (2 * i);
+        }
+    }
+    out[0] = uint8_t(c0); out[1] = uint8_t(c0 >> 8);
+    out[2] = uint8_t(c1); out[3] = uint8_t(c1 >> 8);
+    for(int i = 0; i < 4; ++i) out[4 + i] = uint8_t(bits >> (8 * i));
+}
+
+// Gather a 4x4 block with edge clamping. C = channels per texel.
+template<int C>
+void gather_block(const uint8_t* img, int w, int h, int bx, int by, uint8_t* px)
+{
+    for(int y = 0; y < 4; ++y){
+        const int sy = std::min(h - 1, by * 4 + y);
+        for(int x = 0; x < 4; ++x){
+            const int sx = std::min(w - 1, bx * 4 + x);
+            std::memcpy(px + (y * 4 + x) * C, img + (size_t(sy) * w + sx) * C, C);
+        }
+    }
+}
+
+inline void encode_bc4(const uint8_t* r8, int w, int h, uint8_t* dst)
+{
+    const int bw = (w + 3) / 4, bh = (h + 3) / 4;
+    parallel_for(0, bh, [&](int b, int e){
+        uint8_t px[16];
+        for(int by = b; by < e; ++by)
+            for(int bx = 0; bx < bw; ++bx){
+                gather_block<1>(r8, w, h, bx, by, px);
+                encode_bc4_block(px, dst + (size_t(by) * bw + bx) * 8);
+            }
+    });
+}
+inline void encode_bc1(const uint8_t* rgb, int w, int h, uint8_t* dst)
+{
+    const int bw = (w + 3) / 4, bh = (h + 3) / 4;
+    parallel_for(0, bh, [&](int b, int e){
+        uint8_t px[48];
+        for(int by = b; by < e; ++by)
+            for(int bx = 0; bx < bw; ++bx){
+                gather_block<3>(rgb, w, h, bx, by, px);
+                encode_bc1_block(px, dst + (size_t(by) * bw + bx) * 8);
+            }
+    });
+}
+
+// Encode a scalar field. rgb8/bc1 expand the normalized value to grey.
+inline texture_image encode_scalar(const float* data, int w, int h, texture_format fmt)
+{
+    texture_image img;
+    img.fmt = fmt; img.width = w; img.height = h;
+    const size_t n = size_t(w) * h;
+    float lo, hi;
+    minmax_of(data, n, lo, hi);
+    img.display_lo = lo; img.display_hi = hi;
+    img.bytes.resize(texture_bytes(fmt, w, h));
+    switch(fmt){
+        case texture_format::r16f:
+            encode_half(data, n, reinterpret_cast<uint16_t*>(img.bytes.data()));
+            break;
+        case texture_format::r16q:
+            quantize(data, n, reinterpret_cast<uint16_t*>(img.bytes.data()), lo, hi);
+            img.value_scale = hi - lo; img.value_offset = lo;
+            break;
+        case texture_format::r8q:
+            quantize(data, n, img.bytes.data(), lo, hi);
+            img.value_scale = hi - lo; img.value_offset = lo;
+            break;
+        case texture_format::bc4:{
+            std::vector<uint8_t> r8(n);
+            quantize(data, n, r8.data(), lo, hi);
+            encode_bc4(r8.data(), w, h, img.bytes.data());
+            img.value_scale = hi - lo; img.value_offset = lo;
+            break;
+        }
+        case texture_format::rgb8:
+        case texture_format::bc1:{
+            std::vector<uint8_t> r8(n);
+            quantize(data, n, r8.data(), lo, hi);
+            std::vector<uint8_t> rgb(n * 3);
+            parallel_for(0, h, [&](int b, int e){
+                for(size_t i = size_t(b) * w; i < size_t(e) * w; ++i)
+                    rgb[i*3] = rgb[i*3+1] = rgb[i*3+2] = r8[i];
+            });
+            if(fmt == texture_format::bc1) encode_bc1(rgb.data(), w, h, img.bytes.data());
+            else img.bytes.swap(rgb);
+            img.value_scale = hi - lo; img.value_offset = lo;
+            break;
+        }
+    }
+    return img;
+}
+
+// Encode an RGB8 image. Only rgb8 and bc1 keep colour; scalar formats are rejected.
+inline texture_image encode_rgb(const uint8_t* rgb, int w, int h, texture_format fmt)
+{
+    texture_image img;
+    img.width = w; img.height = h;
+    img.value_scale = 255.0f; img.display_hi = 255.0f;
+    if(fmt != texture_format::bc1){
+        if(fmt != texture_format::rgb8)
+            std::cerr << "texture format " << texture_format_name(fmt) << " is scalar only, using rgb8\n";
+        img.fmt = texture_format::rgb8;
+        img.bytes.assign(rgb, rgb + size_t(w) * h * 3);
+        return img;
+    }
+    img.fmt = fmt;
+    img.bytes.resize(texture_bytes(fmt, w, h));
+    encode_bc1(rgb, w, h, img.bytes.data());
+    return img;
+}
+
+// ---------- GL upload (call with a current context) ----------
+// swizzle_grey needs GL 3.3; the fixed-function path only uploads rgb8/bc1.
+static gpu_texture upload_texture_image(const texture_image& img, bool swizzle_grey = true)
+{
+    gpu_texture t;
+    t.fmt = img.fmt; t.width = img.width; t.height = img.height;
+    t.bytes = img.bytes.size();
+    const float range = img.display_hi - img.display_lo;
+    t.scale = img.value_scale / range;
+    t.offset = (img.value_offset - img.display_lo) / range;
+    t.value_scale = img.value_scale;
+    t.value_offset = img.value_offset;
+
+    glGenTextures(1, &t.id);
+    glBindTexture(GL_TEXTURE_2D, t.id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    const int w = img.width, h = img.height;
+    const void* p = img.bytes.data();
+    switch(img.fmt){
+        case texture_format::rgb8:
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, p);
+            break;
+        case texture_format::r16f:
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, w, h, 0, GL_RED, GL_HALF_FLOAT, p);
+            break;
+        case texture_format::r8q:
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w, h, 0, GL_RED, GL_UNSIGNED_BYTE, p);
+            break;
+        case texture_format::r16q:
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, w, h, 0, GL_RED, GL_UNSIGNED_SHORT, p);
+            break;
+        case texture_format::bc4:
+            glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RED_RGTC1, w, h, 0, GLsizei(t.bytes), p);
+            break;
+        case texture_format::bc1:
+            glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, w, h, 0, GLsizei(t.bytes), p);
+            break;
+    }
+    if(swizzle_grey && is_scalar_format(img.fmt)){
+        const GLint swz[4] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swz);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return t;
+}
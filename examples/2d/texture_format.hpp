@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// GPU storage of a texture. Scalar formats are sampled from .r and shown as grey.
+enum class texture_format : int
+{
+    rgb8,   // 3 B/texel, the original upload path
+    r16f,   // 2 B/texel, half-float scalar
+    r8q,    // 1 B/texel, scalar quantized to [min, max]
+    r16q,   // 2 B/texel, scalar quantized to [min, max]
+    bc4,    // 0.5 B/texel, RGTC1 scalar blocks
+    bc1,    // 0.5 B/texel, DXT1 colour blocks
+};
+
+inline const char* texture_format_name(texture_format f)
+{
+    switch(f){
+        case texture_format::rgb8: return "rgb8";
+        case texture_format::r16f: return "r16f";
+        case texture_format::r8q:  return "r8q";
+        case texture_format::r16q: return "r16q";
+        case texture_format::bc4:  return "bc4";
+        case texture_format::bc1:  return "bc1";
+    }
+    return "unknown";
+}
+inline bool is_scalar_format(texture_format f)
+{
+    return f != texture_format::rgb8 && f != texture_format::bc1;
+}
+inline bool is_block_format(texture_format f)
+{
+    return f == texture_format::bc4 || f == texture_format::bc1;
+}
+inline size_t texture_bytes(texture_format f, int w, int h)
+{
+    const size_t blocks = size_t((w + 3) / 4) * size_t((h + 3) / 4);
+    switch(f){
+        case texture_format::rgb8: return size_t(w) * h * 3;
+        case texture_format::r16f:
+        case texture_format::r16q: return size_t(w) * h * 2;
+        case texture_format::r8q:  return size_t(w) * h;
+        case texture_format::bc4:
+        case texture_format::bc1:  return blocks * 8;
+    }
+    return 0;
+}
+
+// CPU-side encoded image, ready for glTexImage2D / glCompressedTexImage2D.
+// A sampled texel s maps back to the source value as s * value_scale + value_offset.
+struct texture_image
+{
+    texture_format fmt = texture_format::rgb8;
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> bytes;
+    float value_scale = 1.0f;
+    float value_offset = 0.0f;
+    float display_lo = 0.0f;
+    float display_hi = 1.0f;
+};
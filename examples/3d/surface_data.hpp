@@ -0,0 +1,252 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include "volume_data.hpp"
+#include "../disk_cache.hpp"
+
+// Height field as a quadtree of 128x128-cell chunks. Level 0 holds the samples normalized
+// to 16 bit; level L is level L-1 filtered with [1 2 1] and decimated by two, so every
+// coarse sample sits on a fine one. Each node keeps its height range and a bound on how
+// far its surface is from the full resolution one (`err`, in 16 bit units).
+// A pyramid loaded from a disk cache entry keeps no samples in memory; extract() copies the
+// node's tile out of the mapped entry.
+struct surface_pyramid
+{
+    static constexpr int chunk = 128;
+    static constexpr int tile = chunk + 1;  // samples per node side
+
+    struct level
+    {
+        int w = 0, h = 0;    // samples
+        int nx = 0, ny = 0;  // nodes
+        std::vector<uint16_t> v;
+        std::vector<float> err;
+        std::vector<uint16_t> lo, hi;
+    };
+    std::vector<level> levels;
+    float vmin = 0, vmax = 1;
+
+    // first z slice of src
+    void build(const volume_source& src)
+    {
+        cached = {};
+        const int w = src.nx, h = src.ny;
+        std::vector<float> row_min(h), row_max(h);
+        src.visit([&](auto* v){
+            parallel_for(0, h, [&](int b, int e){
+                for(int y = b; y < e; ++y){
+                    float a = std::numeric_limits<float>::infinity(), o = -a;
+                    for(int x = 0; x < w; ++x){
+                        const float f = float(v[size_t(y) * w + x]);
+                        a = std::min(a, f);
+                        o = std::max(o, f);
+                    }
+                    row_min[y] = a;
+                    row_max[y] = o;
+                }
+            });
+            vmin = *std::min_element(row_min.begin(), row_min.end());
+            vmax = *std::max_element(row_max.begin(), row_max.end());
+            if(!(vmax > vmin)) vmax = vmin + 1;
+            const float scale = 65535.0f / (vmax - vmin);
+            levels.assign(1, level{});
+            levels[0].w = w;
+            levels[0].h = h;
+            levels[0].v.resize(size_t(w) * h);
+            parallel_for(0, h, [&](int b, int e){
+                for(size_t i = size_t(b) * w; i < size_t(e) * w; ++i){
+                    const float f = (float(v[i]) - vmin) * scale;
+                    levels[0].v[i] = f >= 0.0f ? uint16_t(std::min(65535.0f, f + 0.5f)) : 0;  // NaN -> 0
+                }
+            });
+        });
+        finish();
+    }
+    // rolling hills with a few ridges, n x n samples
+    void synthetic(int n)
+    {
+        cached = {};
+        levels.assign(1, level{});
+        levels[0].w = levels[0].h = n;
+        levels[0].v.resize(size_t(n) * n);
+        vmin = 0;
+        vmax = 1;
+        parallel_for(0, n, [&](int b, int e){
+            for(int y = b; y < e; ++y)
+                for(int x = 0; x < n; ++x){
+                    const float u = float(x) / n, v = float(y) / n;
+                    float d = 0.5f + 0.2f * std::sin(u * 6.0f) * std::cos(v * 5.0f);
+                    d += 0.1f * std::sin(u * 41.0f + std::sin(v * 13.0f) * 2.0f);
+                    d += 0.03f * std::sin(u * 397.0f) * std::sin(v * 411.0f);
+                    d += 0.15f * std::max(0.0f, 1.0f - std::abs(u - v - 0.2f) * 30.0f);
+                    levels[0].v[size_t(y) * n + x] = uint16_t(std::min(1.0f, std::max(0.0f, d)) * 65535.0f);
+                }
+        });
+        finish();
+    }
+    int top() const
+    {
+        return int(levels.size()) - 1;
+    }
+    // tile x tile samples of node (x, y) on level l, repeating the last row/column at the border
+    void extract(int l, int x, int y, uint16_t* out) const
+    {
+        if(cached.valid()){
+            const cache_blob b = cached.find(tile_id(l, x, y));
+            if(b.size == sizeof(uint16_t) * tile * tile) std::memcpy(out, b.data, b.size);
+            else std::fill(out, out + tile * tile, uint16_t(0));
+            return;
+        }
+        const level& L = levels[l];
+        const int x0 = x * chunk, n = std::min(tile, L.w - x0);
+        for(int j = 0; j < tile; ++j){
+            const uint16_t* row = &L.v[size_t(std::min(L.h - 1, y * chunk + j)) * L.w + x0];
+            std::memcpy(out + j * tile, row, n * sizeof(uint16_t));
+            std::fill(out + j * tile + n, out + (j + 1) * tile, row[n - 1]);
+        }
+    }
+    // every node's tile plus the per-level node stats
+    void save(cache_writer& w) const
+    {
+        std::vector<int32_t> meta = {int32_t(levels.size())};
+        for(const auto& L : levels){
+            meta.push_back(L.w);
+            meta.push_back(L.h);
+        }
+        w.add(0, meta);
+        const float range[2] = {vmin, vmax};
+        w.add(1, range, sizeof(range));
+        std::vector<uint16_t> buf(size_t(tile) * tile);
+        for(int l = 0; l <= top(); ++l){
+            const level& L = levels[l];
+            w.add(stats_id(l, 0), L.err);
+            w.add(stats_id(l, 1), L.lo);
+            w.add(stats_id(l, 2), L.hi);
+            for(int y = 0; y < L.ny; ++y)
+                for(int x = 0; x < L.nx; ++x){
+                    extract(l, x, y, buf.data());
+                    w.add(tile_id(l, x, y), buf);
+                }
+        }
+    }
+    // take over a cache entry written by save(); false leaves the pyramid empty
+    bool load(cache_file&& f)
+    {
+        std::vector<int32_t> meta;
+        std::vector<float> range;
+        levels.clear();
+        if(!f.read(0, meta) || meta.empty() || meta.size() != size_t(1 + 2 * meta[0]) || !f.read(1, range, 2)) return false;
+        levels.resize(meta[0]);
+        for(int l = 0; l <= top(); ++l){
+            level& L = levels[l];
+            L.w = meta[1 + 2 * l];
+            L.h = meta[2 + 2 * l];
+            nodes(L);
+            const size_t n = L.err.size();
+            if(!f.read(stats_id(l, 0), L.err, n) || !f.read(stats_id(l, 1), L.lo, n) || !f.read(stats_id(l, 2), L.hi, n)){
+                levels.clear();
+                return false;
+            }
+        }
+        vmin = range[0];
+        vmax = range[1];
+        cached = std::move(f);
+        return true;
+    }
+private:
+    static uint64_t stats_id(int l, int kind)
+    {
+        return 16 + uint64_t(l) * 4 + kind;
+    }
+    static uint64_t tile_id(int l, int x, int y)
+    {
+        return (uint64_t(l + 1) << 48) | (uint64_t(y) << 24) | uint64_t(x);
+    }
+    void finish()
+    {
+        nodes(levels[0]);
+        stats(0);
+        while(levels.back().w > tile || levels.back().h > tile){
+            const level& prev = levels.back();
+            level next;
+            next.w = prev.w / 2 + 1;
+            next.h = prev.h / 2 + 1;
+            next.v.resize(size_t(next.w) * next.h);
+            downsample(prev, next);
+            nodes(next);
+            levels.push_back(std::move(next));
+            stats(top());
+        }
+    }
+    static void nodes(level& L)
+    {
+        L.nx = std::max(1, (L.w - 1 + chunk - 1) / chunk);
+        L.ny = std::max(1, (L.h - 1 + chunk - 1) / chunk);
+        L.err.assign(size_t(L.nx) * L.ny, 0.0f);
+        L.lo.assign(L.err.size(), 65535);
+        L.hi.assign(L.err.size(), 0);
+    }
+    static void downsample(const level& p, level& c)
+    {
+        auto at = [&](int x, int y){
+            return float(p.v[size_t(std::min(p.h - 1, std::max(0, y))) * p.w + std::min(p.w - 1, std::max(0, x))]);
+        };
+        parallel_for(0, c.h, [&](int b, int e){
+            for(int y = b; y < e; ++y)
+                for(int x = 0; x < c.w; ++x){
+                    float s = 0;
+                    for(int dy = -1; dy <= 1; ++dy)
+                        for(int dx = -1; dx <= 1; ++dx)
+                            s += (2 - std::abs(dx)) * (2 - std::abs(dy)) * at(2 * x + dx, 2 * y + dy);
+                    c.v[size_t(y) * c.w + x] = uint16_t(s / 16.0f + 0.5f);
+                }
+        });
+    }
+    // height range and error of every node on level l; one row of nodes per task
+    void stats(int l)
+    {
+        level& L = levels[l];
+        parallel_for(0, L.ny, [&](int b, int e){
+            for(int y = b; y < e; ++y)
+                for(int x = 0; x < L.nx; ++x){
+                    const size_t n = size_t(y) * L.nx + x;
+                    uint16_t lo = 65535, hi = 0;
+                    for(int r = y * chunk; r <= std::min(L.h - 1, (y + 1) * chunk); ++r)
+                        for(int c = x * chunk; c <= std::min(L.w - 1, (x + 1) * chunk); ++c){
+                            lo = std::min(lo, L.v[size_t(r) * L.w + c]);
+                            hi = std::max(hi, L.v[size_t(r) * L.w + c]);
+                        }
+                    float err = 0;
+                    if(l > 0){
+                        const level& P = levels[l - 1];
+                        // deviation of this node's surface from the finer samples it replaces
+                        for(int r = 2 * y * chunk; r <= std::min(P.h - 1, 2 * (y + 1) * chunk); ++r)
+                            for(int c = 2 * x * chunk; c <= std::min(P.w - 1, 2 * (x + 1) * chunk); ++c){
+                                const int c0 = c >> 1, c1 = std::min(L.w - 1, (c + 1) >> 1);
+                                const int r0 = r >> 1, r1 = std::min(L.h - 1, (r + 1) >> 1);
+                                const float coarse = 0.25f * (float(L.v[size_t(r0) * L.w + c0]) + L.v[size_t(r0) * L.w + c1] +
+                                                              L.v[size_t(r1) * L.w + c0] + L.v[size_t(r1) * L.w + c1]);
+                                err = std::max(err, std::abs(float(P.v[size_t(r) * P.w + c]) - coarse));
+                            }
+                        float child = 0;
+                        for(int cy = 2 * y; cy < std::min(P.ny, 2 * y + 2); ++cy)
+                            for(int cx = 2 * x; cx < std::min(P.nx, 2 * x + 2); ++cx){
+                                const size_t k = size_t(cy) * P.nx + cx;
+                                child = std::max(child, P.err[k]);
+                                lo = std::min(lo, P.lo[k]);
+                                hi = std::max(hi, P.hi[k]);
+                            }
+                        err += child;
+                    }
+                    L.err[n] = err;
+                    L.lo[n] = lo;
+                    L.hi[n] = hi;
+                }
+        });
+    }
+    cache_file cached;
+};
@@ -0,0 +1,372 @@
+#pragma once
+#ifdef __APPLE__
+#   include <OpenGL/gl3.h>
+#else
+#   include <GL/glew.h>
+#endif
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "view3d.hpp"
+#include "surface_data.hpp"
+#include "colormaps.hpp"
+
+// ---------- height field shaders (GL 3.3) ----------
+// One instance per chunk. The vertex grid is 131x131: 129x129 samples plus a ring of skirt
+// vertices pushed down to hide cracks between chunks of different levels.
+static const char* surfaceVS = R"(
+#version 330 core
+layout(location = 0) in vec4 iChunk;   // origin x, origin z, sample spacing, skirt depth
+layout(location = 1) in float iLayer;
+uniform mat4 uViewProj;
+uniform vec2 uMax;                     // world x/z of the last sample
+uniform float uHeight;
+uniform sampler2DArray uHeights;
+out float vValue;
+out vec3 vNormal;
+const int side = 131;
+float height(ivec2 s) {
+    return texelFetch(uHeights, ivec3(clamp(s, ivec2(0), ivec2(128)), int(iLayer)), 0).r;
+}
+void main() {
+    ivec2 g = ivec2(gl_VertexID % side, gl_VertexID / side);
+    ivec2 s = clamp(g - 1, ivec2(0), ivec2(128));
+    float h = height(s);
+    vec2 d = vec2(height(s + ivec2(1, 0)) - height(s - ivec2(1, 0)),
+                  height(s + ivec2(0, 1)) - height(s - ivec2(0, 1))) * uHeight / (2.0 * iChunk.z);
+    vNormal = normalize(vec3(-d.x, 1.0, -d.y));
+    vValue = h;
+    bool skirt = any(equal(g, ivec2(0))) || any(equal(g, ivec2(side - 1)));
+    vec2 p = min(iChunk.xy + vec2(s) * iChunk.z, uMax);
+    float y = (h - 0.5) * uHeight - (skirt ? iChunk.w : 0.0);
+    gl_Position = uViewProj * vec4(p.x, y, p.y, 1.0);
+}
+)";
+
+static const char* surfaceFS = R"(
+#version 330 core
+in float vValue;
+in vec3 vNormal;
+out vec4 FragColor;
+uniform sampler2D uColormap;
+void main() {
+    vec3 c = texture(uColormap, vec2(vValue, 0.5)).rgb;
+    float light = 0.35 + 0.65 * max(dot(normalize(vNormal), normalize(vec3(0.4, 1.0, 0.3))), 0.0);
+    FragColor = vec4(c * light, 1.0);
+}
+)";
+
+// Quadtree LOD over a surface_pyramid. Every frame the tree is walked from the root and a
+// chunk is split while its error projects to more than tolerance_px pixels and all of its
+// children are resident. Resident chunks live in one R16 texture array; missing children are
+// uploaded (at most max_uploads per frame, worst error first, all four of a split at once)
+// replacing the least recently used chunks. All chunks share one index buffer and are drawn
+// with a single instanced call.
+struct surface_renderer
+{
+    float tolerance_px = 2.0f;
+    float height = 0.2f;  // world units for the full value range
+    int max_uploads = 32;
+
+    bool init(const surface_pyramid& pyramid, size_t budget_mb,
+              GLuint (*compile)(GLenum, const char*))
+    {
+        src = &pyramid;
+        GLuint vs = compile(GL_VERTEX_SHADER, surfaceVS), fs = compile(GL_FRAGMENT_SHADER, surfaceFS);
+        program = glCreateProgram();
+        glAttachShader(program, vs);
+        glAttachShader(program, fs);
+        glLinkProgram(program);
+        glDeleteShader(vs);
+        glDeleteShader(fs);
+        GLint ok = 0; glGetProgramiv(program, GL_LINK_STATUS, &ok);
+        if(!ok){
+            char buf[1024]; glGetProgramInfoLog(program, 1024, nullptr, buf);
+            std::cerr << "Surface program link error: " << buf << "\n";
+            return false;
+        }
+
+        // shared index buffer over the 131x131 grid
+        constexpr int side = surface_pyramid::tile + 2;
+        std::vector<uint16_t> idx;
+        idx.reserve((side - 1) * (side - 1) * 6);
+        for(int j = 0; j + 1 < side; ++j)
+            for(int i = 0; i + 1 < side; ++i){
+                const uint16_t a = uint16_t(j * side + i), b = uint16_t(a + 1), c = uint16_t(a + side), d = uint16_t(c + 1);
+                idx.insert(idx.end(), {a, c, b, b, c, d});
+            }
+        index_count = GLsizei(idx.size());
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &ibo);
+        glGenBuffers(1, &instance_vbo);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx.size() * sizeof(uint16_t), idx.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(chunk_instance), (void*)0);
+        glVertexAttribDivisor(0, 1);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(chunk_instance), (void*)(4 * sizeof(float)));
+        glVertexAttribDivisor(1, 1);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        offset.assign(src->levels.size() + 1, 0);
+        for(size_t l = 0; l < src->levels.size(); ++l)
+            offset[l + 1] = offset[l] + src->levels[l].err.size();
+        node_slot.assign(offset.back(), -1);
+        node_stamp.assign(offset.back(), 0);
+
+        GLint layers = 256; glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &layers);
+        constexpr size_t tile_bytes = size_t(surface_pyramid::tile) * surface_pyramid::tile * sizeof(uint16_t);
+        const size_t slots = std::max<size_t>(1, std::min({budget_mb * 1024 * 1024 / tile_bytes, size_t(layers), offset.back()}));
+        slot_node.assign(slots, -1);
+        glGenTextures(1, &heights);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, heights);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R16, surface_pyramid::tile, surface_pyramid::tile, GLsizei(slots),
+                     0, GL_RED, GL_UNSIGNED_SHORT, nullptr);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        glGenTextures(1, &colormap_tex);
+        set_colormap("viridis");
+
+        // the root is always resident
+        upload(node(src->top(), 0, 0), src->top(), 0, 0);
+        const auto& L0 = src->levels[0];
+        std::printf("surface %dx%d, %d levels, %zu chunks, %zu resident slots (%.0f MiB)\n", L0.w, L0.h,
+                    int(src->levels.size()), offset.back(), slots, slots * double(tile_bytes) / (1 << 20));
+        return true;
+    }
+    void set_colormap(const std::string& name)
+    {
+        const auto& cmap = get_colormap_color(name);
+        glBindTexture(GL_TEXTURE_2D, colormap_tex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, 256, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, cmap.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    void render(const view3d& view, int width, int height_px)
+    {
+        ++frame;
+        select(view, height_px);
+        stream();
+
+        const float eye = std::sqrt(view.eye[0] * view.eye[0] + view.eye[1] * view.eye[1] + view.eye[2] * view.eye[2]);
+        float vp[16];
+        view_projection(view, 0.01f * eye, 10.0f + 10.0f * eye, vp);
+        glViewport(0, 0, width, height_px);
+        glEnable(GL_DEPTH_TEST);
+        glUseProgram(program);
+        glUniformMatrix4fv(glGetUniformLocation(program, "uViewProj"), 1, GL_FALSE, vp);
+        glUniform2f(glGetUniformLocation(program, "uMax"), extent(0), extent(1));
+        glUniform1f(glGetUniformLocation(program, "uHeight"), height);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, heights);
+        glUniform1i(glGetUniformLocation(program, "uHeights"), 0);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, colormap_tex);
+        glUniform1i(glGetUniformLocation(program, "uColormap"), 1);
+
+        glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+        glBufferData(GL_ARRAY_BUFFER, draw.size() * sizeof(chunk_instance), draw.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(vao);
+        glDrawElementsInstanced(GL_TRIANGLES, index_count, GL_UNSIGNED_SHORT, nullptr, GLsizei(draw.size()));
+        glBindVertexArray(0);
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        glUseProgram(0);
+        glDisable(GL_DEPTH_TEST);
+    }
+    void release()
+    {
+        const GLuint tex[2] = {heights, colormap_tex};
+        glDeleteTextures(2, tex);
+        const GLuint buf[2] = {ibo, instance_vbo};
+        glDeleteBuffers(2, buf);
+        glDeleteVertexArrays(1, &vao);
+        glDeleteProgram(program);
+        heights = colormap_tex = ibo = instance_vbo = vao = program = 0;
+    }
+    int drawn() const
+    {
+        return int(draw.size());
+    }
+    int resident() const
+    {
+        return resident_count;
+    }
+private:
+    struct chunk_instance
+    {
+        float x, z, spacing, skirt;
+        float layer;
+    };
+    struct wanted_split
+    {
+        float error_px;
+        int l, x, y;  // the chunk to split once its missing children are uploaded
+    };
+    size_t node(int l, int x, int y) const
+    {
+        return offset[l] + size_t(y) * src->levels[l].nx + x;
+    }
+    // world size of one level 0 cell; the surface is centred on the origin
+    float cell() const
+    {
+        const auto& L0 = src->levels[0];
+        return 1.0f / float(std::max(1, std::max(L0.w, L0.h) - 1));
+    }
+    float origin(int axis) const
+    {
+        const auto& L0 = src->levels[0];
+        return -0.5f * cell() * float((axis ? L0.h : L0.w) - 1);
+    }
+    float extent(int axis) const
+    {
+        return -origin(axis);
+    }
+    void select(const view3d& v, int height_px)
+    {
+        const float k = float(height_px) / (2.0f * v.tan_half_fov);
+        const float tx = v.tan_half_fov * v.aspect, ty = v.tan_half_fov;
+        // side planes through the eye, normals pointing inside the frustum
+        float planes[4][3];
+        for(int i = 0; i < 3; ++i){
+            planes[0][i] = v.forward[i] * tx - v.right[i];
+            planes[1][i] = v.forward[i] * tx + v.right[i];
+            planes[2][i] = v.forward[i] * ty - v.up[i];
+            planes[3][i] = v.forward[i] * ty + v.up[i];
+        }
+        draw.clear();
+        wanted.clear();
+        std::vector<std::array<int, 3>> stack{{src->top(), 0, 0}};
+        while(!stack.empty()){
+            const auto [l, x, y] = stack.back();
+            stack.pop_back();
+            const auto& L = src->levels[l];
+            const size_t n = size_t(y) * L.nx + x;
+            const float spacing = cell() * float(1 << l);
+            float lo[3] = {origin(0) + x * surface_pyramid::chunk * spacing, (L.lo[n] / 65535.0f - 0.5f) * height,
+                           origin(1) + y * surface_pyramid::chunk * spacing};
+            float hi[3] = {std::min(extent(0), lo[0] + surface_pyramid::chunk * spacing), (L.hi[n] / 65535.0f - 0.5f) * height,
+                           std::min(extent(1), lo[2] + surface_pyramid::chunk * spacing)};
+            const float err = L.err[n] / 65535.0f * height;
+            lo[1] -= err;  // the skirt
+            bool outside = false;
+            for(auto& p : planes){
+                float d = 0;
+                for(int i = 0; i < 3; ++i) d += p[i] * ((p[i] > 0 ? hi[i] : lo[i]) - v.eye[i]);
+                outside = outside || d < 0;
+            }
+            if(outside) continue;
+            float dist2 = 0;
+            for(int i = 0; i < 3; ++i){
+                const float d = std::max({lo[i] - v.eye[i], 0.0f, v.eye[i] - hi[i]});
+                dist2 += d * d;
+            }
+            const float error_px = err * k / std::max(1e-6f, std::sqrt(dist2));
+            if(l > 0 && error_px > tolerance_px){
+                const auto& P = src->levels[l - 1];
+                bool ready = true;
+                for(int cy = 2 * y; cy < std::min(P.ny, 2 * y + 2); ++cy)
+                    for(int cx = 2 * x; cx < std::min(P.nx, 2 * x + 2); ++cx){
+                        const size_t c = node(l - 1, cx, cy);
+                        if(node_slot[c] < 0) ready = false;
+                        else node_stamp[c] = frame;  // keep the children already there for the split
+                    }
+                if(!ready) wanted.push_back({error_px, l, x, y});
+                else{
+                    node_stamp[node(l, x, y)] = frame;
+                    for(int cy = 2 * y; cy < std::min(P.ny, 2 * y + 2); ++cy)
+                        for(int cx = 2 * x; cx < std::min(P.nx, 2 * x + 2); ++cx)
+                            stack.push_back({l - 1, cx, cy});
+                    continue;
+                }
+            }
+            const size_t id = node(l, x, y);
+            node_stamp[id] = frame;
+            draw.push_back({lo[0], lo[2], spacing, err + 2.0f * spacing, float(node_slot[id])});
+        }
+    }
+    // Worst error first, a split only when all of its missing children fit into the free slots
+    // and those not used this frame; a partial split would be evicted again before it is drawn.
+    void stream()
+    {
+        std::sort(wanted.begin(), wanted.end(), [](const wanted_split& a, const wanted_split& b){ return a.error_px > b.error_px; });
+        const size_t root = node(src->top(), 0, 0);
+        int available = 0;
+        for(const int n : slot_node)
+            if(n < 0 || (size_t(n) != root && node_stamp[n] < frame)) ++available;
+        int uploads = 0;
+        for(const wanted_split& w : wanted){
+            const auto& P = src->levels[w.l - 1];
+            std::array<int, 2> missing[4];
+            int n = 0;
+            for(int cy = 2 * w.y; cy < std::min(P.ny, 2 * w.y + 2); ++cy)
+                for(int cx = 2 * w.x; cx < std::min(P.nx, 2 * w.x + 2); ++cx)
+                    if(node_slot[node(w.l - 1, cx, cy)] < 0) missing[n++] = {cx, cy};
+            if(n > available || uploads + n > max_uploads) break;
+            for(int i = 0; i < n; ++i)
+                if(!upload(node(w.l - 1, missing[i][0], missing[i][1]), w.l - 1, missing[i][0], missing[i][1])) return;
+            available -= n;
+            uploads += n;
+        }
+    }
+    // into a free slot or the least recently used one; chunks used this frame (drawn, split, kept
+    // for a split or just uploaded) and the root stay
+    bool upload(size_t id, int l, int x, int y)
+    {
+        const size_t root = node(src->top(), 0, 0);
+        int best = -1;
+        uint32_t oldest = frame;
+        for(size_t s = 0; s < slot_node.size(); ++s){
+            const int n = slot_node[s];
+            if(n < 0){ best = int(s); break; }
+            if(size_t(n) != root && node_stamp[n] < oldest){
+                oldest = node_stamp[n];
+                best = int(s);
+            }
+        }
+        if(best < 0) return false;
+        if(slot_node[best] >= 0){
+            node_slot[slot_node[best]] = -1;
+            --resident_count;
+        }
+        staging.resize(size_t(surface_pyramid::tile) * surface_pyramid::tile);
+        src->extract(l, x, y, staging.data());
+        glBindTexture(GL_TEXTURE_2D_ARRAY, heights);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, best, surface_pyramid::tile, surface_pyramid::tile, 1,
+                        GL_RED, GL_UNSIGNED_SHORT, staging.data());
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        slot_node[best] = int(id);
+        node_slot[id] = best;
+        node_stamp[id] = frame;
+        ++resident_count;
+        return true;
+    }
+
+    const surface_pyramid* src = nullptr;
+    GLuint program = 0, vao = 0, ibo = 0, instance_vbo = 0, heights = 0, colormap_tex = 0;
+    GLsizei index_count = 0;
+    std::vector<size_t> offset;
+    std::vector<int> node_slot, slot_node;
+    std::vector<uint32_t> node_stamp;
+    std::vector<chunk_instance> draw;
+    std::vector<wanted_split> wanted;
+    std::vector<uint16_t> staging;
+    uint32_t frame = 1;
+    int resident_count = 0;
+};
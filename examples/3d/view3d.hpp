@@ -0,0 +1,30 @@
+#pragma once
+
+// Orbit camera basis shared by the 3D renderers; the world up axis is +y.
+struct view3d
+{
+    float eye[3];
+    float forward[3], right[3], up[3];
+    float tan_half_fov;
+    float aspect;
+};
+
+// Column-major perspective * look-along matrix for glUniformMatrix4fv.
+inline void view_projection(const view3d& v, float zn, float zf, float out[16])
+{
+    auto dot = [](const float* a, const float* b){ return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; };
+    float view[16] = {
+        v.right[0], v.up[0], -v.forward[0], 0,
+        v.right[1], v.up[1], -v.forward[1], 0,
+        v.right[2], v.up[2], -v.forward[2], 0,
+        -dot(v.right, v.eye), -dot(v.up, v.eye), dot(v.forward, v.eye), 1};
+    const float f = 1.0f / v.tan_half_fov;
+    float proj[16] = {0};
+    proj[0] = f / v.aspect; proj[5] = f; proj[10] = (zf + zn) / (zn - zf); proj[11] = -1; proj[14] = 2 * zf * zn / (zn - zf);
+    for(int c = 0; c < 4; ++c)
+        for(int r = 0; r < 4; ++r){
+            float s = 0;
+            for(int k = 0; k < 4; ++k) s += proj[k * 4 + r] * view[c * 4 + k];
+            out[c * 4 + r] = s;
+        }
+}
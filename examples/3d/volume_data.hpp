@@ -0,0 +1,317 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "../disk_cache.hpp"
+#include "../mapped_file.hpp"
+#include "../parallel_for.hpp"
+
+enum class voxel_type : int { u8, u16, f32 };
+
+inline size_t voxel_bytes(voxel_type t)
+{
+    return t == voxel_type::u8 ? 1 : t == voxel_type::u16 ? 2 : 4;
+}
+
+// Raw x-fastest scalar volume, memory-mapped from a file or held in memory.
+struct volume_source
+{
+    int nx = 0, ny = 0, nz = 0;
+    voxel_type type = voxel_type::u8;
+
+    bool open_raw(const std::string& path, int x, int y, int z, voxel_type t)
+    {
+        if(!file.open(path)) return false;
+        nx = x; ny = y; nz = z; type = t;
+        if(file.size() < voxel_count() * voxel_bytes(t)){
+            std::cerr << path << ": " << file.size() << " bytes, expected " << voxel_count() * voxel_bytes(t) << "\n";
+            file.close();
+            return false;
+        }
+        data = file.data();
+        return true;
+    }
+    // a few soft blobs inside a noisy shell, as u8
+    void make_synthetic(int n)
+    {
+        nx = ny = nz = n;
+        type = voxel_type::u8;
+        owned.resize(voxel_count());
+        parallel_for(0, n, [&](int b, int e){
+            for(int z = b; z < e; ++z)
+                for(int y = 0; y < n; ++y)
+                    for(int x = 0; x < n; ++x){
+                        const float u = (x + 0.5f) / n - 0.5f, v = (y + 0.5f) / n - 0.5f, w = (z + 0.5f) / n - 0.5f;
+                        const float r = std::sqrt(u * u + v * v + w * w);
+                        float d = std::max(0.0f, 1.0f - std::abs(r - 0.4f) * 40.0f) * (0.6f + 0.4f * std::sin(u * 40.0f) * std::cos(w * 30.0f));
+                        d = std::max(d, std::exp(-((u - 0.1f) * (u - 0.1f) + v * v + (w + 0.1f) * (w + 0.1f)) * 60.0f));
+                        d = std::max(d, 0.8f * std::exp(-((u + 0.15f) * (u + 0.15f) + (v - 0.1f) * (v - 0.1f) + w * w) * 120.0f));
+                        owned[(size_t(z) * n + y) * n + x] = uint8_t(std::min(255.0f, d * 255.0f));
+                    }
+        });
+        data = owned.data();
+    }
+    size_t voxel_count() const
+    {
+        return size_t(nx) * ny * nz;
+    }
+    // f(const T* voxels) with the stored element type
+    template<class F> void visit(F&& f) const
+    {
+        switch(type){
+            case voxel_type::u8:  f(reinterpret_cast<const uint8_t*>(data)); break;
+            case voxel_type::u16: f(reinterpret_cast<const uint16_t*>(data)); break;
+            case voxel_type::f32: f(reinterpret_cast<const float*>(data)); break;
+        }
+    }
+
+    const uint8_t* data = nullptr;
+private:
+    mapped_file file;
+    std::vector<uint8_t> owned;
+};
+
+// Min/max of every 16^3 macrocell, normalized to 8 bit over the volume's value range and
+// dilated by one cell so trilinear samples near a cell face are covered too.
+struct macrocell_grid
+{
+    static constexpr int cell = 16;
+    int cx = 0, cy = 0, cz = 0;
+    float vmin = 0, vmax = 1;
+    std::vector<uint8_t> lo, hi;
+
+    void build(const volume_source& src)
+    {
+        cx = (src.nx + cell - 1) / cell;
+        cy = (src.ny + cell - 1) / cell;
+        cz = (src.nz + cell - 1) / cell;
+        const size_t n = size_t(cx) * cy * cz;
+        std::vector<float> fmin(n, std::numeric_limits<float>::infinity()), fmax(n, -std::numeric_limits<float>::infinity());
+        // one slab of cells per task, so no two threads touch the same cell
+        src.visit([&](auto* v){
+            parallel_for(0, cz, [&](int b, int e){
+                for(int z = b * cell; z < std::min(src.nz, e * cell); ++z)
+                    for(int y = 0; y < src.ny; ++y){
+                        const auto* row = v + (size_t(z) * src.ny + y) * src.nx;
+                        const size_t base = (size_t(z / cell) * cy + y / cell) * cx;
+                        for(int c = 0; c < cx; ++c){
+                            float a = fmin[base + c], o = fmax[base + c];
+                            for(int x = c * cell; x < std::min(src.nx, (c + 1) * cell); ++x){
+                                const float f = float(row[x]);
+                                a = std::min(a, f);  // NaN never wins
+                                o = std::max(o, f);
+                            }
+                            fmin[base + c] = a;
+                            fmax[base + c] = o;
+                        }
+                    }
+            });
+        });
+        vmin = *std::min_element(fmin.begin(), fmin.end());
+        vmax = *std::max_element(fmax.begin(), fmax.end());
+        if(!(vmax > vmin)) vmax = vmin + 1;
+        lo.resize(n);
+        hi.resize(n);
+        for(size_t i = 0; i < n; ++i){
+            lo[i] = uint8_t(std::floor(normalize(fmin[i])));
+            hi[i] = uint8_t(std::ceil(normalize(fmax[i])));
+        }
+        dilate();
+    }
+    void save(cache_writer& w) const
+    {
+        const int32_t dims[3] = {cx, cy, cz};
+        const float range[2] = {vmin, vmax};
+        w.add(0, dims, sizeof(dims));
+        w.add(1, range, sizeof(range));
+        w.add(2, lo);
+        w.add(3, hi);
+    }
+    bool load(const cache_file& f)
+    {
+        std::vector<int32_t> dims;
+        std::vector<float> range;
+        if(!f.read(0, dims, 3) || !f.read(1, range, 2)) return false;
+        const size_t n = size_t(dims[0]) * dims[1] * dims[2];
+        if(!f.read(2, lo, n) || !f.read(3, hi, n)) return false;
+        cx = dims[0]; cy = dims[1]; cz = dims[2];
+        vmin = range[0]; vmax = range[1];
+        return true;
+    }
+    float normalize(float v) const
+    {
+        return std::min(255.0f, std::max(0.0f, (v - vmin) / (vmax - vmin) * 255.0f));
+    }
+    size_t index(int x, int y, int z) const
+    {
+        return (size_t(z) * cy + y) * cx + x;
+    }
+private:
+    void dilate()
+    {
+        const int dims[3] = {cx, cy, cz};
+        const size_t stride[3] = {1, size_t(cx), size_t(cx) * cy};
+        for(int axis = 0; axis < 3; ++axis){
+            const std::vector<uint8_t> l = lo, h = hi;
+            for(int z = 0; z < cz; ++z)
+                for(int y = 0; y < cy; ++y)
+                    for(int x = 0; x < cx; ++x){
+                        const int p[3] = {x, y, z};
+                        const size_t i = index(x, y, z);
+                        for(int d = -1; d <= 1; d += 2){
+                            const int q = p[axis] + d;
+                            if(q < 0 || q >= dims[axis]) continue;
+                            const size_t j = i + (d < 0 ? -stride[axis] : stride[axis]);
+                            lo[i] = std::min(lo[i], l[j]);
+                            hi[i] = std::max(hi[i], h[j]);
+                        }
+                    }
+        }
+    }
+};
+
+// 64^3 bricks stored with a one-voxel apron (66^3) so the atlas can filter across faces.
+struct volume_bricks
+{
+    static constexpr int brick = 64;
+    static constexpr int stored = brick + 2;
+    static constexpr size_t stored_bytes = size_t(stored) * stored * stored;
+    int bx = 0, by = 0, bz = 0;
+
+    void setup(const volume_source& s)
+    {
+        bx = (s.nx + brick - 1) / brick;
+        by = (s.ny + brick - 1) / brick;
+        bz = (s.nz + brick - 1) / brick;
+    }
+    int count() const { return bx * by * bz; }
+    // does any macrocell of the brick hold a visible value
+    bool occupied(const macrocell_grid& g, const std::vector<uint8_t>& occupancy, int id) const
+    {
+        constexpr int k = brick / macrocell_grid::cell;
+        const int x = id % bx, y = (id / bx) % by, z = id / (bx * by);
+        for(int cz = z * k; cz < std::min(g.cz, (z + 1) * k); ++cz)
+            for(int cy = y * k; cy < std::min(g.cy, (y + 1) * k); ++cy)
+                for(int cx = x * k; cx < std::min(g.cx, (x + 1) * k); ++cx)
+                    if(occupancy[g.index(cx, cy, cz)]) return true;
+        return false;
+    }
+    // voxels of brick id incl. apron (clamped at the volume border), normalized to 8 bit
+    void extract(const volume_source& s, const macrocell_grid& g, int id, uint8_t* out) const
+    {
+        const int x0 = (id % bx) * brick - 1, y0 = ((id / bx) % by) * brick - 1, z0 = id / (bx * by) * brick - 1;
+        const float scale = 255.0f / (g.vmax - g.vmin);
+        int xs[stored];
+        for(int i = 0; i < stored; ++i) xs[i] = std::min(s.nx - 1, std::max(0, x0 + i));
+        s.visit([&](auto* v){
+            for(int k = 0; k < stored; ++k){
+                const int z = std::min(s.nz - 1, std::max(0, z0 + k));
+                for(int j = 0; j < stored; ++j){
+                    const int y = std::min(s.ny - 1, std::max(0, y0 + j));
+                    const auto* row = v + (size_t(z) * s.ny + y) * s.nx;
+                    uint8_t* o = out + (size_t(k) * stored + j) * stored;
+                    for(int i = 0; i < stored; ++i){
+                        const float f = (float(row[xs[i]]) - g.vmin) * scale;
+                        o[i] = f >= 0.0f ? uint8_t(std::min(255.0f, f + 0.5f)) : 0;  // NaN -> 0
+                    }
+                }
+            }
+        });
+    }
+};
+
+// Reads bricks out of the (mapped) source as low-priority jobs, nearest first, with at most
+// max_ready bricks in flight or waiting. request() replaces the queue and cancels the reads
+// of the previous view that have not started; finished bricks wait in a ready list.
+struct brick_streamer
+{
+    ~brick_streamer()
+    {
+        stop();
+    }
+    void start(const volume_source& s, const macrocell_grid& g, const volume_bricks& b,
+               job_system& js = job_system::current())
+    {
+        src = &s; grid = &g; bricks = &b;
+        jobs = &js;
+    }
+    void stop()
+    {
+        std::vector<std::shared_ptr<job_group>> wait;
+        {
+            std::lock_guard<std::mutex> lock(m);
+            todo.clear();
+            for(auto& g : groups) g->cancel();
+            wait.swap(groups);
+            group = nullptr;
+        }
+        for(auto& g : wait) jobs->wait(*g);
+        ready.clear();
+    }
+    void request(const std::vector<int>& ids)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        if(group) group->cancel();
+        groups.erase(std::remove_if(groups.begin(), groups.end(), [](const auto& g){ return g->done(); }), groups.end());
+        groups.push_back(std::make_shared<job_group>());
+        group = groups.back().get();
+        todo.assign(ids.begin(), ids.end());
+        inflight = 0;
+        pump();
+    }
+    bool pop(int& id, std::vector<uint8_t>& voxels)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        if(ready.empty()) return false;
+        id = ready.front().first;
+        voxels.swap(ready.front().second);
+        ready.pop_front();
+        pump();
+        return true;
+    }
+    size_t bytes_read() const
+    {
+        return read.load();
+    }
+private:
+    static constexpr size_t max_ready = 32;
+    // with m held
+    void pump()
+    {
+        while(!todo.empty() && inflight + ready.size() < max_ready){
+            const int id = todo.front();
+            todo.pop_front();
+            ++inflight;
+            jobs->submit([this, id, g = group]{ load(id, g); }, job_priority::low, group);
+        }
+    }
+    void load(int id, const job_group* g)
+    {
+        std::vector<uint8_t> buf(volume_bricks::stored_bytes);
+        bricks->extract(*src, *grid, id, buf.data());
+        read += volume_bricks::stored_bytes;
+        std::lock_guard<std::mutex> lock(m);
+        if(g != group) return;  // request() replaced the view meanwhile, the brick is no longer wanted
+        --inflight;
+        ready.emplace_back(id, std::move(buf));
+    }
+    const volume_source* src = nullptr;
+    const macrocell_grid* grid = nullptr;
+    const volume_bricks* bricks = nullptr;
+    job_system* jobs = nullptr;
+    std::mutex m;
+    std::deque<int> todo;
+    std::deque<std::pair<int, std::vector<uint8_t>>> ready;
+    std::vector<std::shared_ptr<job_group>> groups;  // the current view's and cancelled ones still running
+    job_group* group = nullptr;
+    size_t inflight = 0;
+    std::atomic<size_t> read{0};
+};
@@ -0,0 +1,344 @@
+#pragma once
+#ifdef __APPLE__
+#   include <OpenGL/gl3.h>
+#else
+#   include <GL/glew.h>
+#endif
+#include <array>
+#include <cstdio>
+#include <iostream>
+#include <numeric>
+#include "view3d.hpp"
+#include "volume_data.hpp"
+#include "colormaps.hpp"
+
+// ---------- volume ray-marching shaders (GL 3.3) ----------
+static const char* volumeVS = R"(
+#version 330 core
+out vec2 vNdc;
+void main() {
+    vNdc = vec2(gl_VertexID == 1 ? 3.0 : -1.0, gl_VertexID == 2 ? 3.0 : -1.0);
+    gl_Position = vec4(vNdc, 0.0, 1.0);
+}
+)";
+
+static const char* volumeFS = R"(
+#version 330 core
+in vec2 vNdc;
+out vec4 FragColor;
+uniform vec3 uEye, uForward, uRight, uUp;
+uniform vec2 uTan;          // tan(fov/2) * (aspect, 1)
+uniform vec3 uHalf;         // world half extents of the volume box
+uniform vec3 uDims;         // voxels
+uniform vec3 uAtlasSize;    // atlas texels
+uniform float uStep;        // voxels per sample
+uniform sampler3D uAtlas;
+uniform usampler3D uPage;   // brick -> atlas slot (xyz), resident (w)
+uniform usampler3D uOccupancy;
+uniform sampler2D uTransfer;
+const float cell = 16.0;
+const float brick = 64.0;
+const float stored = 66.0;
+
+float sample_volume(vec3 v) {
+    vec3 b = floor(clamp(v, vec3(0.0), uDims - 0.001) / brick);
+    uvec4 page = texelFetch(uPage, ivec3(b), 0);
+    if(page.w == 0u) return -1.0;
+    vec3 a = vec3(page.xyz) * stored + 1.0 + (v - b * brick);
+    return texture(uAtlas, a / uAtlasSize).r;
+}
+
+void main() {
+    vec3 rd = normalize(uForward + vNdc.x * uTan.x * uRight + vNdc.y * uTan.y * uUp);
+    vec3 inv = 1.0 / rd;
+    vec3 t0 = (-uHalf - uEye) * inv, t1 = (uHalf - uEye) * inv;
+    float tnear = max(max(min(t0.x, t1.x), min(t0.y, t1.y)), min(t0.z, t1.z));
+    float tfar = min(min(max(t0.x, t1.x), max(t0.y, t1.y)), max(t0.z, t1.z));
+    tnear = max(tnear, 0.0);
+    if(tfar <= tnear) discard;
+
+    // march in voxel units: v(t) = vo + vd * t, t in world units
+    vec3 vo = (uEye + uHalf) / (2.0 * uHalf) * uDims;
+    vec3 vd = rd / (2.0 * uHalf) * uDims;
+    float dt = uStep / length(vd);
+    ivec3 cells = textureSize(uOccupancy, 0);
+    vec4 acc = vec4(0.0);
+    float t = tnear;
+    for(int i = 0; i < 8192 && t < tfar; ++i) {
+        vec3 v = vo + vd * t;
+        ivec3 c = clamp(ivec3(floor(v / cell)), ivec3(0), cells - 1);
+        if(texelFetch(uOccupancy, c, 0).r == 0u) {
+            // empty macrocell: jump to where the ray leaves it
+            vec3 exit = (vec3(c) + step(0.0, vd)) * cell;
+            vec3 te = (exit - v) / vd;
+            te = mix(te, vec3(1e30), lessThanEqual(abs(vd), vec3(1e-8)));
+            t += max(min(min(te.x, te.y), te.z), 0.0) + dt * 0.01;
+            continue;
+        }
+        float s = sample_volume(v);
+        if(s >= 0.0) {
+            vec4 c = texture(uTransfer, vec2(s, 0.5));
+            float a = 1.0 - pow(1.0 - c.a, uStep);
+            acc.rgb += (1.0 - acc.a) * a * c.rgb;
+            acc.a += (1.0 - acc.a) * a;
+            if(acc.a > 0.99) break;  // early ray termination
+        }
+        t += dt;
+    }
+    if(acc.a <= 0.0) discard;
+    FragColor = vec4(acc.rgb / acc.a, acc.a);
+}
+)";
+
+// Bricked volume in a fixed-size 3D atlas with a page table. Occupied bricks are wanted
+// nearest-first; missing ones stream in from brick_streamer, at most max_uploads per
+// frame, evicting bricks that are no longer wanted. Until a brick arrives it renders empty.
+struct volume_renderer
+{
+    int max_uploads = 16;
+    float step = 0.5f;  // voxels per sample
+
+    // cells: a grid loaded from the disk cache, built from the source when null
+    bool init(volume_source& source, size_t atlas_budget_mb,
+              GLuint (*compile)(GLenum, const char*), const macrocell_grid* cells = nullptr)
+    {
+        src = &source;
+        if(cells) grid = *cells;
+        else grid.build(*src);
+        bricks.setup(*src);
+        GLuint vs = compile(GL_VERTEX_SHADER, volumeVS), fs = compile(GL_FRAGMENT_SHADER, volumeFS);
+        program = glCreateProgram();
+        glAttachShader(program, vs);
+        glAttachShader(program, fs);
+        glLinkProgram(program);
+        glDeleteShader(vs);
+        glDeleteShader(fs);
+        GLint ok = 0; glGetProgramiv(program, GL_LINK_STATUS, &ok);
+        if(!ok){
+            char buf[1024]; glGetProgramInfoLog(program, 1024, nullptr, buf);
+            std::cerr << "Volume program link error: " << buf << "\n";
+            return false;
+        }
+        glGenVertexArrays(1, &vao);
+
+        // atlas: as many 66^3 slots as the budget and GL_MAX_3D_TEXTURE_SIZE allow
+        GLint max3d = 256; glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &max3d);
+        const int per_axis = std::max(1, int(max3d) / volume_bricks::stored);
+        size_t slots = std::max<size_t>(1, atlas_budget_mb * 1024 * 1024 / volume_bricks::stored_bytes);
+        slots = std::min<size_t>({slots, size_t(bricks.count()), size_t(per_axis) * per_axis * per_axis});
+        ax = std::min(per_axis, int(std::ceil(std::cbrt(double(slots)) - 1e-9)));
+        ay = std::min(per_axis, int(std::ceil(std::sqrt(double((slots + ax - 1) / ax)) - 1e-9)));
+        az = std::min(per_axis, int((slots + size_t(ax) * ay - 1) / (size_t(ax) * ay)));
+        slot_brick.assign(size_t(ax) * ay * az, -1);
+        brick_slot.assign(bricks.count(), -1);
+        wanted_stamp.assign(bricks.count(), 0);
+        glGenTextures(1, &atlas);
+        glBindTexture(GL_TEXTURE_3D, atlas);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_R8, ax * volume_bricks::stored, ay * volume_bricks::stored,
+                     az * volume_bricks::stored, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+
+        page.assign(size_t(bricks.count()) * 4, 0);
+        page_tex = make_uint_texture(GL_RGBA8UI, GL_RGBA_INTEGER, bricks.bx, bricks.by, bricks.bz, page.data());
+        glGenTextures(1, &transfer_tex);
+        set_transfer("viridis", 0.1f, 1.0f, 0.05f);
+        glBindTexture(GL_TEXTURE_3D, 0);
+        streamer.start(*src, grid, bricks);
+        std::printf("volume %dx%dx%d, %d bricks, atlas %d slots (%.0f MiB), %dx%dx%d macrocells\n",
+                    src->nx, src->ny, src->nz, bricks.count(), ax * ay * az,
+                    ax * ay * az * double(volume_bricks::stored_bytes) / (1 << 20), grid.cx, grid.cy, grid.cz);
+        return true;
+    }
+    // Colormap over normalized values; opacity ramps from 0 at lo to `opacity` at hi
+    // (per voxel of path length). Rebuilds the occupancy used for empty-space skipping.
+    void set_transfer(const std::string& colormap, float lo, float hi, float opacity)
+    {
+        const auto& cmap = get_colormap_color(colormap);
+        std::array<uint8_t, 256 * 4> tf;
+        std::array<float, 257> sum{};
+        for(int i = 0; i < 256; ++i){
+            const float v = i / 255.0f;
+            const float a = v < lo ? 0.0f : opacity * std::min(1.0f, (v - lo) / std::max(1e-6f, hi - lo));
+            tf[i * 4 + 0] = cmap[i][0];
+            tf[i * 4 + 1] = cmap[i][1];
+            tf[i * 4 + 2] = cmap[i][2];
+            tf[i * 4 + 3] = uint8_t(std::min(255.0f, a * 255.0f + 0.5f));
+            sum[i + 1] = sum[i] + tf[i * 4 + 3];
+        }
+        glBindTexture(GL_TEXTURE_2D, transfer_tex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 256, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, tf.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        occupancy.resize(grid.lo.size());
+        for(size_t i = 0; i < occupancy.size(); ++i)
+            occupancy[i] = sum[grid.hi[i] + 1] - sum[grid.lo[i]] > 0;
+        if(occupancy_tex) glDeleteTextures(1, &occupancy_tex);
+        occupancy_tex = make_uint_texture(GL_R8UI, GL_RED_INTEGER, grid.cx, grid.cy, grid.cz, occupancy.data());
+        occupied.clear();
+        for(int id = 0; id < bricks.count(); ++id)
+            if(bricks.occupied(grid, occupancy, id)) occupied.push_back(id);
+        dirty_view = true;
+    }
+    void render(const view3d& view, int width, int height)
+    {
+        stream(view);
+        const float m = float(std::max({src->nx, src->ny, src->nz}));
+        glViewport(0, 0, width, height);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glUseProgram(program);
+        glUniform3fv(glGetUniformLocation(program, "uEye"), 1, view.eye);
+        glUniform3fv(glGetUniformLocation(program, "uForward"), 1, view.forward);
+        glUniform3fv(glGetUniformLocation(program, "uRight"), 1, view.right);
+        glUniform3fv(glGetUniformLocation(program, "uUp"), 1, view.up);
+        glUniform2f(glGetUniformLocation(program, "uTan"), view.tan_half_fov * view.aspect, view.tan_half_fov);
+        glUniform3f(glGetUniformLocation(program, "uHalf"), 0.5f * src->nx / m, 0.5f * src->ny / m, 0.5f * src->nz / m);
+        glUniform3f(glGetUniformLocation(program, "uDims"), float(src->nx), float(src->ny), float(src->nz));
+        glUniform3f(glGetUniformLocation(program, "uAtlasSize"), float(ax * volume_bricks::stored),
+                    float(ay * volume_bricks::stored), float(az * volume_bricks::stored));
+        glUniform1f(glGetUniformLocation(program, "uStep"), step);
+        const GLuint tex[4] = {atlas, page_tex, occupancy_tex, transfer_tex};
+        const GLenum target[4] = {GL_TEXTURE_3D, GL_TEXTURE_3D, GL_TEXTURE_3D, GL_TEXTURE_2D};
+        const char* name[4] = {"uAtlas", "uPage", "uOccupancy", "uTransfer"};
+        for(int i = 0; i < 4; ++i){
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(target[i], tex[i]);
+            glUniform1i(glGetUniformLocation(program, name[i]), i);
+        }
+        glBindVertexArray(vao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        for(int i = 3; i >= 0; --i){
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(target[i], 0);
+        }
+        glUseProgram(0);
+        glDisable(GL_BLEND);
+    }
+    void release()
+    {
+        streamer.stop();
+        const GLuint tex[4] = {atlas, page_tex, occupancy_tex, transfer_tex};
+        glDeleteTextures(4, tex);
+        glDeleteVertexArrays(1, &vao);
+        glDeleteProgram(program);
+        atlas = page_tex = occupancy_tex = transfer_tex = vao = program = 0;
+    }
+    int resident() const
+    {
+        return resident_count;
+    }
+    size_t streamed_bytes() const
+    {
+        return streamer.bytes_read();
+    }
+private:
+    static GLuint make_uint_texture(GLenum internal, GLenum format, int w, int h, int d, const void* data)
+    {
+        GLuint t = 0;
+        glGenTextures(1, &t);
+        glBindTexture(GL_TEXTURE_3D, t);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage3D(GL_TEXTURE_3D, 0, internal, w, h, d, 0, format, GL_UNSIGNED_BYTE, data);
+        glBindTexture(GL_TEXTURE_3D, 0);
+        return t;
+    }
+    // wanted = occupied bricks nearest to the eye, as many as the atlas holds
+    void stream(const view3d& view)
+    {
+        const float m = float(std::max({src->nx, src->ny, src->nz}));
+        if(dirty_view || std::memcmp(view.eye, last_eye, sizeof(last_eye))){
+            dirty_view = false;
+            std::memcpy(last_eye, view.eye, sizeof(last_eye));
+            ++frame;
+            // eye in voxel coordinates
+            const float e[3] = {view.eye[0] * m + 0.5f * src->nx, view.eye[1] * m + 0.5f * src->ny, view.eye[2] * m + 0.5f * src->nz};
+            std::vector<std::pair<float, int>> order;
+            order.reserve(occupied.size());
+            for(int id : occupied){
+                const float cx = ((id % bricks.bx) + 0.5f) * volume_bricks::brick - e[0];
+                const float cy = ((id / bricks.bx % bricks.by) + 0.5f) * volume_bricks::brick - e[1];
+                const float cz = ((id / (bricks.bx * bricks.by)) + 0.5f) * volume_bricks::brick - e[2];
+                order.emplace_back(cx * cx + cy * cy + cz * cz, id);
+            }
+            const size_t keep = std::min(order.size(), slot_brick.size());
+            std::partial_sort(order.begin(), order.begin() + keep, order.end());
+            std::vector<int> missing;
+            for(size_t i = 0; i < keep; ++i){
+                wanted_stamp[order[i].second] = frame;
+                if(brick_slot[order[i].second] < 0) missing.push_back(order[i].second);
+            }
+            streamer.request(missing);
+        }
+        int id;
+        for(int n = 0; n < max_uploads && streamer.pop(id, staging); ++n){
+            if(wanted_stamp[id] != frame || brick_slot[id] >= 0) continue;
+            const int slot = free_slot();
+            if(slot < 0) break;
+            const int sx = slot % ax, sy = slot / ax % ay, sz = slot / (ax * ay);
+            glBindTexture(GL_TEXTURE_3D, atlas);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexSubImage3D(GL_TEXTURE_3D, 0, sx * volume_bricks::stored, sy * volume_bricks::stored,
+                            sz * volume_bricks::stored, volume_bricks::stored, volume_bricks::stored,
+                            volume_bricks::stored, GL_RED, GL_UNSIGNED_BYTE, staging.data());
+            slot_brick[slot] = id;
+            brick_slot[id] = slot;
+            ++resident_count;
+            set_page(id, sx, sy, sz, 1);
+        }
+        glBindTexture(GL_TEXTURE_3D, 0);
+    }
+    // a free slot, or the slot of a brick that is no longer wanted
+    int free_slot()
+    {
+        for(size_t i = 0; i < slot_brick.size(); ++i){
+            const size_t s = (next_slot + i) % slot_brick.size();
+            const int b = slot_brick[s];
+            if(b >= 0 && wanted_stamp[b] == frame) continue;
+            if(b >= 0){
+                brick_slot[b] = -1;
+                --resident_count;
+                set_page(b, 0, 0, 0, 0);
+            }
+            next_slot = (s + 1) % slot_brick.size();
+            return int(s);
+        }
+        return -1;
+    }
+    void set_page(int id, int x, int y, int z, int resident)
+    {
+        uint8_t* p = &page[size_t(id) * 4];
+        p[0] = uint8_t(x); p[1] = uint8_t(y); p[2] = uint8_t(z); p[3] = uint8_t(resident);
+        glBindTexture(GL_TEXTURE_3D, page_tex);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage3D(GL_TEXTURE_3D, 0, id % bricks.bx, id / bricks.bx % bricks.by, id / (bricks.bx * bricks.by),
+                        1, 1, 1, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, p);
+        glBindTexture(GL_TEXTURE_3D, atlas);
+    }
+
+    volume_source* src = nullptr;
+    macrocell_grid grid;
+    volume_bricks bricks;
+    brick_streamer streamer;
+    GLuint program = 0, vao = 0, atlas = 0, page_tex = 0, occupancy_tex = 0, transfer_tex = 0;
+    int ax = 1, ay = 1, az = 1;
+    std::vector<int> slot_brick, brick_slot;
+    std::vector<uint32_t> wanted_stamp;
+    std::vector<uint8_t> page, occupancy, staging;
+    std::vector<int> occupied;
+    uint32_t frame = 0;
+    size_t next_slot = 0;
+    int resident_count = 0;
+    float last_eye[3] = {};
+    bool dirty_view = true;
+};
@@ -0,0 +1,15 @@
+#pragma once
+#include <stdexcept>
+#include <string>
+
+// Numeric command line argument for the headless tools. The whole argument has to be a
+// number: "--fps x" or a width of "4x" throws std::invalid_argument, which the tools turn
+// into exit code 2.
+inline double parse_number(const char* s)
+{
+    size_t used = 0;
+    double v = 0;
+    try{ v = std::stod(s, &used); } catch(const std::exception&){}
+    if(0 == used || s[used]) throw std::invalid_argument(std::string("not a number: ") + s);
+    return v;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "glfw_window_2d.h"
+#include "2d/image_diff.hpp"
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+// image_2d's synthetic scene: a scalar field with contours, a second channel composited over it
+// through a colormap, a perturbed re-run for the A/B comparison and its spectrum. Shared with
+// trace_replay so a recorded session replays over the same content.
+inline void build_demo_scene(glfw_window_2d& win, instrumentation& stats, texture_format fmt)
+{
+    constexpr int N = 2048;
+    std::vector<float> field(N * N);
+    for(int y = 0; y < N; ++y)
+        for(int x = 0; x < N; ++x)
+            field[y * N + x] = std::sin(x * 0.02f) * std::cos(y * 0.013f) * 100.0f + 20.0f;
+    win.append_texture(field.data(), N, N, fmt);
+    win.contours().set_field(field.data(), N, N);
+    for(float level : {-60.0f, 20.0f, 100.0f})
+        win.contours().add_level(level, rgba(255, 64, 64));
+    printf("contours: %.2f ms per level\n", win.contours().last_ms());
+    // a second channel added on top of the field through a colormap
+    std::vector<float> spot(N * N);
+    for(int y = 0; y < N; ++y)
+        for(int x = 0; x < N; ++x)
+            spot[y * N + x] = std::exp(-((x - 700.0f) * (x - 700.0f) + (y - 1200.0f) * (y - 1200.0f)) / 40000.0f);
+    win.append_texture(spot.data(), N, N, fmt);
+    win.layers().add(0);
+    win.layers().add(1, blend_mode::additive, 0.8f, "magma");
+    // a "re-run" of the field with a local error, compared against the original
+    std::vector<float> rerun(field);
+    for(int y = 900; y < 1100; ++y)
+        for(int x = 1400; x < 1600; ++x)
+            rerun[y * N + x] += 2.0f * std::sin(x * 0.3f) * std::sin(y * 0.3f);
+    win.append_texture(rerun.data(), N, N, fmt);
+    win.compare().set(0, 2, compare_view::off).set_diff_range(2.0f);
+    const diff_stats d = compare_images(field.data(), rerun.data(), field.size(), 0.5f);
+    d.publish(stats, "compare");
+    printf("compare: max abs %g, rmse %g, psnr %.1f dB, %zu mismatches\n", d.max_abs, d.rmse, d.psnr, d.mismatches);
+    // F shows the spectrum of the re-run around its local error, P its phase
+    win.spectrum().set_field(rerun.data(), N, N);
+    const double full_ms = win.spectrum().last_ms();
+    win.spectrum().set_roi(1280, 768, 512, 512);
+    printf("spectrum: %.2f ms whole field, %.2f ms ROI\n", full_ms, win.spectrum().last_ms());
+}
@@ -0,0 +1,270 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <vector>
+#include "instrumentation.h"
+#include "mapped_file.hpp"
+
+// One cache entry: blobs addressed by a 64-bit id, written once, then memory-mapped.
+//   header  { "DTCACHE1", uint32 version, uint32 count, uint64 index offset }
+//   blobs   each starting on a 64-byte boundary
+//   index   count x { uint64 id, offset, bytes }, sorted by id
+// Opening only reads the header and the index; blob pages are faulted in when touched.
+struct cache_blob
+{
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    explicit operator bool() const { return nullptr != data; }
+};
+
+struct cache_file
+{
+    static constexpr uint32_t version = 1;
+    struct header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t count;
+        uint64_t index_offset;
+    };
+    struct entry
+    {
+        uint64_t id, offset, bytes;
+    };
+
+    bool open(const std::string& path)
+    {
+        index = nullptr;
+        count = 0;
+        if(!file.open(path)) return false;
+        header h;
+        if(file.size() < sizeof(h)) return fail(path);
+        std::memcpy(&h, file.data(), sizeof(h));
+        if(std::memcmp(h.magic, "DTCACHE1", 8) || h.version != version) return fail(path);
+        if(h.index_offset > file.size() || (file.size() - h.index_offset) / sizeof(entry) < h.count) return fail(path);
+        index = reinterpret_cast<const entry*>(file.data() + h.index_offset);
+        count = h.count;
+        return true;
+    }
+    cache_blob find(uint64_t id) const
+    {
+        const entry* e = std::lower_bound(index, index + count, id, [](const entry& a, uint64_t b){ return a.id < b; });
+        if(e == index + count || e->id != id || e->offset + e->bytes > file.size()) return {};
+        return {file.data() + e->offset, size_t(e->bytes)};
+    }
+    // copy a blob of T; false when missing or of the wrong size (n = 0 accepts any size)
+    template<class T> bool read(uint64_t id, std::vector<T>& out, size_t n = 0) const
+    {
+        const cache_blob b = find(id);
+        if(!b || b.size % sizeof(T) || (n && b.size != n * sizeof(T))) return false;
+        out.resize(b.size / sizeof(T));
+        if(b.size) std::memcpy(out.data(), b.data, b.size);
+        return true;
+    }
+    bool valid() const { return nullptr != index; }
+private:
+    bool fail(const std::string& path)
+    {
+        std::cerr << path << ": not a cache file of this version\n";
+        file.close();
+        return false;
+    }
+    mapped_file file;
+    const entry* index = nullptr;
+    uint32_t count = 0;
+};
+
+// Streams blobs into a temporary file; finish() appends the index and renames it into place,
+// so readers never see a partial entry.
+struct cache_writer
+{
+    cache_writer() = default;
+    cache_writer(const cache_writer&) = delete;
+    cache_writer& operator=(const cache_writer&) = delete;
+    ~cache_writer()
+    {
+        if(f){
+            std::fclose(f);
+            std::remove(tmp.c_str());
+        }
+    }
+    bool open(const std::string& target)
+    {
+        path = target;
+        tmp = target + ".tmp" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+        f = std::fopen(tmp.c_str(), "wb");
+        if(!f){ std::cerr << "can not write " << tmp << "\n"; return false; }
+        const cache_file::header h{};
+        std::fwrite(&h, sizeof(h), 1, f);
+        pos = sizeof(h);
+        return true;
+    }
+    void add(uint64_t id, const void* data, size_t bytes)
+    {
+        if(!f) return;
+        align();
+        index.push_back({id, pos, bytes});
+        if(bytes && std::fwrite(data, 1, bytes, f) != bytes) ok = false;
+        pos += bytes;
+    }
+    template<class T> void add(uint64_t id, const std::vector<T>& v)
+    {
+        add(id, v.data(), v.size() * sizeof(T));
+    }
+    bool finish()
+    {
+        if(!f) return false;
+        std::sort(index.begin(), index.end(), [](const cache_file::entry& a, const cache_file::entry& b){ return a.id < b.id; });
+        align();
+        cache_file::header h{};
+        std::memcpy(h.magic, "DTCACHE1", 8);
+        h.version = cache_file::version;
+        h.count = uint32_t(index.size());
+        h.index_offset = pos;
+        if(!index.empty() && std::fwrite(index.data(), sizeof(index[0]), index.size(), f) != index.size()) ok = false;
+        std::fseek(f, 0, SEEK_SET);
+        std::fwrite(&h, sizeof(h), 1, f);
+        ok = std::fclose(f) == 0 && ok;
+        f = nullptr;
+        std::error_code ec;
+        if(ok) std::filesystem::rename(tmp, path, ec);
+        if(!ok || ec){
+            std::cerr << "can not write cache entry " << path << "\n";
+            std::filesystem::remove(tmp, ec);
+            return false;
+        }
+        return true;
+    }
+    size_t bytes() const { return pos; }
+private:
+    void align()
+    {
+        static const uint8_t zeros[64] = {};
+        const size_t pad = (64 - pos % 64) % 64;
+        std::fwrite(zeros, 1, pad, f);
+        pos += pad;
+    }
+    std::FILE* f = nullptr;
+    std::string path, tmp;
+    std::vector<cache_file::entry> index;
+    uint64_t pos = 0;
+    bool ok = true;
+};
+
+// Directory of cache entries named by a hash of the source file's identity and the processing
+// parameters. Opening an entry refreshes its mtime; commit() evicts least recently opened
+// entries beyond the size cap. Directory: DISPLAY_TOOL_CACHE or ~/.cache/display_tool,
+// cap: DISPLAY_TOOL_CACHE_MB (default 8192, 0 disables the cache).
+struct disk_cache
+{
+    explicit disk_cache(instrumentation* stats = nullptr) : stats(stats)
+    {
+        const char* d = std::getenv("DISPLAY_TOOL_CACHE");
+        const char* home = std::getenv("HOME");
+#ifdef _WIN32
+        if(!home) home = std::getenv("LOCALAPPDATA");
+#endif
+        dir = d ? d : home ? std::string(home) + "/.cache/display_tool" : "display_tool_cache";
+        const char* mb = std::getenv("DISPLAY_TOOL_CACHE_MB");
+        cap = (mb ? size_t(std::atoll(mb)) : 8192) << 20;
+    }
+    // "" for synthetic data keys on the parameters alone; "" is returned when the source is missing
+    static std::string key(const std::string& source, const std::string& params)
+    {
+        std::string id;
+        if(!source.empty()){
+            namespace fs = std::filesystem;
+            std::error_code ec;
+            const fs::path p = fs::canonical(source, ec);
+            if(ec) return "";
+            const auto size = fs::file_size(p, ec);
+            const auto mtime = fs::last_write_time(p, ec);
+            if(ec) return "";
+            id = p.string() + "|" + std::to_string(size) + "|" + std::to_string(mtime.time_since_epoch().count());
+        }
+        id += "|" + params;
+        uint64_t h = 1469598103934665603ull;  // FNV-1a
+        for(unsigned char c : id) h = (h ^ c) * 1099511628211ull;
+        char name[17];
+        std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)h);
+        return name;
+    }
+    bool open(const std::string& key, cache_file& out)
+    {
+        if(0 == cap || key.empty()) return false;
+        const auto t0 = std::chrono::steady_clock::now();
+        std::error_code ec;
+        const std::filesystem::path p = entry(key);
+        if(!std::filesystem::exists(p, ec) || !out.open(p.string())){
+            count("cache.misses");
+            return false;
+        }
+        std::filesystem::last_write_time(p, std::filesystem::file_time_type::clock::now(), ec);
+        count("cache.hits");
+        if(stats) stats->set("cache.open_ms", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+        return true;
+    }
+    bool create(const std::string& key, cache_writer& w)
+    {
+        if(0 == cap || key.empty()) return false;
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+        return w.open(entry(key).string());
+    }
+    bool commit(cache_writer& w)
+    {
+        const bool ok = w.finish();
+        if(ok && stats) stats->add("cache.written_mb", w.bytes() / double(1 << 20));
+        trim();
+        return ok;
+    }
+    // drop least recently opened entries until the directory fits the cap
+    void trim()
+    {
+        namespace fs = std::filesystem;
+        struct item { fs::path path; fs::file_time_type used; uintmax_t bytes; };
+        std::vector<item> items;
+        uintmax_t total = 0;
+        std::error_code ec;
+        for(const auto& e : fs::directory_iterator(dir, ec)){
+            if(e.path().extension() != ".dtc") continue;
+            item i{e.path(), e.last_write_time(ec), e.file_size(ec)};
+            if(ec) continue;
+            total += i.bytes;
+            items.push_back(std::move(i));
+        }
+        std::sort(items.begin(), items.end(), [](const item& a, const item& b){ return a.used < b.used; });
+        for(const auto& i : items){
+            if(total <= cap) break;
+            if(fs::remove(i.path, ec)){
+                total -= i.bytes;
+                count("cache.evictions");
+            }
+        }
+        if(stats) stats->set("cache.size_mb", total / double(1 << 20));
+    }
+    std::string entry_path(const std::string& key) const
+    {
+        return entry(key).string();
+    }
+    std::string dir;
+    size_t cap;
+private:
+    std::filesystem::path entry(const std::string& key) const
+    {
+        return std::filesystem::path(dir) / (key + ".dtc");
+    }
+    void count(const char* what)
+    {
+        if(stats) stats->add(what);
+    }
+    instrumentation* stats;
+};
@@ -0,0 +1,61 @@
+#include "2d/fft2d.hpp"
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+// 2D FFT of a real N x N field: the textbook row/column transform (one thread, strided
+// columns) against the blocked SIMD one behind the spectrum view (all hardware threads).
+// usage: fft_bench [size=2048] [repeat=5]
+int main(int argc, char** argv)
+{
+    const int N = fft_size_for(argc > 1 ? std::stoi(argv[1]) : 2048);
+    const int repeat = argc > 2 ? std::stoi(argv[2]) : 5;
+    const size_t n = size_t(N) * N;
+    std::vector<float> field(n);
+    parallel_for(0, N, [&](int b, int e){
+        for(int y = b; y < e; ++y)
+            for(int x = 0; x < N; ++x)
+                field[size_t(y) * N + x] = std::sin(x * 0.01f) * std::cos(y * 0.007f) + 0.1f * std::sin(x * y * 1e-5f);
+    });
+
+    using clock = std::chrono::high_resolution_clock;
+    auto ms = [](clock::duration d){ return std::chrono::duration<double, std::milli>(d).count(); };
+
+    double naive = 1e30;
+    std::vector<float> nre, nim;
+    for(int r = 0; r < repeat; ++r){
+        nre = field;
+        nim.assign(n, 0.0f);
+        auto t0 = clock::now();
+        fft2d_naive(nre, nim, N, N);
+        naive = std::min(naive, ms(clock::now() - t0));
+    }
+
+    double fast = 1e30;
+    fft_plan plan;
+    plan.init(N);
+    std::vector<float> rre(n), rim(n), re(n), im(n);
+    for(int r = 0; r < repeat; ++r){
+        auto t0 = clock::now();
+        parallel_for(0, N, [&](int b, int e){
+            fft2d_rows(plan, field.data(), size_t(N), N, nullptr, b, e, &rre[size_t(b) * N], &rim[size_t(b) * N]);
+        }, 8);
+        fft2d_columns(plan, rre.data(), rim.data(), N, N, nullptr, re.data(), im.data());
+        fast = std::min(fast, ms(clock::now() - t0));
+    }
+
+    // the blocked transform comes out transposed
+    double err = 0, peak = 0;
+    for(int y = 0; y < N; ++y)
+        for(int x = 0; x < N; ++x){
+            const size_t a = size_t(y) * N + x, b = size_t(x) * N + y;
+            err = std::max(err, double(std::hypot(nre[a] - re[b], nim[a] - im[b])));
+            peak = std::max(peak, double(std::hypot(nre[a], nim[a])));
+        }
+    std::printf("%dx%d, best of %d\n", N, N, repeat);
+    std::printf("%-8s %10s %10s\n", "", "time(ms)", "speedup");
+    std::printf("%-8s %10.2f %9.2fx\n", "naive", naive, 1.0);
+    std::printf("%-8s %10.2f %9.2fx\n", "blocked", fast, naive / fast);
+    std::printf("max error %.3g of the peak magnitude %.3g\n", err / peak, peak);
+    return 0;
+}
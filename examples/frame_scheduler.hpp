@@ -0,0 +1,119 @@
+#pragma once
+#ifdef __APPLE__
+#   include <OpenGL/gl3.h>
+#else
+#   include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include "glfw_initializer.h"
+
+inline int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Presentation scheduler of one render thread:
+// - frames start on fixed deadlines (no drift), reached by sleeping to within
+//   spin_margin and spinning the rest, since sleep_for alone overshoots by ~1 ms;
+// - swap interval follows present_mode;
+// - glFinish after the swap keeps the driver from queueing frames ahead;
+// - input-event-to-swap latency of every frame that carries a new input.
+struct frame_scheduler
+{
+    using clock = std::chrono::steady_clock;
+
+    frame_scheduler& set_max_fps(int fps)
+    {
+        period = fps > 0 ? std::chrono::nanoseconds(1000000000LL / fps) : std::chrono::nanoseconds(0);
+        next = clock::now();
+        return *this;
+    }
+    // any thread; applied by the render thread before the next frame
+    void request_mode(present_mode m)
+    {
+        requested.store(int(m));
+    }
+    // render thread, context current
+    void begin_frame()
+    {
+        const int m = requested.load();
+        if(m != applied && has_context){
+            applied = m;
+            switch(present_mode(m)){
+                case present_mode::vsync: glfwSwapInterval(1); break;
+                case present_mode::immediate: glfwSwapInterval(0); break;
+                case present_mode::adaptive:
+                    // late frames tear instead of waiting a whole refresh
+                    glfwSwapInterval(glfwExtensionSupported("WGL_EXT_swap_control_tear") ||
+                                     glfwExtensionSupported("GLX_EXT_swap_control_tear") ? -1 : 1);
+                    break;
+            }
+        }
+        wait_for_deadline();
+    }
+    // right after glfwSwapBuffers; input_ns is the timestamp carried by the camera snapshot
+    void presented(int64_t input_ns)
+    {
+        if(finish_after_swap && has_context) glFinish();
+        const int64_t t = now_ns();
+        if(input_ns > last_input_ns){
+            last_input_ns = input_ns;
+            const double ms = (t - input_ns) * 1e-6;
+            latency_sum += ms;
+            latency_max = std::max(latency_max, ms);
+            ++latency_frames;
+        }
+    }
+    // publish and reset the window of latency samples
+    void publish(instrumentation& stats, const std::string& prefix)
+    {
+        if(latency_frames){
+            stats.set(prefix + ".input_to_swap_ms", latency_sum / latency_frames);
+            stats.set(prefix + ".input_to_swap_max_ms", latency_max);
+        }
+        stats.set(prefix + ".spin_margin_ms", spin_margin.count() * 1e-6);
+        latency_sum = latency_max = 0;
+        latency_frames = 0;
+    }
+
+    bool finish_after_swap = true;
+    bool has_context = true;  // false: headless, deadline pacing only
+
+private:
+    void wait_for_deadline()
+    {
+        if(period.count() == 0) return;
+        next += period;
+        auto now = clock::now();
+        if(next < now - period){
+            next = now;  // fell behind by more than a frame: resync instead of bursting
+            return;
+        }
+        if(next - now > spin_margin){
+            const auto target = next - spin_margin;
+            std::this_thread::sleep_until(target);
+            // learn the scheduler's oversleep, keep the margin within [0.2, 4] ms
+            const auto over = clock::now() - target;
+            spin_margin = std::clamp<std::chrono::nanoseconds>(
+                (spin_margin * 7 + std::chrono::duration_cast<std::chrono::nanoseconds>(over) * 2) / 8,
+                std::chrono::microseconds(200), std::chrono::microseconds(4000));
+        }
+        while(clock::now() < next) std::this_thread::yield();
+    }
+
+    std::chrono::nanoseconds period{0};
+    std::chrono::nanoseconds spin_margin{std::chrono::milliseconds(1)};
+    clock::time_point next = clock::now();
+    std::atomic<int> requested{int(present_mode::vsync)};
+    int applied = int(present_mode::vsync);  // set_fps_ratio(1) in loop()
+    int64_t last_input_ns = 0;
+    double latency_sum = 0, latency_max = 0;
+    int latency_frames = 0;
+};
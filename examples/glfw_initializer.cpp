@@ -7,22 +7,27 @@
 
 #include "glfw_initializer.h"
 #include "glfw_window_2d.h"
-#include <assert.h>
 #include <iostream>
 
 glfw_initializer::glfw_initializer() : is_init(glfwInit())
 {
+    job_system::install(&jobs);
+    // without a display only window_type::software (headless) can be created
     if(!is_init){
         std::cerr<<"glfw init failed\n";
     }
-    assert(is_init);
 }
 glfw_initializer::~glfw_initializer()
 {
+    // windows must go before glfwTerminate() and before the resource manager
+    windows.clear();
     glfwTerminate();
+    job_system::install(nullptr);
 }
-glfw_window& glfw_initializer::create2d(window_type t)
+glfw_window_2d& glfw_initializer::create2d(window_type t)
 {
-    windows.push_back(std::make_unique<glfw_window_2d>(t));
-    return *windows.back();
+    auto w = std::make_unique<glfw_window_2d>(t, *this);
+    glfw_window_2d& ref = *w;
+    windows.push_back(std::move(w));
+    return ref;
 }
\ No newline at end of file
@@ -1,12 +1,23 @@
 #pragma once
 #include <vector>
 #include <memory>
+#include "instrumentation.h"
+#include "resource_manager.h"
+#include "job_system.hpp"
 
 enum class window_type : int
 {
     pipline,
     shader,
+    software,   // CPU tile renderer, headless without a display
 };
+enum class present_mode : int
+{
+    vsync,      // swap interval 1
+    adaptive,   // swap interval -1 if tearing on late frames is supported
+    immediate,  // swap interval 0, lowest latency, may tear
+};
+struct glfw_window_2d;
 struct glfw_window
 {
     virtual glfw_window& async_loop(int maxFPS) = 0;
@@ -17,6 +28,10 @@ struct glfw_initializer
     const bool is_init;
     glfw_initializer();
     ~glfw_initializer();
-    glfw_window& create2d(window_type t = window_type::pipline);
+    glfw_window_2d& create2d(window_type t = window_type::pipline);
+    // CPU data work of every window; parallel_for() runs here while the initializer lives
+    job_system jobs;
+    instrumentation stats;
+    resource_manager resources{stats};
     std::vector<std::unique_ptr<glfw_window>> windows;
 };
\ No newline at end of file
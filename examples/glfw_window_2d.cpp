@@ -1,53 +1,123 @@
 #include "glfw_window_2d.h"
 #include "2d/glfw_window2d_GL_v21.hpp"
 #include "2d/glfw_window2d_GL_v33.hpp"
+#include "2d/glfw_window2d_sw.hpp"
 
-glfw_window2d_GL_v21* real_ptr21(void*p)
+// call f with the backend behind the union
+template<class F> static void dispatch(glfw_window_2d& w, F&& f)
 {
-    return reinterpret_cast<glfw_window2d_GL_v21*>(p);
-}
-glfw_window2d_GL_v33* real_ptr33(void*p)
-{
-    return reinterpret_cast<glfw_window2d_GL_v33*>(p);
+    switch(w.t){
+        case window_type::pipline:  f(*w.p.v21); break;
+        case window_type::shader:   f(*w.p.v33); break;
+        case window_type::software: f(*w.p.sw);  break;
+    }
 }
-glfw_window_2d::glfw_window_2d(window_type type) : t(type)
+
+glfw_window_2d::glfw_window_2d(window_type type, glfw_initializer& owner) : t(type)
 {
+    if(!owner.is_init && t != window_type::software){
+        printf("no display, fall back to the software renderer\n");
+        t = window_type::software;
+    }
     if(t == window_type::pipline){
-        p.v21 = new glfw_window2d_GL_v21;
+        p.v21 = new glfw_window2d_GL_v21(owner);
         printf("use OpenGL2.1\n");
     }
-    else{
-        p.v33 = new glfw_window2d_GL_v33;
+    else if(t == window_type::shader){
+        p.v33 = new glfw_window2d_GL_v33(owner);
         printf("use OpenGL3.3\n");
     }
+    else{
+        p.sw = new glfw_window2d_sw(owner);
+        printf("use software renderer\n");
+    }
 }
 glfw_window_2d::~glfw_window_2d()
 {
-    if(t == window_type::pipline){
-        delete p.v21;
-    }
-    else{
-        delete p.v33;
-    }
+    dispatch(*this, [](auto& w){ delete &w; });
 }
 
 glfw_window& glfw_window_2d::async_loop(int maxFPS) 
 {
-    if(t == window_type::pipline){
-        p.v21->async_loop(maxFPS);
-    }
-    else{
-        p.v33->async_loop(maxFPS);
-    }
+    dispatch(*this, [&](auto& w){ w.async_loop(maxFPS); });
     return *this;
 }
 glfw_window& glfw_window_2d::event_loop()
 {
-    if(t == window_type::pipline){
-        p.v21->event_loop();
-    }
-    else{
-        p.v33->event_loop();
+    dispatch(*this, [](auto& w){ w.event_loop(); });
+    return *this;
+}
+glfw_window_2d& glfw_window_2d::append_texture(const float* data, int xsize, int ysize, texture_format fmt)
+{
+    dispatch(*this, [&](auto& w){ w.append_texture(data, xsize, ysize, fmt); });
+    return *this;
+}
+glfw_window_2d& glfw_window_2d::append_texture(const uint8_t* rgb, int xsize, int ysize, texture_format fmt)
+{
+    dispatch(*this, [&](auto& w){ w.append_texture(rgb, xsize, ysize, fmt); });
+    return *this;
+}
+glfw_window_2d& glfw_window_2d::append_texture(std::function<texture_image()> loader)
+{
+    dispatch(*this, [&](auto& w){ w.append_texture(std::move(loader)); });
+    return *this;
+}
+glfw_window_2d& glfw_window_2d::set_present_mode(present_mode m)
+{
+    dispatch(*this, [&](auto& w){ w.set_present_mode(m); });
+    return *this;
+}
+overlay_layer& glfw_window_2d::overlay()
+{
+    overlay_layer* layer = nullptr;
+    dispatch(*this, [&](auto& w){ layer = &w.overlay.layer; });
+    return *layer;
+}
+layer_stack& glfw_window_2d::layers()
+{
+    layer_stack* stack = nullptr;
+    dispatch(*this, [&](auto& w){ stack = &w.layers; });
+    return *stack;
+}
+compare_state& glfw_window_2d::compare()
+{
+    compare_state* state = nullptr;
+    dispatch(*this, [&](auto& w){ state = &w.compare; });
+    return *state;
+}
+spectrum_engine& glfw_window_2d::spectrum()
+{
+    spectrum_engine* engine = nullptr;
+    dispatch(*this, [&](auto& w){ engine = &w.spectrum; });
+    return *engine;
+}
+contour_engine& glfw_window_2d::contours()
+{
+    contour_engine* engine = nullptr;
+    dispatch(*this, [&](auto& w){ engine = &w.overlay.contours; });
+    return *engine;
+}
+frame_capture& glfw_window_2d::capture()
+{
+    frame_capture* sink = nullptr;
+    dispatch(*this, [&](auto& w){ sink = &w.capture; });
+    return *sink;
+}
+glfw_window_2d& glfw_window_2d::record_trace(const std::string& path, int scene)
+{
+    dispatch(*this, [&](auto& w){ w.cam.record(path, scene); });
+    return *this;
+}
+replay_stats glfw_window_2d::replay(const input_trace& trace, float fps, bool realtime)
+{
+    if(t != window_type::software){
+        std::cerr << "replay needs the software renderer\n";
+        return {};
     }
+    return p.sw->replay(trace, fps, realtime);
+}
+glfw_window_2d& glfw_window_2d::on_pick(std::function<void(overlay_id, bool click)> f)
+{
+    dispatch(*this, [&](auto& w){ w.overlay.on_pick = std::move(f); });
     return *this;
-}
\ No newline at end of file
+}
@@ -1,19 +1,54 @@
 #pragma once
 #include "glfw_initializer.h"
+#include "2d/texture_format.hpp"
+#include "2d/overlay.hpp"
+#include "2d/layer_stack.hpp"
+#include "2d/compare.hpp"
+#include "2d/spectrum.hpp"
+#include "2d/input_trace.hpp"
+#include "2d/capture.hpp"
+#include <functional>
 #include <variant>
 
 struct glfw_window2d_GL_v21;
 struct glfw_window2d_GL_v33;
+struct glfw_window2d_sw;
 
 struct glfw_window_2d : glfw_window
 {
-    glfw_window_2d(window_type t);
+    glfw_window_2d(window_type t, glfw_initializer& owner);
     ~glfw_window_2d();
     glfw_window& async_loop(int maxFPS = 30) override;
     glfw_window& event_loop() override;
+    glfw_window_2d& append_texture(const float* data, int xsize, int ysize, texture_format fmt = texture_format::r16f);
+    glfw_window_2d& append_texture(const uint8_t* rgb, int xsize, int ysize, texture_format fmt = texture_format::rgb8);
+    glfw_window_2d& append_texture(std::function<texture_image()> loader);
+    glfw_window_2d& set_present_mode(present_mode m);
+    // annotations drawn over the image, in image pixels; edits are thread-safe
+    overlay_layer& overlay();
+    // co-registered textures composited bottom to top; texture = append order. Thread-safe.
+    layer_stack& layers();
+    // A/B view of two textures (append order) under the same camera; C cycles the view,
+    // the right mouse button drags the split. Thread-safe.
+    compare_state& compare();
+    // 2D FFT of a scalar field or ROI: spectrum().set_field(...); F shows it instead of the
+    // image, P switches log magnitude / phase. Thread-safe.
+    spectrum_engine& spectrum();
+    // iso-lines of a scalar field: contours().set_field(...), then add_level()/set_level()
+    contour_engine& contours();
+    // screen recording and screenshots, encoded off the render thread: capture().start("a.y4m"),
+    // stop(), screenshot("a.png"); F10 toggles recording, F12 takes a screenshot. Thread-safe.
+    frame_capture& capture();
+    // log input events and camera changes to a binary trace; scene tells the replay what was shown
+    glfw_window_2d& record_trace(const std::string& path, int scene = -1);
+    // software windows only, instead of async_loop(): headless replay of a trace with per-frame timings
+    replay_stats replay(const input_trace& trace, float fps = 60.0f, bool realtime = false);
+    // hovered (click == false) or clicked annotation, -1 for none; called on the event thread
+    glfw_window_2d& on_pick(std::function<void(overlay_id, bool click)> f);
     union{
         glfw_window2d_GL_v21* v21;
         glfw_window2d_GL_v33* v33;
+        glfw_window2d_sw* sw;
     } p;
     window_type t;
 };
@@ -1,9 +1,24 @@
-#include "glfw_window_2d.h"
+#include "demo_scene.hpp"
+#include <cstdlib>
 #include <string>
 
-int main(int argc, char** argv) 
+// usage: image_2d [window_type] [texture_format|-1] [present_mode]
+// window_type: 0 OpenGL2.1, 1 OpenGL3.3, 2 software
+// with a texture_format a synthetic scalar field is displayed in that storage format,
+// with a second channel composited over it. C cycles an A/B comparison against a perturbed copy,
+// F shows its spectrum. F12 saves a screenshot, F10 starts/stops a recording.
+int main(int argc, char** argv)
 {
-    window_type type = argc == 1 ? window_type::pipline : (window_type)(std::stoi(argv[1])); 
-    glfw_initializer().create2d(type).async_loop(30).event_loop();
+    window_type type = argc == 1 ? window_type::pipline : (window_type)(std::stoi(argv[1]));
+    glfw_initializer init;
+    glfw_window_2d& win = init.create2d(type);
+    const int scene = argc > 2 ? std::stoi(argv[2]) : -1;
+    if(scene >= 0) build_demo_scene(win, init.stats, texture_format(scene));
+    // DISPLAY_TOOL_TRACE=file records the session for trace_replay
+    if(const char* trace = std::getenv("DISPLAY_TOOL_TRACE")) win.record_trace(trace, scene);
+    // DISPLAY_TOOL_RECORD=file.y4m records the screen from the first frame
+    if(const char* video = std::getenv("DISPLAY_TOOL_RECORD")) win.capture().start(video);
+    if(argc > 3) win.set_present_mode((present_mode)(std::stoi(argv[3])));
+    win.async_loop(argc > 3 ? 240 : 30).event_loop();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,91 @@
+#include "2d/image_diff.hpp"
+#include "cli_args.hpp"
+#include "mapped_file.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+// Headless A/B check of two raw images, for CI. Exit code 1 when a threshold is exceeded,
+// 2 on bad input.
+// usage: image_diff reference.raw test.raw width height [f32|u16|u8]
+//            [--tol t] [--peak p] [--max-abs x] [--max-rmse x] [--min-psnr db] [--max-mismatch n]
+int main(int argc, char** argv)
+{
+    if(argc < 5){
+        std::cerr << "usage: image_diff reference.raw test.raw width height [f32|u16|u8]\n"
+                     "           [--tol t] [--peak p] [--max-abs x] [--max-rmse x] [--min-psnr db] [--max-mismatch n]\n";
+        return 2;
+    }
+    size_t w = 0, h = 0;
+    std::string type = "f32";
+    float tol = 0.0f;
+    double peak = 0.0, max_abs = -1, max_rmse = -1, min_psnr = -1, max_mismatch = -1;
+    try{
+        const double dw = parse_number(argv[3]), dh = parse_number(argv[4]);
+        if(dw < 1 || dh < 1 || dw != std::floor(dw) || dh != std::floor(dh))
+            throw std::invalid_argument("width and height must be positive integers");
+        w = size_t(dw);
+        h = size_t(dh);
+        for(int i = 5; i < argc; ++i){
+            const std::string a = argv[i];
+            auto value = [&]{
+                if(i + 1 >= argc) throw std::invalid_argument(a + " needs a value");
+                return parse_number(argv[++i]);
+            };
+            if(a == "--tol") tol = float(value());
+            else if(a == "--peak") peak = value();
+            else if(a == "--max-abs") max_abs = value();
+            else if(a == "--max-rmse") max_rmse = value();
+            else if(a == "--min-psnr") min_psnr = value();
+            else if(a == "--max-mismatch") max_mismatch = value();
+            else if(a == "f32" || a == "u16" || a == "u8") type = a;
+            else { std::cerr << "unknown argument " << a << "\n"; return 2; }
+        }
+    }
+    catch(const std::exception& e){
+        std::cerr << "bad argument: " << e.what() << "\n";
+        return 2;
+    }
+    const size_t elem = type == "f32" ? 4 : type == "u16" ? 2 : 1;
+    const size_t n = w * h;
+
+    mapped_file ref(argv[1]), test(argv[2]);
+    if(ref.size() < n * elem || test.size() < n * elem){
+        std::cerr << "files smaller than " << w << "x" << h << " " << type << "\n";
+        return 2;
+    }
+    ref.sequential();
+    test.sequential();
+
+    using clock = std::chrono::high_resolution_clock;
+    const auto t0 = clock::now();
+    diff_stats s;
+    if(elem == 4)      s = compare_images(reinterpret_cast<const float*>(ref.data()), reinterpret_cast<const float*>(test.data()), n, tol, peak);
+    else if(elem == 2) s = compare_images(reinterpret_cast<const uint16_t*>(ref.data()), reinterpret_cast<const uint16_t*>(test.data()), n, tol, peak);
+    else               s = compare_images(ref.data(), test.data(), n, tol, peak);
+    const double ms = std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+
+    std::printf("%zux%zu %s, tolerance %g\n", w, h, type.c_str(), tol);
+    std::printf("max abs    %g\n", s.max_abs);
+    std::printf("rmse       %g\n", s.rmse);
+    std::printf("psnr       %.2f dB\n", s.psnr);
+    std::printf("mismatches %zu (%.4f%%), %zu NaN\n", s.mismatches, n ? 100.0 * s.mismatches / n : 0.0, s.nans);
+    std::printf("reference  [%g, %g]\n", s.ref_min, s.ref_max);
+    std::printf("%.2f ms, %.2f GB/s\n", ms, ms > 0 ? 2.0 * n * elem / (ms * 1e6) : 0.0);
+
+    int failed = 0;
+    auto check = [&](bool bad, const char* what, double v, double limit){
+        if(!bad) return;
+        std::printf("FAIL %s %g (limit %g)\n", what, v, limit);
+        failed = 1;
+    };
+    check(max_abs >= 0 && s.max_abs > max_abs, "max abs", s.max_abs, max_abs);
+    check(max_rmse >= 0 && s.rmse > max_rmse, "rmse", s.rmse, max_rmse);
+    check(min_psnr >= 0 && s.psnr < min_psnr, "psnr", s.psnr, min_psnr);
+    check(max_mismatch >= 0 && double(s.mismatches) > max_mismatch, "mismatches", double(s.mismatches), max_mismatch);
+    return failed;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+// Process-wide named gauges/counters. Writers are the render threads and the
+// resource manager; readers take a snapshot.
+struct instrumentation
+{
+    void set(const std::string& key, double v)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        values[key] = v;
+    }
+    void add(const std::string& key, double v = 1.0)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        values[key] += v;
+    }
+    double get(const std::string& key) const
+    {
+        std::lock_guard<std::mutex> lock(m);
+        auto it = values.find(key);
+        return it == values.end() ? 0.0 : it->second;
+    }
+    std::map<std::string, double> snapshot() const
+    {
+        std::lock_guard<std::mutex> lock(m);
+        return values;
+    }
+    void print(std::ostream& os) const
+    {
+        for(const auto& [k, v] : snapshot()) os << k << " = " << v << "\n";
+    }
+private:
+    mutable std::mutex m;
+    std::map<std::string, double> values;
+};
@@ -0,0 +1,321 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#ifdef __linux__
+#   include <pthread.h>
+#   include <sched.h>
+#endif
+#include "instrumentation.h"
+
+// Urgency of a job; workers always take the most urgent one queued anywhere.
+enum class job_priority : int
+{
+    high,    // someone waits for it: parallel_for, visible tiles
+    normal,
+    low,     // prefetch and other speculative work
+};
+
+// Jobs submitted together. cancel() drops the ones that have not started (a running job can
+// poll cancelled()); job_system::wait() returns once every job ran or was dropped.
+// Must outlive its jobs.
+struct job_group
+{
+    void cancel() { stop = true; }
+    bool cancelled() const { return stop.load(); }
+    bool done() const { return 0 == pending.load(); }
+private:
+    friend struct job_system;
+    std::atomic<int> pending{0};
+    std::atomic<int> level{0};  // least urgent priority submitted
+    std::atomic<bool> stop{false};
+};
+
+// Static dependency graph for job_system::run(): a node starts when all nodes it was
+// added `after` have finished.
+struct job_graph
+{
+    int add(std::function<void()> fn, std::initializer_list<int> after = {})
+    {
+        nodes.push_back({std::move(fn), {}, int(after.size())});
+        const int id = int(nodes.size()) - 1;
+        for(int a : after) nodes[a].next.push_back(id);
+        return id;
+    }
+    size_t size() const { return nodes.size(); }
+private:
+    friend struct job_system;
+    struct node
+    {
+        std::function<void()> fn;
+        std::vector<int> next;
+        int deps;
+    };
+    std::vector<node> nodes;
+};
+
+// Process-wide work-stealing scheduler. Every worker owns one deque per priority: it pops its
+// own newest job and steals the oldest from the others, workers on the same NUMA node first.
+// Threads that wait for a group run queued jobs of at least the group's urgency meanwhile,
+// so nested parallel_for calls can not deadlock. On machines with several NUMA nodes the
+// workers are spread over the nodes and pinned to their node's CPUs.
+// Workers: DISPLAY_TOOL_JOBS or one per hardware thread but the caller's.
+struct job_system
+{
+    explicit job_system(int workers = 0)
+    {
+        const char* env = std::getenv("DISPLAY_TOOL_JOBS");
+        if(workers <= 0 && env) workers = std::atoi(env);
+        if(workers <= 0) workers = std::max(1, int(std::thread::hardware_concurrency()) - 1);
+        nodes = numa_nodes();
+        queue_n = workers;
+        queues.reset(new queue[workers]);
+        for(int i = 0; i < workers; ++i) threads.emplace_back(&job_system::worker, this, i);
+    }
+    ~job_system()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_m);
+            quit = true;
+        }
+        sleep_cv.notify_all();
+        for(auto& t : threads) t.join();
+    }
+    job_system(const job_system&) = delete;
+    job_system& operator=(const job_system&) = delete;
+
+    // the process job system: glfw_initializer::jobs while one exists, else one made on first use
+    static job_system& current()
+    {
+        if(job_system* s = installed().load()) return *s;
+        static job_system fallback;
+        return fallback;
+    }
+    static void install(job_system* s)
+    {
+        installed() = s;
+    }
+    // workers plus the calling thread
+    int size() const
+    {
+        return queue_n + 1;
+    }
+    void submit(std::function<void()> fn, job_priority p = job_priority::normal, job_group* g = nullptr)
+    {
+        if(g){
+            g->pending.fetch_add(1);
+            int level = g->level.load();
+            while(int(p) > level && !g->level.compare_exchange_weak(level, int(p))){}
+        }
+        push({std::move(fn), g, p});
+    }
+    // blocks until the group is done, running queued jobs meanwhile
+    void wait(job_group& g)
+    {
+        const int level = g.level.load();
+        while(!g.done()){
+            if(run_one(level)) continue;
+            std::unique_lock<std::mutex> lock(sleep_m);
+            sleep_cv.wait(lock, [&]{ return g.done() || queued(level); });
+        }
+    }
+    // Split [begin, end) into chunks of at least min_chunk; the caller runs the first one.
+    template<class F>
+    void parallel_for(int begin, int end, F&& f, int min_chunk = 1, job_priority p = job_priority::high)
+    {
+        const int n = end - begin;
+        if(n <= 0) return;
+        const int chunks = std::min(size() * 4, std::max(1, n / std::max(1, min_chunk)));
+        if(chunks == 1){
+            f(begin, end);
+            return;
+        }
+        const int chunk = (n + chunks - 1) / chunks;
+        job_group g;
+        for(int b = begin + chunk; b < end; b += chunk)
+            submit([&f, b, e = std::min(end, b + chunk)]{ f(b, e); }, p, &g);
+        f(begin, std::min(end, begin + chunk));
+        wait(g);
+    }
+    // Run a graph to completion. Cancelling `g` skips the nodes that have not started.
+    void run(const job_graph& graph, job_priority p = job_priority::high, job_group* g = nullptr)
+    {
+        job_group local;
+        job_group& group = g ? *g : local;
+        std::unique_ptr<std::atomic<int>[]> deps(new std::atomic<int>[graph.size()]);
+        for(size_t i = 0; i < graph.size(); ++i) deps[i] = graph.nodes[i].deps;
+        std::function<void(int)> start = [&](int i){
+            submit([&, i]{
+                if(!group.cancelled()) graph.nodes[i].fn();
+                for(int k : graph.nodes[i].next)
+                    if(1 == deps[k].fetch_sub(1)) start(k);
+            }, p, &group);
+        };
+        for(size_t i = 0; i < graph.size(); ++i)
+            if(0 == graph.nodes[i].deps) start(int(i));
+        wait(group);
+    }
+    void publish(instrumentation& stats, const std::string& prefix = "jobs") const
+    {
+        stats.set(prefix + ".workers", queue_n);
+        stats.set(prefix + ".numa_nodes", double(std::max<size_t>(1, nodes.size())));
+        stats.set(prefix + ".executed", double(executed.load()));
+        stats.set(prefix + ".stolen", double(stolen.load()));
+        stats.set(prefix + ".cancelled", double(dropped.load()));
+    }
+
+private:
+    struct job
+    {
+        std::function<void()> fn;
+        job_group* group;
+        job_priority priority;
+    };
+    struct queue
+    {
+        std::mutex m;
+        std::deque<job> jobs[3];
+    };
+    static std::atomic<job_system*>& installed()
+    {
+        static std::atomic<job_system*> s{nullptr};
+        return s;
+    }
+    // worker index of the calling thread, -1 for threads that are not ours
+    int self() const
+    {
+        return tls().first == this ? tls().second : -1;
+    }
+    static std::pair<const job_system*, int>& tls()
+    {
+        thread_local std::pair<const job_system*, int> w{nullptr, -1};
+        return w;
+    }
+    int node_of(int worker) const
+    {
+        return nodes.empty() ? 0 : worker % int(nodes.size());
+    }
+    bool queued(int level) const
+    {
+        for(int p = 0; p <= level; ++p) if(count[p].load() > 0) return true;
+        return false;
+    }
+    void push(job&& j)
+    {
+        // workers keep what they spawn, other threads deal round robin
+        const int w = self();
+        queue& q = queues[w >= 0 ? w : int(next_queue.fetch_add(1) % unsigned(queue_n))];
+        {
+            std::lock_guard<std::mutex> lock(q.m);
+            q.jobs[int(j.priority)].push_back(std::move(j));
+            count[int(j.priority)].fetch_add(1);
+        }
+        std::lock_guard<std::mutex> lock(sleep_m);
+        sleep_cv.notify_all();
+    }
+    bool pop(queue& q, int p, bool newest, job& out)
+    {
+        std::lock_guard<std::mutex> lock(q.m);
+        auto& d = q.jobs[p];
+        if(d.empty()) return false;
+        if(newest){ out = std::move(d.back()); d.pop_back(); }
+        else{ out = std::move(d.front()); d.pop_front(); }
+        count[p].fetch_sub(1);
+        return true;
+    }
+    bool run_one(int level)
+    {
+        const int w = self();
+        const int home = w >= 0 ? node_of(w) : -1;
+        job j;
+        for(int p = 0; p <= level; ++p){
+            if(count[p].load() <= 0) continue;
+            bool found = w >= 0 && pop(queues[w], p, true, j);
+            for(int pass = 0; pass < 2 && !found; ++pass)
+                for(int k = 1; k <= queue_n && !found; ++k){
+                    const int v = (std::max(0, w) + k) % queue_n;
+                    if(v == w || (node_of(v) == home) != (pass == 0)) continue;
+                    found = pop(queues[v], p, false, j);
+                    if(found) stolen.fetch_add(1);
+                }
+            if(!found) continue;
+            if(j.group && j.group->cancelled()) dropped.fetch_add(1);
+            else j.fn();
+            executed.fetch_add(1);
+            if(j.group && 1 == j.group->pending.fetch_sub(1)){
+                std::lock_guard<std::mutex> lock(sleep_m);
+                sleep_cv.notify_all();
+            }
+            return true;
+        }
+        return false;
+    }
+    void worker(int i)
+    {
+        tls() = {this, i};
+        pin(i);
+        for(;;){
+            if(run_one(int(job_priority::low))) continue;
+            std::unique_lock<std::mutex> lock(sleep_m);
+            sleep_cv.wait(lock, [&]{ return quit || queued(int(job_priority::low)); });
+            if(quit) return;
+        }
+    }
+    void pin(int i)
+    {
+        if(nodes.empty()) return;
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for(int c : nodes[node_of(i)]) if(c < CPU_SETSIZE) CPU_SET(c, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+    }
+    // CPUs of every NUMA node; empty on single-node machines and where the OS does not say
+    static std::vector<std::vector<int>> numa_nodes()
+    {
+        std::vector<std::vector<int>> nodes;
+#ifdef __linux__
+        for(int n = 0;; ++n){
+            const std::string path = "/sys/devices/system/node/node" + std::to_string(n) + "/cpulist";
+            std::FILE* f = std::fopen(path.c_str(), "r");
+            if(!f) break;
+            std::vector<int> cpus;
+            int a, b;
+            while(std::fscanf(f, "%d", &a) == 1){  // "0-3,8-11"
+                int c = std::fgetc(f);
+                b = a;
+                if(c == '-' && std::fscanf(f, "%d", &b) == 1) c = std::fgetc(f);
+                for(int x = a; x <= b; ++x) cpus.push_back(x);
+                if(c != ',') break;
+            }
+            std::fclose(f);
+            if(!cpus.empty()) nodes.push_back(std::move(cpus));
+        }
+#endif
+        if(nodes.size() < 2) nodes.clear();
+        return nodes;
+    }
+
+    std::vector<std::vector<int>> nodes;
+    std::unique_ptr<queue[]> queues;
+    int queue_n = 0;
+    std::atomic<int> count[3] = {};
+    std::atomic<unsigned> next_queue{0};
+    std::atomic<size_t> executed{0}, stolen{0}, dropped{0};
+    std::mutex sleep_m;
+    std::condition_variable sleep_cv;
+    bool quit = false;
+    std::vector<std::thread> threads;
+};
@@ -0,0 +1,96 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <utility>
+#ifdef _WIN32
+#   ifndef NOMINMAX
+#       define NOMINMAX
+#   endif
+#   include <windows.h>
+#else
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+// Read-only memory map of a whole file. Pages are faulted in on first touch,
+// so files larger than RAM can be read piecewise.
+struct mapped_file
+{
+    mapped_file() = default;
+    explicit mapped_file(const std::string& path) { open(path); }
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+    mapped_file(mapped_file&& o) noexcept { swap(o); }
+    mapped_file& operator=(mapped_file&& o) noexcept { close(); swap(o); return *this; }
+    ~mapped_file() { close(); }
+
+    bool open(const std::string& path)
+    {
+        close();
+#ifdef _WIN32
+        HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                               FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(f == INVALID_HANDLE_VALUE){ std::cerr << "can not open " << path << "\n"; return false; }
+        LARGE_INTEGER sz;
+        GetFileSizeEx(f, &sz);
+        bytes = size_t(sz.QuadPart);
+        if(bytes){
+            HANDLE m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if(m){
+                ptr = static_cast<const uint8_t*>(MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0));
+                CloseHandle(m);
+            }
+        }
+        CloseHandle(f);
+#else
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0){ std::cerr << "can not open " << path << "\n"; return false; }
+        struct stat st;
+        if(fstat(fd, &st) == 0) bytes = size_t(st.st_size);
+        if(bytes){
+            void* p = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+            ptr = p == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(p);
+        }
+        ::close(fd);
+#endif
+        if(bytes && !ptr){
+            std::cerr << "can not map " << path << "\n";
+            bytes = 0;
+            return false;
+        }
+        return true;
+    }
+    void close()
+    {
+        if(ptr){
+#ifdef _WIN32
+            UnmapViewOfFile(ptr);
+#else
+            munmap(const_cast<uint8_t*>(ptr), bytes);
+#endif
+        }
+        ptr = nullptr;
+        bytes = 0;
+    }
+    // tell the kernel the whole file will be read front to back
+    void sequential() const
+    {
+#ifndef _WIN32
+        if(ptr) madvise(const_cast<uint8_t*>(ptr), bytes, MADV_SEQUENTIAL);
+#endif
+    }
+    const uint8_t* data() const { return ptr; }
+    size_t size() const { return bytes; }
+private:
+    void swap(mapped_file& o) noexcept
+    {
+        std::swap(ptr, o.ptr);
+        std::swap(bytes, o.bytes);
+    }
+    const uint8_t* ptr = nullptr;
+    size_t bytes = 0;
+};
@@ -1,14 +1,18 @@
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <cmath>
+#include <string>
 #include <vector>
 
-#include <GLFW/glfw3.h>
 #ifdef __APPLE__
 #include <OpenGL/gl3.h>
 #else
-#include <GL/gl.h>
+#include <GL/glew.h>
 #endif
+#include <GLFW/glfw3.h>
+#include "3d/surface_gl.hpp"
+#include "3d/volume_gl.hpp"
 
 struct OrbitCam { float dist=3.0f; float yaw=0.7f; float pitch=0.4f; };
 
@@ -30,7 +34,259 @@ static void lookAt(float ex,float ey,float ez,float cx,float cy,float cz,float u
     glTranslatef(-ex,-ey,-ez);
 }
 
-int main(){
+static GLuint compile_shader(GLenum type, const char* src)
+{
+    GLuint s = glCreateShader(type);
+    glShaderSource(s, 1, &src, nullptr);
+    glCompileShader(s);
+    GLint ok=0; glGetShaderiv(s, GL_COMPILE_STATUS, &ok);
+    if(!ok){
+        char buf[1024]; glGetShaderInfoLog(s, 1024, nullptr, buf);
+        std::fprintf(stderr, "Shader compile error: %s\n", buf);
+    }
+    return s;
+}
+
+static void orbit(GLFWwindow* win, OrbitCam& cam, bool& rotating, double& lastX, double& lastY)
+{
+    int rmb=glfwGetMouseButton(win,GLFW_MOUSE_BUTTON_LEFT); double mx,my; glfwGetCursorPos(win,&mx,&my);
+    if(rmb==GLFW_PRESS && !rotating){ rotating=true; lastX=mx; lastY=my; }
+    if(rmb==GLFW_RELEASE && rotating){ rotating=false; }
+    if(rotating){ float dx=float(mx-lastX), dy=float(my-lastY); cam.yaw+=dx*0.005f; cam.pitch+=dy*0.005f; if(cam.pitch>1.5f)cam.pitch=1.5f; if(cam.pitch<-1.5f)cam.pitch=-1.5f; lastX=mx; lastY=my; }
+}
+
+static view3d orbit_view(const OrbitCam& cam, float aspect)
+{
+    view3d v;
+    v.eye[0]=cam.dist*std::cos(cam.pitch)*std::cos(cam.yaw);
+    v.eye[1]=cam.dist*std::sin(cam.pitch);
+    v.eye[2]=cam.dist*std::cos(cam.pitch)*std::sin(cam.yaw);
+    for(int i=0;i<3;++i) v.forward[i] = -v.eye[i]/cam.dist;
+    // right = forward x (0,1,0), up = right x forward
+    const float rl = std::sqrt(v.forward[2]*v.forward[2] + v.forward[0]*v.forward[0]);
+    v.right[0] = -v.forward[2]/rl; v.right[1] = 0; v.right[2] = v.forward[0]/rl;
+    v.up[0] = v.right[1]*v.forward[2] - v.right[2]*v.forward[1];
+    v.up[1] = v.right[2]*v.forward[0] - v.right[0]*v.forward[2];
+    v.up[2] = v.right[0]*v.forward[1] - v.right[1]*v.forward[0];
+    v.tan_half_fov = std::tan(30.0f*3.14159265f/180.0f);
+    v.aspect = aspect;
+    return v;
+}
+
+// GL 3.3 core window with the orbit camera's scroll zoom; nullptr on failure
+static GLFWwindow* open_core_window(const char* title, OrbitCam& cam)
+{
+    if(!glfwInit()) return nullptr;
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR,3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR,3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+    GLFWwindow* win=glfwCreateWindow(960,600,title,nullptr,nullptr);
+    if(!win){ glfwTerminate(); return nullptr; }
+    glfwMakeContextCurrent(win);
+    glfwSwapInterval(1);
+#ifndef __APPLE__
+    glewExperimental = GL_TRUE;
+    if(glewInit() != GLEW_OK){ std::fprintf(stderr, "glew init failed\n"); glfwTerminate(); return nullptr; }
+#endif
+    glfwSetWindowUserPointer(win,&cam);
+    glfwSetScrollCallback(win,[](GLFWwindow* w,double, double yoff){ auto* c=(OrbitCam*)glfwGetWindowUserPointer(w); c->dist *= (yoff<0?1.1f:0.9f); if(c->dist<0.01f) c->dist=0.01f; });
+    return win;
+}
+
+static size_t vram_budget_mb()
+{
+    const char* vram = std::getenv("DISPLAY_TOOL_VRAM_MB");
+    return vram ? size_t(std::atoll(vram)) : 512;
+}
+
+static voxel_type parse_voxel_type(const std::string& t)
+{
+    return t == "f32" ? voxel_type::f32 : t == "u16" ? voxel_type::u16 : voxel_type::u8;
+}
+
+static double ms_since(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// preprocessed data into the disk cache, nothing happens for an empty key
+template<class T> static void store(disk_cache& cache, const std::string& key, const T& data)
+{
+    cache_writer w;
+    if(cache.create(key, w)){
+        data.save(w);
+        cache.commit(w);
+    }
+}
+
+// mesh_3d volume [file.raw nx ny nz u8|u16|f32] [colormap]
+// LEFT/RIGHT move the opacity threshold, UP/DOWN scale the opacity.
+// The macrocell grid of a file is kept in the disk cache.
+static int run_volume(int argc, char** argv)
+{
+    instrumentation stats;
+    disk_cache cache(&stats);
+    const auto t_start = std::chrono::steady_clock::now();
+    volume_source src;
+    std::string key;
+    int next = 2;
+    if(argc > 6){
+        if(!src.open_raw(argv[2], std::atoi(argv[3]), std::atoi(argv[4]), std::atoi(argv[5]), parse_voxel_type(argv[6]))) return 1;
+        key = disk_cache::key(argv[2], "macrocells 1 " + std::string(argv[3]) + "x" + argv[4] + "x" + argv[5] + " " + argv[6]);
+        next = 7;
+    }
+    else{
+        src.make_synthetic(256);
+    }
+    const std::string cmap = argc > next ? argv[next] : "viridis";
+    macrocell_grid cells;
+    cache_file entry;
+    if(!cache.open(key, entry) || !cells.load(entry)){
+        cells.build(src);
+        store(cache, key, cells);
+    }
+    stats.set("startup.volume_ms", ms_since(t_start));
+    stats.print(std::cout);
+
+    OrbitCam cam; bool rotating=false; double lastX=0,lastY=0;
+    cam.dist = 2.0f;
+    GLFWwindow* win = open_core_window("mesh_3d volume", cam);
+    if(!win) return 1;
+
+    volume_renderer vol;
+    if(!vol.init(src, vram_budget_mb(), compile_shader, &cells)){ glfwTerminate(); return 1; }
+    float lo = 0.1f, opacity = 0.05f;
+    bool keys[4] = {};
+    auto t0 = glfwGetTime();
+    int frames = 0;
+    while(!glfwWindowShouldClose(win)){
+        glfwPollEvents();
+        const int key_ids[4] = {GLFW_KEY_LEFT, GLFW_KEY_RIGHT, GLFW_KEY_UP, GLFW_KEY_DOWN};
+        bool changed = false;
+        for(int i=0;i<4;++i){
+            const bool down = glfwGetKey(win, key_ids[i]) == GLFW_PRESS;
+            if(down && !keys[i]){
+                changed = true;
+                if(i==0) lo = std::max(0.0f, lo-0.05f);
+                if(i==1) lo = std::min(0.95f, lo+0.05f);
+                if(i==2) opacity = std::min(1.0f, opacity*1.5f);
+                if(i==3) opacity = opacity/1.5f;
+            }
+            keys[i] = down;
+        }
+        if(changed) vol.set_transfer(cmap, lo, 1.0f, opacity);
+
+        int w,h; glfwGetFramebufferSize(win,&w,&h);
+        glViewport(0,0,w,h);
+        glClearColor(0.12f,0.13f,0.16f,1);
+        glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+        orbit(win, cam, rotating, lastX, lastY);
+        vol.render(orbit_view(cam, h>0?(float)w/(float)h:1.0f), w, h);
+        glfwSwapBuffers(win);
+
+        ++frames;
+        const double now = glfwGetTime();
+        if(now - t0 >= 5.0){
+            std::printf("FPS: %.1f, resident bricks %d, streamed %.1f MiB\n", frames/(now-t0),
+                        vol.resident(), vol.streamed_bytes() / double(1<<20));
+            frames = 0;
+            t0 = now;
+        }
+    }
+    vol.release();
+    glfwTerminate();
+    return 0;
+}
+
+
+// mesh_3d surface [file.raw w h u8|u16|f32 | n] [colormap]
+// LEFT/RIGHT change the screen-space error tolerance, UP/DOWN scale the heights.
+// The LOD tiles are kept in the disk cache, a second start maps them instead of rebuilding.
+static int run_surface(int argc, char** argv)
+{
+    instrumentation stats;
+    disk_cache cache(&stats);
+    surface_pyramid pyramid;
+    int next = 2;
+    const auto t_start = std::chrono::steady_clock::now();
+    const std::string params = "surface 1 " + std::to_string(surface_pyramid::chunk);
+    cache_file entry;
+    if(argc > 5){
+        const std::string key = disk_cache::key(argv[2], params + " " + argv[3] + "x" + argv[4] + " " + argv[5]);
+        if(!cache.open(key, entry) || !pyramid.load(std::move(entry))){
+            volume_source src;
+            if(!src.open_raw(argv[2], std::atoi(argv[3]), std::atoi(argv[4]), 1, parse_voxel_type(argv[5]))) return 1;
+            pyramid.build(src);
+            store(cache, key, pyramid);
+        }
+        next = 6;
+    }
+    else{
+        const int n = argc > 2 ? std::atoi(argv[2]) : 0;
+        const std::string key = disk_cache::key("", params + " synthetic " + std::to_string(n > 1 ? n : 4096));
+        if(!cache.open(key, entry) || !pyramid.load(std::move(entry))){
+            pyramid.synthetic(n > 1 ? n : 4096);
+            store(cache, key, pyramid);
+        }
+        next = n > 1 ? 3 : 2;
+    }
+    const std::string cmap = argc > next ? argv[next] : "viridis";
+    stats.set("startup.surface_ms", ms_since(t_start));
+    stats.print(std::cout);
+
+    OrbitCam cam; bool rotating=false; double lastX=0,lastY=0;
+    cam.dist = 1.5f;
+    GLFWwindow* win = open_core_window("mesh_3d surface", cam);
+    if(!win) return 1;
+
+    surface_renderer surface;
+    if(!surface.init(pyramid, vram_budget_mb(), compile_shader)){ glfwTerminate(); return 1; }
+    surface.set_colormap(cmap);
+    bool keys[4] = {};
+    auto t0 = glfwGetTime();
+    int frames = 0;
+    while(!glfwWindowShouldClose(win)){
+        glfwPollEvents();
+        const int key_ids[4] = {GLFW_KEY_LEFT, GLFW_KEY_RIGHT, GLFW_KEY_UP, GLFW_KEY_DOWN};
+        for(int i=0;i<4;++i){
+            const bool down = glfwGetKey(win, key_ids[i]) == GLFW_PRESS;
+            if(down && !keys[i]){
+                if(i==0) surface.tolerance_px = std::max(0.25f, surface.tolerance_px/1.5f);
+                if(i==1) surface.tolerance_px *= 1.5f;
+                if(i==2) surface.height *= 1.25f;
+                if(i==3) surface.height /= 1.25f;
+            }
+            keys[i] = down;
+        }
+
+        int w,h; glfwGetFramebufferSize(win,&w,&h);
+        glViewport(0,0,w,h);
+        glClearColor(0.12f,0.13f,0.16f,1);
+        glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+        orbit(win, cam, rotating, lastX, lastY);
+        surface.render(orbit_view(cam, h>0?(float)w/(float)h:1.0f), w, h);
+        glfwSwapBuffers(win);
+
+        ++frames;
+        const double now = glfwGetTime();
+        if(now - t0 >= 5.0){
+            std::printf("FPS: %.1f, chunks drawn %d, resident %d, tolerance %.2f px\n", frames/(now-t0),
+                        surface.drawn(), surface.resident(), surface.tolerance_px);
+            frames = 0;
+            t0 = now;
+        }
+    }
+    surface.release();
+    glfwTerminate();
+    return 0;
+}
+
+int main(int argc, char** argv){
+    if(argc > 1 && std::string(argv[1]) == "volume") return run_volume(argc, argv);
+    if(argc > 1 && std::string(argv[1]) == "surface") return run_surface(argc, argv);
     if(!glfwInit()) return 1;
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR,2);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR,1);
@@ -51,10 +307,7 @@ int main(){
         glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
         glEnable(GL_DEPTH_TEST);
 
-        int rmb=glfwGetMouseButton(win,GLFW_MOUSE_BUTTON_LEFT); double mx,my; glfwGetCursorPos(win,&mx,&my);
-        if(rmb==GLFW_PRESS && !rotating){ rotating=true; lastX=mx; lastY=my; }
-        if(rmb==GLFW_RELEASE && rotating){ rotating=false; }
-        if(rotating){ float dx=float(mx-lastX), dy=float(my-lastY); cam.yaw+=dx*0.005f; cam.pitch+=dy*0.005f; if(cam.pitch>1.5f)cam.pitch=1.5f; if(cam.pitch<-1.5f)cam.pitch=-1.5f; lastX=mx; lastY=my; }
+        orbit(win, cam, rotating, lastX, lastY);
 
         perspective(60.0f, h>0?(float)w/(float)h:1.0f, 0.01f, 100.0f);
         glLoadIdentity();
@@ -0,0 +1,11 @@
+#pragma once
+#include <utility>
+#include "job_system.hpp"
+
+// Split [begin, end) into contiguous chunks and run f(chunk_begin, chunk_end) as high-priority
+// jobs of the process job system. The calling thread takes part until all chunks are done.
+template<class F>
+void parallel_for(int begin, int end, F&& f, int min_chunk = 1)
+{
+    job_system::current().parallel_for(begin, end, std::forward<F>(f), min_chunk);
+}
@@ -0,0 +1,193 @@
+#include "resource_manager.h"
+#include "instrumentation.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+static size_t env_megabytes(const char* name)
+{
+    const char* v = std::getenv(name);
+    return v ? size_t(std::strtoull(v, nullptr, 10)) << 20 : 0;
+}
+
+resource_manager::resource_manager(instrumentation& s) : stats(s)
+{
+    set_budget(env_megabytes("DISPLAY_TOOL_VRAM_MB"), env_megabytes("DISPLAY_TOOL_HOST_MB"));
+}
+resource_manager& resource_manager::set_budget(size_t vram_bytes, size_t host_bytes)
+{
+    std::lock_guard<std::mutex> lock(m);
+    vram_budget = vram_bytes;
+    host_budget = host_bytes;
+    warned = false;
+    enforce();
+    publish();
+    return *this;
+}
+int resource_manager::add_window(const void* owner)
+{
+    std::lock_guard<std::mutex> lock(m);
+    auto it = windows.emplace(owner, next_window).first;
+    if(it->second == next_window) ++next_window;
+    return it->second;
+}
+void resource_manager::remove_window(const void* owner)
+{
+    std::lock_guard<std::mutex> lock(m);
+    for(auto it = entries.begin(); it != entries.end();){
+        if(it->second.owner == owner){
+            vram_total -= it->second.vram;
+            host_total -= it->second.host;
+            it = entries.erase(it);
+        }
+        else ++it;
+    }
+    publish();
+    auto w = windows.find(owner);
+    if(w != windows.end()){
+        const std::string prefix = "mem.window" + std::to_string(w->second);
+        stats.set(prefix + ".vram", 0);
+        stats.set(prefix + ".host", 0);
+        windows.erase(w);
+    }
+}
+resource_id resource_manager::track(const void* owner, resource_kind kind, size_t vram_bytes, size_t host_bytes,
+                                    bool evictable, bool has_source)
+{
+    std::lock_guard<std::mutex> lock(m);
+    const resource_id id = next_id++;
+    entries.emplace(id, entry{owner, kind, vram_bytes, host_bytes, evictable, has_source, false, false, clock::now()});
+    vram_total += vram_bytes;
+    host_total += host_bytes;
+    enforce();
+    publish();
+    return id;
+}
+void resource_manager::untrack(resource_id id)
+{
+    std::lock_guard<std::mutex> lock(m);
+    auto it = entries.find(id);
+    if(it == entries.end()) return;
+    vram_total -= it->second.vram;
+    host_total -= it->second.host;
+    entries.erase(it);
+    publish();
+}
+void resource_manager::touch(resource_id id)
+{
+    std::lock_guard<std::mutex> lock(m);
+    auto it = entries.find(id);
+    if(it == entries.end()) return;
+    it->second.last_use = clock::now();
+    // drawn again before its owner got to it: keep it
+    it->second.want_gpu_evict = false;
+}
+void resource_manager::restored(resource_id id, size_t vram_bytes, size_t host_bytes)
+{
+    std::lock_guard<std::mutex> lock(m);
+    auto it = entries.find(id);
+    if(it == entries.end()) return;
+    vram_total += vram_bytes - it->second.vram;
+    host_total += host_bytes - it->second.host;
+    it->second.vram = vram_bytes;
+    it->second.host = host_bytes;
+    it->second.last_use = clock::now();
+    stats.add("mem.reuploads");
+    enforce();
+    publish();
+}
+void resource_manager::evicted(resource_id id)
+{
+    std::lock_guard<std::mutex> lock(m);
+    auto it = entries.find(id);
+    if(it == entries.end()) return;
+    vram_total -= it->second.vram;
+    it->second.vram = 0;
+    it->second.want_gpu_evict = false;
+    stats.add("mem.evictions");
+    publish();
+}
+void resource_manager::host_dropped(resource_id id)
+{
+    std::lock_guard<std::mutex> lock(m);
+    auto it = entries.find(id);
+    if(it == entries.end()) return;
+    host_total -= it->second.host;
+    it->second.host = 0;
+    it->second.want_host_drop = false;
+    publish();
+}
+std::vector<resource_manager::eviction> resource_manager::take_evictions(const void* owner)
+{
+    std::vector<eviction> out;
+    std::lock_guard<std::mutex> lock(m);
+    enforce();
+    for(auto& [id, e] : entries){
+        if(e.owner != owner || !(e.want_gpu_evict || e.want_host_drop)) continue;
+        out.push_back({id, e.want_gpu_evict, e.want_host_drop});
+    }
+    return out;
+}
+size_t resource_manager::vram_used() const
+{
+    std::lock_guard<std::mutex> lock(m);
+    return vram_total;
+}
+size_t resource_manager::host_used() const
+{
+    std::lock_guard<std::mutex> lock(m);
+    return host_total;
+}
+
+void resource_manager::enforce()
+{
+    const auto now = clock::now();
+    auto pick = [&](size_t used, size_t budget, bool gpu){
+        if(0 == budget) return true;
+        std::vector<std::pair<clock::time_point, entry*>> lru;
+        for(auto& [id, e] : entries){
+            const bool pending = gpu ? e.want_gpu_evict : e.want_host_drop;
+            const size_t bytes = gpu ? e.vram : e.host;
+            if(pending) used -= std::min(used, bytes);
+            if(!e.evictable || pending || 0 == bytes || now - e.last_use < min_idle) continue;
+            if(!gpu && !e.has_source) continue;
+            lru.emplace_back(e.last_use, &e);
+        }
+        std::sort(lru.begin(), lru.end(), [](auto& a, auto& b){ return a.first < b.first; });
+        for(auto& [t, e] : lru){
+            if(used <= budget) break;
+            if(gpu){ e->want_gpu_evict = true; used -= e->vram; }
+            else{ e->want_host_drop = true; used -= e->host; }
+        }
+        return used <= budget;
+    };
+    const bool vram_ok = pick(vram_total, vram_budget, true);
+    const bool host_ok = pick(host_total, host_budget, false);
+    if(vram_ok && host_ok){
+        warned = false;
+    }
+    else if(!warned){
+        std::cerr << "memory budget exceeded by recently drawn resources: vram " << (vram_total >> 20) << "/"
+                  << (vram_budget >> 20) << " MiB, host " << (host_total >> 20) << "/" << (host_budget >> 20) << " MiB\n";
+        warned = true;
+    }
+}
+void resource_manager::publish()
+{
+    stats.set("mem.vram.used", double(vram_total));
+    stats.set("mem.vram.budget", double(vram_budget));
+    stats.set("mem.host.used", double(host_total));
+    stats.set("mem.host.budget", double(host_budget));
+    std::unordered_map<const void*, std::pair<size_t, size_t>> per_window;
+    for(auto& [id, e] : entries){
+        auto& w = per_window[e.owner];
+        w.first += e.vram;
+        w.second += e.host;
+    }
+    for(auto& [owner, n] : windows){
+        const std::string prefix = "mem.window" + std::to_string(n);
+        auto it = per_window.find(owner);
+        stats.set(prefix + ".vram", it == per_window.end() ? 0.0 : double(it->second.first));
+        stats.set(prefix + ".host", it == per_window.end() ? 0.0 : double(it->second.second));
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct instrumentation;
+
+enum class resource_kind : int
+{
+    texture,
+    buffer,
+};
+using resource_id = uint64_t;
+
+// Process-wide byte accounting for GPU resources and their host copies.
+// GL objects can only be deleted by the thread owning the context, so the manager
+// only decides what to evict; each window collects its evictions once per frame,
+// frees them and reports back with evicted()/host_dropped().
+struct resource_manager
+{
+    struct eviction
+    {
+        resource_id id;
+        bool gpu;   // delete the GL object, keep the host copy
+        bool host;  // drop the host copy, reload from source on demand
+    };
+    explicit resource_manager(instrumentation& stats);
+
+    // budgets in bytes, 0 = unlimited.
+    // Defaults come from DISPLAY_TOOL_VRAM_MB / DISPLAY_TOOL_HOST_MB.
+    resource_manager& set_budget(size_t vram_bytes, size_t host_bytes);
+
+    int add_window(const void* owner);
+    void remove_window(const void* owner);
+
+    // evictable resources are expected to be re-creatable from host copy or source.
+    resource_id track(const void* owner, resource_kind kind, size_t vram_bytes, size_t host_bytes,
+                      bool evictable = true, bool has_source = false);
+    void untrack(resource_id id);
+    // mark as drawn now (LRU order)
+    void touch(resource_id id);
+    // the owner re-uploaded / reloaded the resource
+    void restored(resource_id id, size_t vram_bytes, size_t host_bytes);
+    void evicted(resource_id id);
+    void host_dropped(resource_id id);
+    std::vector<eviction> take_evictions(const void* owner);
+
+    size_t vram_used() const;
+    size_t host_used() const;
+private:
+    using clock = std::chrono::steady_clock;
+    struct entry
+    {
+        const void* owner;
+        resource_kind kind;
+        size_t vram;
+        size_t host;
+        bool evictable;
+        bool has_source;
+        bool want_gpu_evict = false;
+        bool want_host_drop = false;
+        clock::time_point last_use;
+    };
+    // resources drawn more recently than this are never picked, to avoid thrashing
+    static constexpr std::chrono::milliseconds min_idle{500};
+
+    void enforce();   // call with m held
+    void publish();   // call with m held
+
+    instrumentation& stats;
+    mutable std::mutex m;
+    std::unordered_map<resource_id, entry> entries;
+    std::unordered_map<const void*, int> windows;
+    resource_id next_id = 1;
+    int next_window = 0;
+    size_t vram_budget = 0, host_budget = 0;
+    size_t vram_total = 0, host_total = 0;
+    bool warned = false;
+};
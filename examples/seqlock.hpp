@@ -0,0 +1,51 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Single-writer sequence lock for small trivially copyable state.
+// The reader never blocks the writer; it retries if it raced a store.
+// The payload lives in relaxed atomics so torn reads are detected, not UB.
+template<class T>
+struct seqlock
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    explicit seqlock(const T& v = T{})
+    {
+        write_words(v);
+    }
+    void store(const T& v)
+    {
+        const uint32_t s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        write_words(v);
+        seq.store(s + 2, std::memory_order_release);
+    }
+    T load() const
+    {
+        uint64_t buf[N];
+        uint32_t s0, s1;
+        do{
+            s0 = seq.load(std::memory_order_acquire);
+            for(size_t i = 0; i < N; ++i) buf[i] = words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            s1 = seq.load(std::memory_order_relaxed);
+        } while((s0 & 1u) || s0 != s1);
+        T v;
+        std::memcpy(&v, buf, sizeof(T));
+        return v;
+    }
+private:
+    static constexpr size_t N = (sizeof(T) + 7) / 8;
+    void write_words(const T& v)
+    {
+        uint64_t buf[N] = {};
+        std::memcpy(buf, &v, sizeof(T));
+        for(size_t i = 0; i < N; ++i) words[i].store(buf[i], std::memory_order_relaxed);
+    }
+    std::atomic<uint32_t> seq{0};
+    std::atomic<uint64_t> words[N];
+};
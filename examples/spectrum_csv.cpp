@@ -0,0 +1,41 @@
+#include "spectrum_csv.hpp"
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+// Parse a wavelength,X,Y,Z table into a columnar file that python/plot_spectrum.py maps
+// without parsing. The file is the disk cache entry (a second run only maps it) or --out.
+// The last line of the output is "columns: <file>". Exit code 2 on bad input.
+// usage: spectrum_csv data.csv [--out columns.dtc]
+int main(int argc, char** argv)
+{
+    if(argc < 2){
+        std::cerr << "usage: spectrum_csv data.csv [--out columns.dtc]\n";
+        return 2;
+    }
+    std::string out;
+    for(int i = 2; i < argc; ++i){
+        const std::string a = argv[i];
+        if(a == "--out" && i + 1 < argc) out = argv[++i];
+        else { std::cerr << "unknown argument " << a << "\n"; return 2; }
+    }
+    instrumentation stats;
+    spectrum_columns cols;
+    std::string entry;
+    if(!load_spectrum_csv(argv[1], cols, &stats, &entry)) return 2;
+    if(!out.empty()){
+        if(!save_spectrum_columns(out, cols)) return 2;
+        entry = out;
+    }
+    if(entry.empty()){
+        std::cerr << "the disk cache is disabled, pass --out\n";
+        return 2;
+    }
+    if(stats.get("csv.parse_ms") > 0)
+        std::printf("%zu rows, %zu skipped, parsed in %.1f ms (%.0f MB/s)\n", cols.rows(), cols.skipped,
+                    stats.get("csv.parse_ms"), stats.get("csv.mb_per_s"));
+    else
+        std::printf("%zu rows from the cache in %.1f ms\n", cols.rows(), stats.get("csv.load_ms"));
+    std::printf("columns: %s\n", entry.c_str());
+    return 0;
+}
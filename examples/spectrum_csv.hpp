@@ -0,0 +1,236 @@
+#pragma once
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "disk_cache.hpp"
+#include "instrumentation.h"
+#include "mapped_file.hpp"
+#include "parallel_for.hpp"
+
+// Spectrum tables as read by python/plot_spectrum.py: one "wavelength,X,Y,Z" row per line,
+// extra columns ignored. Rows with fewer than four fields are skipped silently, rows with a
+// field that is not a number are skipped with a warning, as csv.reader + float() do.
+struct spectrum_columns
+{
+    std::vector<double> wavelength, x, y, z;
+    size_t skipped = 0;              // rows with a non-numeric field
+    std::vector<size_t> bad_lines;   // 1-based line numbers of the first few of them
+
+    size_t rows() const
+    {
+        return wavelength.size();
+    }
+    void resize(size_t n)
+    {
+        wavelength.resize(n);
+        x.resize(n);
+        y.resize(n);
+        z.resize(n);
+    }
+};
+
+// float() of one csv.reader field: quotes only count right at the separator, then
+// surrounding blanks and a leading '+' are allowed
+inline bool parse_spectrum_field(const char* b, const char* e, double& v)
+{
+    if(e - b >= 2 && *b == '"' && e[-1] == '"'){ ++b; --e; }
+    while(b < e && (*b == ' ' || *b == '\t')) ++b;
+    while(e > b && (e[-1] == ' ' || e[-1] == '\t')) --e;
+    if(b < e && *b == '+' && e - b > 1 && b[1] != '-' && b[1] != '+') ++b;
+    if(b == e) return false;
+    const std::from_chars_result r = std::from_chars(b, e, v);
+    if(r.ec == std::errc() && r.ptr == e) return true;
+    // float() also overflows to inf, underflows to 0 and takes single underscores between digits
+    char buf[64];
+    size_t n = 0;
+    if(size_t(e - b) >= sizeof(buf)) return false;
+    if(r.ec == std::errc::result_out_of_range && r.ptr == e){
+        std::memcpy(buf, b, e - b);
+        buf[e - b] = 0;
+        v = std::strtod(buf, nullptr);
+        return true;
+    }
+    if(!std::memchr(b, '_', e - b)) return false;
+    for(const char* q = b; q < e; ++q){
+        if(*q != '_') buf[n++] = *q;
+        else if(q == b || q + 1 == e || !std::isdigit((unsigned char)q[-1]) || !std::isdigit((unsigned char)q[1])) return false;
+    }
+    const std::from_chars_result u = std::from_chars(buf, buf + n, v);
+    return u.ec == std::errc() && u.ptr == buf + n;
+}
+
+// ---------- parser ----------
+// One run of whole lines, parsed into its own columns.
+struct spectrum_csv_chunk
+{
+    static constexpr size_t max_bad_lines = 16;
+    const char* begin;
+    const char* end;
+    spectrum_columns cols;
+    size_t lines = 0;
+    std::vector<size_t> bad;  // line index within the chunk
+
+    void parse()
+    {
+        cols.wavelength.reserve((end - begin) / 24);
+        const char* p = begin;
+        while(p < end){
+            const char* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+            const char* e = nl ? nl : end;
+            const char* line_end = e > p && e[-1] == '\r' ? e - 1 : e;
+            const char* f[5] = {p};
+            int fields = 1;
+            for(const char* q = p; q < line_end && fields < 5; ++q)
+                if(*q == ',') f[fields++] = q + 1;
+            if(fields >= 4){
+                double v[4];
+                bool ok = true;
+                for(int i = 0; i < 4 && ok; ++i)
+                    ok = parse_spectrum_field(f[i], i + 1 < fields ? f[i + 1] - 1 : line_end, v[i]);
+                if(ok){
+                    cols.wavelength.push_back(v[0]);
+                    cols.x.push_back(v[1]);
+                    cols.y.push_back(v[2]);
+                    cols.z.push_back(v[3]);
+                }
+                else{
+                    ++cols.skipped;
+                    if(bad.size() < max_bad_lines) bad.push_back(lines);
+                }
+            }
+            ++lines;
+            p = e + 1;
+        }
+    }
+};
+
+// Parse [b, e) in parallel: the text is cut at line starts into a few chunks per worker,
+// each chunk parses into its own columns, which are then copied to their final offsets.
+inline void parse_spectrum_csv(const char* b, const char* e, spectrum_columns& out)
+{
+    if(e - b >= 3 && 0 == std::memcmp(b, "\xEF\xBB\xBF", 3)) b += 3;  // UTF-8 BOM, skipped by utf-8-sig in plot_spectrum.py too
+    const size_t bytes = size_t(e - b);
+    const size_t n = std::max<size_t>(1, std::min<size_t>(job_system::current().size() * 4, bytes >> 16));
+    std::vector<spectrum_csv_chunk> chunks;
+    const char* p = b;
+    for(size_t i = 1; i <= n && p < e; ++i){
+        const char* q = i == n ? e : std::max(p, b + bytes * i / n);
+        if(q < e){
+            const char* nl = static_cast<const char*>(std::memchr(q, '\n', e - q));
+            q = nl ? nl + 1 : e;
+        }
+        if(q > p) chunks.push_back({p, q, {}, 0, {}});
+        p = q;
+    }
+    parallel_for(0, int(chunks.size()), [&](int cb, int ce){
+        for(int i = cb; i < ce; ++i) chunks[i].parse();
+    });
+
+    std::vector<size_t> first(chunks.size() + 1, 0);
+    size_t line = 0;
+    out.skipped = 0;
+    out.bad_lines.clear();
+    for(size_t i = 0; i < chunks.size(); ++i){
+        first[i + 1] = first[i] + chunks[i].cols.rows();
+        out.skipped += chunks[i].cols.skipped;
+        for(size_t k : chunks[i].bad)
+            if(out.bad_lines.size() < spectrum_csv_chunk::max_bad_lines) out.bad_lines.push_back(line + k + 1);
+        line += chunks[i].lines;
+    }
+    out.resize(first.back());
+    parallel_for(0, int(chunks.size()), [&](int cb, int ce){
+        for(int i = cb; i < ce; ++i){
+            const spectrum_columns& c = chunks[i].cols;
+            std::copy(c.wavelength.begin(), c.wavelength.end(), out.wavelength.begin() + first[i]);
+            std::copy(c.x.begin(), c.x.end(), out.x.begin() + first[i]);
+            std::copy(c.y.begin(), c.y.end(), out.y.begin() + first[i]);
+            std::copy(c.z.begin(), c.z.end(), out.z.begin() + first[i]);
+        }
+    });
+}
+
+// ---------- columnar file ----------
+// A cache entry (disk_cache.hpp) with the four columns as float64 blobs 0-3 and
+// { rows, skipped } as uint64 blob 4, readable without parsing (python/plot_spectrum.py maps it).
+inline void write_spectrum_columns(cache_writer& w, const spectrum_columns& c)
+{
+    w.add(0, c.wavelength);
+    w.add(1, c.x);
+    w.add(2, c.y);
+    w.add(3, c.z);
+    w.add(4, std::vector<uint64_t>{c.rows(), c.skipped});
+}
+inline bool read_spectrum_columns(const cache_file& f, spectrum_columns& c)
+{
+    std::vector<uint64_t> info;
+    if(!f.read(4, info, 2)) return false;
+    const size_t n = size_t(info[0]);
+    c.skipped = size_t(info[1]);
+    c.bad_lines.clear();
+    return f.read(0, c.wavelength, n) && f.read(1, c.x, n) && f.read(2, c.y, n) && f.read(3, c.z, n);
+}
+inline bool save_spectrum_columns(const std::string& path, const spectrum_columns& c)
+{
+    cache_writer w;
+    if(!w.open(path)) return false;
+    write_spectrum_columns(w, c);
+    return w.finish();
+}
+
+// Load a spectrum table through the disk cache: a hit maps the columnar entry, a miss parses
+// the file and stores the entry. Sets csv.* in stats. *entry receives the columnar file, ""
+// when the cache is disabled.
+inline bool load_spectrum_csv(const std::string& path, spectrum_columns& out, instrumentation* stats = nullptr,
+                              std::string* entry = nullptr)
+{
+    const auto t0 = std::chrono::steady_clock::now();
+    auto ms = [&]{ return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count(); };
+    disk_cache cache(stats);
+    const std::string key = disk_cache::key(path, "spectrum_csv 1");
+    if(entry) *entry = "";
+    cache_file f;
+    if(cache.open(key, f) && read_spectrum_columns(f, out)){
+        if(entry) *entry = cache.entry_path(key);
+        if(stats){
+            stats->set("csv.rows", double(out.rows()));
+            stats->set("csv.load_ms", ms());
+        }
+        return true;
+    }
+
+    mapped_file file;
+    if(!file.open(path)) return false;
+    file.sequential();
+    const char* text = reinterpret_cast<const char*>(file.data());
+    parse_spectrum_csv(text, text + file.size(), out);
+    const double parse_ms = ms();
+    for(size_t line : out.bad_lines) std::cerr << path << ":" << line << ": not a number, row skipped\n";
+    if(out.skipped > out.bad_lines.size())
+        std::cerr << path << ": " << out.skipped - out.bad_lines.size() << " more rows skipped\n";
+    if(stats){
+        stats->set("csv.rows", double(out.rows()));
+        stats->set("csv.skipped", double(out.skipped));
+        stats->set("csv.parse_ms", parse_ms);
+        stats->set("csv.mb_per_s", file.size() / double(1 << 20) / std::max(parse_ms, 1e-3) * 1e3);
+    }
+    if(out.rows() == 0){
+        std::cerr << path << ": no valid rows\n";
+        return false;
+    }
+
+    cache_writer w;
+    if(cache.create(key, w)){
+        write_spectrum_columns(w, out);
+        if(cache.commit(w) && entry) *entry = cache.entry_path(key);
+    }
+    if(stats) stats->set("csv.load_ms", ms());
+    return true;
+}
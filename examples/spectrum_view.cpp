@@ -0,0 +1,69 @@
+#include "glfw_window_2d.h"
+#include "spectrum_csv.hpp"
+#include "2d/curve_plot.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Curve mode of python/plot_spectrum.py in a native window: X, Y and Z over wavelength as
+// overlay polylines, reduced per pixel column, on a grid texture. The table is loaded through
+// the columnar disk cache.
+// usage: spectrum_view data.csv [window_type]
+// window_type: 0 OpenGL2.1, 1 OpenGL3.3, 2 software
+int main(int argc, char** argv)
+{
+    if(argc < 2){
+        std::fprintf(stderr, "usage: spectrum_view data.csv [window_type]\n");
+        return 2;
+    }
+    const window_type type = argc > 2 ? window_type(std::stoi(argv[2])) : window_type::pipline;
+    glfw_initializer init;
+    spectrum_columns cols;
+    if(!load_spectrum_csv(argv[1], cols, &init.stats)) return 2;
+    std::printf("%zu rows in %.1f ms\n", cols.rows(), init.stats.get("csv.load_ms"));
+
+    constexpr int W = 2048, H = 1024;
+    const size_t n = cols.rows();
+    const curve_axes axes = curve_axes::fit(cols.wavelength.data(), n, {cols.x.data(), cols.y.data(), cols.z.data()}, W, H);
+
+    // background with grid lines at round steps, about ten per axis
+    auto step = [](double range){
+        const double s = std::pow(10.0, std::floor(std::log10(range / 10)));
+        return range / s > 50 ? 5 * s : range / s > 20 ? 2 * s : s;
+    };
+    std::vector<uint8_t> rgb(size_t(W) * H * 3, 24);
+    auto line = [&](int x0, int y0, int x1, int y1){
+        for(int y = std::max(0, y0); y <= std::min(H - 1, y1); ++y)
+            for(int x = std::max(0, x0); x <= std::min(W - 1, x1); ++x)
+                for(int c = 0; c < 3; ++c) rgb[(size_t(y) * W + x) * 3 + c] = 60;
+    };
+    const double sx = step(axes.x1 - axes.x0), sy = step(axes.y1 - axes.y0);
+    for(double x = std::ceil(axes.x0 / sx) * sx; x <= axes.x1; x += sx){
+        const int px = int(axes.px(x));
+        line(px, 0, px, H - 1);
+    }
+    for(double y = std::ceil(axes.y0 / sy) * sy; y <= axes.y1; y += sy){
+        const int py = int(axes.py(y));
+        line(0, py, W - 1, py);
+    }
+    std::printf("wavelength %g .. %g, grid every %g; value %g .. %g, grid every %g\n",
+                axes.x0, axes.x1, sx, axes.y0, axes.y1, sy);
+
+    glfw_window_2d& win = init.create2d(type);
+    win.append_texture(rgb.data(), W, H, texture_format::rgb8);
+    const auto t0 = std::chrono::steady_clock::now();
+    size_t points = 0;
+    const std::vector<double>* curves[3] = {&cols.x, &cols.y, &cols.z};
+    const uint32_t colors[3] = {rgba(230, 60, 60), rgba(60, 200, 60), rgba(70, 110, 255)};
+    for(int i = 0; i < 3; ++i){
+        const std::vector<float> xy = curve_envelope(cols.wavelength.data(), curves[i]->data(), n, axes);
+        win.overlay().add_polyline(xy.data(), int(xy.size() / 2), colors[i]);
+        points += xy.size() / 2;
+    }
+    std::printf("curves: %zu of %zu points drawn, reduced in %.1f ms\n", points, 3 * n,
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+    win.async_loop(60).event_loop();
+    return 0;
+}
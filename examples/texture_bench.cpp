@@ -0,0 +1,69 @@
+#include "2d/texture_codec.hpp"
+#include <GLFW/glfw3.h>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+// Compare encode cost, upload time and VRAM footprint of every texture_format
+// against the uncompressed rgb8 path.
+// usage: texture_bench [size=4096] [repeat=5]
+int main(int argc, char** argv)
+{
+    const int N = argc > 1 ? std::stoi(argv[1]) : 4096;
+    const int repeat = argc > 2 ? std::stoi(argv[2]) : 5;
+    if(!glfwInit()){ std::cerr<<"glfw init failed\n"; return 1; }
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+    GLFWwindow* win = glfwCreateWindow(64, 64, "texture_bench", nullptr, nullptr);
+    if(!win){ glfwTerminate(); return 1; }
+    glfwMakeContextCurrent(win);
+#ifndef __APPLE__
+    glewExperimental = GL_TRUE;
+    if(glewInit() != GLEW_OK){ std::cerr<<"glew init failed\n"; return 1; }
+    glGetError(); // glewExperimental on a core context can leave GL_INVALID_ENUM behind
+#endif
+
+    std::vector<float> field(size_t(N) * N);
+    parallel_for(0, N, [&](int b, int e){
+        for(int y = b; y < e; ++y)
+            for(int x = 0; x < N; ++x)
+                field[size_t(y) * N + x] = std::sin(x * 0.01f) * std::cos(y * 0.007f) + 0.1f * std::sin(x * y * 1e-5f);
+    });
+
+    using clock = std::chrono::high_resolution_clock;
+    auto ms = [](clock::duration d){ return std::chrono::duration<double, std::milli>(d).count(); };
+    const size_t base = texture_bytes(texture_format::rgb8, N, N);
+
+    std::printf("%dx%d, best of %d\n", N, N, repeat);
+    std::printf("%-6s %12s %12s %12s %10s\n", "format", "encode(ms)", "upload(ms)", "VRAM(MiB)", "vs rgb8");
+    for(int f = int(texture_format::rgb8); f <= int(texture_format::bc1); ++f){
+        const texture_format fmt = texture_format(f);
+        double enc = 1e30, up = 1e30;
+        size_t bytes = 0;
+        for(int r = 0; r < repeat; ++r){
+            auto t0 = clock::now();
+            texture_image img = encode_scalar(field.data(), N, N, fmt);
+            auto t1 = clock::now();
+            gpu_texture tex = upload_texture_image(img);
+            glFinish();
+            auto t2 = clock::now();
+            enc = std::min(enc, ms(t1 - t0));
+            up = std::min(up, ms(t2 - t1));
+            bytes = tex.bytes;
+            glDeleteTextures(1, &tex.id);
+        }
+        std::printf("%-6s %12.2f %12.2f %12.2f %9.2fx\n", texture_format_name(fmt), enc, up,
+            bytes / (1024.0 * 1024.0), double(base) / double(bytes));
+    }
+    if(GLenum err = glGetError(); err != GL_NO_ERROR)
+        std::cerr<<"GL error 0x"<<std::hex<<err<<"\n";
+
+    glfwDestroyWindow(win);
+    glfwTerminate();
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include "cli_args.hpp"
+#include "demo_scene.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+// Replay a session recorded with DISPLAY_TOOL_TRACE=file image_2d ... on the headless software
+// renderer and report per-frame shading times, for regression runs in CI. Exit code 1 when a
+// threshold is exceeded or the replay did not reproduce the recorded camera, 2 on bad input.
+// usage: trace_replay trace.dtt [--fps 60] [--realtime] [--csv frames.csv]
+//            [--max-mean ms] [--max-p95 ms] [--max-p99 ms]
+int main(int argc, char** argv)
+{
+    if(argc < 2){
+        std::cerr << "usage: trace_replay trace.dtt [--fps 60] [--realtime] [--csv frames.csv]\n"
+                     "           [--max-mean ms] [--max-p95 ms] [--max-p99 ms]\n";
+        return 2;
+    }
+    float fps = 60.0f;
+    bool realtime = false;
+    std::string csv;
+    double max_mean = -1, max_p95 = -1, max_p99 = -1;
+    try{
+        for(int i = 2; i < argc; ++i){
+            const std::string a = argv[i];
+            auto value = [&]{
+                if(i + 1 >= argc) throw std::invalid_argument(a + " needs a value");
+                return parse_number(argv[++i]);
+            };
+            if(a == "--fps") fps = float(value());
+            else if(a == "--realtime") realtime = true;
+            else if(a == "--csv" && i + 1 < argc) csv = argv[++i];
+            else if(a == "--max-mean") max_mean = value();
+            else if(a == "--max-p95") max_p95 = value();
+            else if(a == "--max-p99") max_p99 = value();
+            else { std::cerr << "unknown argument " << a << "\n"; return 2; }
+        }
+        if(!(fps > 0)) throw std::invalid_argument("--fps must be positive");
+    }
+    catch(const std::exception& e){
+        std::cerr << "bad argument: " << e.what() << "\n";
+        return 2;
+    }
+    input_trace trace;
+    if(!trace.load(argv[1])) return 2;
+
+#ifdef _WIN32
+    _putenv_s("DISPLAY_TOOL_HEADLESS", "1");
+#else
+    setenv("DISPLAY_TOOL_HEADLESS", "1", 1);
+#endif
+    glfw_initializer init;
+    glfw_window_2d& win = init.create2d(window_type::software);
+    if(trace.header.scene >= 0) build_demo_scene(win, init.stats, texture_format(trace.header.scene));
+
+    const replay_stats r = win.replay(trace, fps, realtime);
+    r.publish(init.stats);
+    init.jobs.publish(init.stats);
+    std::printf("%zu events over %.1f s, %zu frames at %g fps (%s), %.0f ms wall\n", r.events, trace.seconds(),
+                r.frame_ms.size(), fps, realtime ? "recorded speed" : "maximum speed", r.wall_ms);
+    std::printf("frame ms: mean %.3f  p50 %.3f  p95 %.3f  p99 %.3f  max %.3f\n", r.mean(),
+                r.percentile(0.50), r.percentile(0.95), r.percentile(0.99), r.percentile(1.0));
+    if(!csv.empty()){
+        std::FILE* f = std::fopen(csv.c_str(), "w");
+        if(!f){ std::cerr << "can not write " << csv << "\n"; return 2; }
+        std::fprintf(f, "frame,ms\n");
+        for(size_t i = 0; i < r.frame_ms.size(); ++i) std::fprintf(f, "%zu,%.4f\n", i, r.frame_ms[i]);
+        std::fclose(f);
+    }
+
+    bool fail = false;
+    auto check = [&](const char* what, double v, double limit){
+        if(limit < 0 || v <= limit) return;
+        std::printf("FAIL: %s %.3f ms > %.3f ms\n", what, v, limit);
+        fail = true;
+    };
+    check("mean", r.mean(), max_mean);
+    check("p95", r.percentile(0.95), max_p95);
+    check("p99", r.percentile(0.99), max_p99);
+    if(r.camera_mismatches){
+        std::printf("FAIL: %zu camera states not reproduced\n", r.camera_mismatches);
+        fail = true;
+    }
+    return fail ? 1 : 0;
+}
@@ -10,6 +10,9 @@ SpectrumPlot v1.0
 import argparse
 import os
 import csv
+import shutil
+import struct
+import subprocess
 import numpy as np
 import matplotlib.pyplot as plt
 from mpl_toolkits.mplot3d import Axes3D  # noqa: F401
@@ -30,14 +33,49 @@ XYZ_TO_LINEAR_RGB = np.array([
 # -------------------------
 # 文件解析
 # -------------------------
-def parse_data(file_path):
+def read_columns(path):
+    """读取 spectrum_csv 写出的列式文件 (DTCACHE1)，内存映射，无需解析"""
+    raw = np.memmap(path, dtype=np.uint8, mode='r')
+    magic, version, count, index_offset = struct.unpack_from('<8sIIQ', raw, 0)
+    if magic != b'DTCACHE1' or version != 1:
+        raise ValueError(f"{path} 不是列式缓存文件")
+    index = np.frombuffer(raw, dtype='<u8', count=3 * count, offset=index_offset).reshape(count, 3)
+    blobs = {int(i): (int(o), int(b)) for i, o, b in index}
+    rows, skipped = np.frombuffer(raw, dtype='<u8', count=2, offset=blobs[4][0])
+    cols = [np.frombuffer(raw, dtype='<f8', count=int(rows), offset=blobs[k][0]) for k in range(4)]
+    return cols, int(skipped)
+
+
+def parse_data_native(file_path):
+    """用 display_tool 的 spectrum_csv (并行 mmap 解析 + 磁盘缓存) 读取；不可用时返回 None"""
+    tool = os.environ.get("DISPLAY_TOOL_SPECTRUM_CSV") or shutil.which("spectrum_csv")
+    if not tool:
+        return None
+    try:
+        out = subprocess.run([tool, file_path], stdout=subprocess.PIPE, text=True, check=True).stdout
+        path = out.strip().splitlines()[-1].split("columns: ", 1)[1]
+        (W, IX, IY, IZ), skipped = read_columns(path)
+    except (OSError, subprocess.CalledProcessError, IndexError, ValueError, KeyError) as e:
+        print(f"警告：spectrum_csv 不可用 ({e})，改用 Python 解析。")
+        return None
+    if skipped:
+        print(f"警告：{skipped} 行包含非数字，跳过。")
+    print(f"成功读取 {len(W)} 条数据。")
+    return W, IX, IY, IZ
+
+
+def parse_data(file_path, native=True):
     if not os.path.exists(file_path):
         print(f"错误：文件未找到！请检查路径: {file_path}")
         return None, None, None, None
+    if native:
+        data = parse_data_native(file_path)
+        if data is not None:
+            return data
 
     wavelengths, ix, iy, iz = [], [], [], []
     try:
-        with open(file_path, mode='r', newline='', encoding='utf-8') as f:
+        with open(file_path, mode='r', newline='', encoding='utf-8-sig') as f:
             reader = csv.reader(f)
             for i, row in enumerate(reader):
                 if len(row) < 4:
@@ -225,11 +263,13 @@ def main():
     parser.add_argument("-m", "--plot-mode", type=int, default=0,
                         choices=PLOT_MODES.keys(),
                         help="绘图模式: 0=curve, 1=3d-scatter, 2=chromaticity, 3=gamut")
+    parser.add_argument("--python-parser", action="store_true",
+                        help="不使用 spectrum_csv (DISPLAY_TOOL_SPECTRUM_CSV 或 PATH 中)，逐行解析")
     parser.add_argument("-h", "--help", action="help", help="显示帮助并退出")
     parser.add_argument("-v", "--version", action="version", version=VERSION)
     args = parser.parse_args()
 
-    W, IX, IY, IZ = parse_data(args.file_path)
+    W, IX, IY, IZ = parse_data(args.file_path, native=not args.python_parser)
     if W is None:
         return
 